@@ -0,0 +1,972 @@
+/*
+Load generator for the HTTP web server
+
+Submits a batch of tasks through POST /taches from several client threads,
+then polls GET /taches until every task has reached a final status. Reports
+the submission rate and how long the cluster took to drain the batch.
+
+--url takes a comma-separated list of servers. Tasks are spread evenly over
+them, or with --skew F a fraction F of them goes to the first server and the
+rest is spread over the others.
+
+Example local cluster with pull-based workers of different speeds:
+  ./DistributedTaskManager --coordinator --lease-port 5000 --port 3000
+  ./DistributedTaskManager --worker --lease-from localhost:5000 --threads 4
+  ./DistributedTaskManager --worker --lease-from localhost:5000 --threads 1
+  ./Benchmark --tasks 200 --duration 50 --clients 4
+
+Replacing the coordinator with
+  ./DistributedTaskManager --coordinator --workers localhost:4001,localhost:4002
+and the workers with --worker --port 4001 / 4002 gives the push-based baseline.
+
+A replicated group, measuring what the commit costs per submission:
+  ./DistributedTaskManager --port 300N --replicas localhost:6000,localhost:6001,localhost:6002 --replica-id N
+for N = 0, 1, 2, then point --url at any of them. Add --no-fsync to all three
+to separate the fsync cost from the network round trips.
+
+Work stealing under skewed submission: two coordinators, each pushing to its
+own worker, with the workers peering with each other:
+  ./DistributedTaskManager --worker --port 4001 --peers localhost:4002
+  ./DistributedTaskManager --worker --port 4002 --peers localhost:4001
+  ./DistributedTaskManager --coordinator --port 3000 --workers localhost:4001
+  ./DistributedTaskManager --coordinator --port 3001 --workers localhost:4002
+  ./Benchmark --url http://localhost:3000,http://localhost:3001 --skew 0.9 --tasks 200
+Dropping --peers from the workers gives the baseline without stealing.
+
+The binary protocol instead of REST, with up to 32 creations in flight on
+each client's connection:
+  ./DistributedTaskManager --rpc 5100,unix:/tmp/tasks.sock
+  ./Benchmark --rpc localhost:5100 --inflight 32 --tasks 100000 --duration 0
+--rpc takes addresses ("host:port" or "unix:/path") where --url takes urls.
+
+How many connections a node serves at once: --connections N keeps N task
+creations in flight, each on a connection of its own, from a single thread,
+and reports the rate and latencies. A node whose request threads waited for
+each operation would serve only as many connections as it has threads, the
+others queuing behind them:
+  ./Benchmark --url http://localhost:3000 --connections 256 --tasks 50000 --duration 0
+
+Durable submission throughput against the flush interval: restart the node
+with each setting, e.g.
+  ./DistributedTaskManager --rpc 5100 --durability every-op --sync-interval 0
+  ./DistributedTaskManager --rpc 5100 --durability every-op --sync-interval 2
+  ./DistributedTaskManager --rpc 5100 --durability batch --sync-interval 10
+and submit with many creations in flight so that they can share flushes:
+  ./Benchmark --rpc localhost:5100 --clients 16 --inflight 8 --tasks 20000 --duration 0
+
+What a node pays in memory and time for each task it holds, without a
+server: --allocations N creates N tasks the way nodes do, from the task
+pool, frees them and creates them again from the recycled blocks, then does
+the same with plain heap allocation for comparison:
+  ./Benchmark --allocations 10000000
+
+How long a node takes to count its tasks by status and to list those in one
+status: --scan N registers N tasks spread over the statuses, then times both
+over the status column nodes scan and, for comparison, over the map of tasks:
+  ./Benchmark --scan 10000000
+Each pass also reports the dTLB misses it took, when perf events are
+available. Tasks and the index sit on huge pages unless --huge-pages off, so
+running it with each mode shows what they save:
+  ./Benchmark --scan 10000000 --huge-pages off
+  ./Benchmark --scan 10000000 --huge-pages transparent
+  ./Benchmark --scan 10000000 --huge-pages explicit
+the last after reserving pages, e.g. sysctl vm.nr_hugepages=1024.
+
+How lookups fare while tasks are being evicted: --churn N registers N tasks,
+then for a few seconds has a thread per core look random ones up while one
+thread keeps evicting and replacing them, once through the lock-free index
+nodes use and once through a map behind a lock:
+  ./Benchmark --churn 1000000
+
+What reading a POST /taches body costs a node: --parse N parses a small body
+and a 4KB one with other members around the fields N times each, as a JSON
+document and with the single-pass parser nodes use:
+  ./Benchmark --parse 1000000
+
+What writing task responses costs a node: --serialize N renders one task N
+times and a listing of N tasks once, through a crow::json::wvalue tree and
+with the writer nodes use:
+  ./Benchmark --serialize 100000
+
+What JSON costs against MessagePack and CBOR, which nodes also answer in:
+--formats N writes a listing of N tasks in each, and reports its size, the
+time a node takes to write it and the time a client takes to read it:
+  ./Benchmark --formats 100000
+*/
+
+#include <crow.h>
+#include <curl/curl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "BinaryWriter.hpp"
+#include "Connection.hpp"
+#include "Epochs.hpp"
+#include "HugePages.hpp"
+#include "JsonWriter.hpp"
+#include "MockTask.hpp"
+#include "Protocol.hpp"
+#include "TaskColumns.hpp"
+#include "TaskIndex.hpp"
+#include "TaskRequest.hpp"
+#include "TaskSlots.hpp"
+
+using json = nlohmann::json;
+
+size_t WriteCallback(char *contents, size_t size, size_t nmemb, void *userp)
+{
+    (static_cast<std::string*>(userp))->append(contents, size * nmemb);
+    return size * nmemb;
+}
+
+// One connection reused for every request, like a pooled production client
+class Client {
+public:
+    Client(const std::string& baseUrl) : m_baseUrl(baseUrl), m_handle(curl_easy_init()) {
+        m_headers = curl_slist_append(nullptr, "Content-Type: application/json");
+        curl_easy_setopt(m_handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(m_handle, CURLOPT_WRITEDATA, &m_response);
+    }
+
+    bool createTask(const std::string& description, int duration) {
+        std::string body = "{\"description\":\"" + description + "\",\"duration\":" + std::to_string(duration) + "}";
+        curl_easy_setopt(m_handle, CURLOPT_HTTPHEADER, m_headers);
+        curl_easy_setopt(m_handle, CURLOPT_POSTFIELDS, body.c_str());
+        auto response = perform("/taches");
+        curl_easy_setopt(m_handle, CURLOPT_HTTPGET, 1L);
+        return response.contains("id");
+    }
+
+    json getAllTasks() {
+        curl_easy_setopt(m_handle, CURLOPT_HTTPGET, 1L);
+        return perform("/taches");
+    }
+
+    ~Client() {
+        curl_slist_free_all(m_headers);
+        curl_easy_cleanup(m_handle);
+    }
+private:
+    json perform(const std::string& path) {
+        m_response.clear();
+        std::string url = m_baseUrl + path;
+        curl_easy_setopt(m_handle, CURLOPT_URL, url.c_str());
+        if(curl_easy_perform(m_handle) != CURLE_OK) {
+            return json();
+        }
+        return json::parse(m_response, nullptr, false);
+    }
+
+    std::string m_baseUrl;
+    CURL* m_handle;
+    curl_slist* m_headers;
+    std::string m_response;
+};
+
+// Binary protocol client, keeping several creations on the wire at once
+class RpcClient {
+public:
+    RpcClient(const std::string& address, size_t inflight) : m_connection(address), m_inflight(inflight), m_failed(0) {}
+
+    // Sends a creation, first waiting for the oldest one if too many are in
+    // flight
+    void createTask(const std::string& description, int duration) {
+        if(m_sent.size() >= m_inflight) {
+            waitOldest();
+        }
+        protocol::Writer request;
+        request.writeString(description);
+        request.writeI32(duration);
+        m_sent.push_back(m_connection.send(protocol::MessageType::CreateTask, request));
+    }
+
+    // Waits for the creations still in flight; returns how many failed
+    int finish() {
+        while(!m_sent.empty()) {
+            waitOldest();
+        }
+        return m_failed;
+    }
+
+    // Same shape as the REST listing, as far as the benchmark looks
+    json getAllTasks() {
+        auto tasks = json::array();
+        try {
+            auto response = m_connection.call(protocol::MessageType::ListTasks, protocol::Writer());
+            for(const auto& view : protocol::Reader(response.payload).readViews()) {
+                tasks.push_back({{"description", view.description.str()}, {"status", view.status}});
+            }
+        } catch(const std::exception&) {}
+        return tasks;
+    }
+private:
+    void waitOldest() {
+        try {
+            auto response = m_sent.front().get();
+            if(protocol::Reader(response.payload).readView().id.empty()) {
+                ++m_failed;
+            }
+        } catch(const std::exception&) {
+            ++m_failed;
+        }
+        m_sent.pop_front();
+    }
+
+    Connection m_connection;
+    size_t m_inflight;
+    int m_failed;
+    std::deque<std::future<protocol::Frame>> m_sent;
+};
+
+struct Options {
+    // Server urls, or binary protocol addresses with --rpc
+    std::vector<std::string> urls = {"http://localhost:3000"};
+    bool rpc = false;
+    // Creations each client keeps in flight per server, with --rpc
+    size_t inflight = 1;
+    int tasks = 100;
+    int duration = 100;
+    int clients = 4;
+    // Share of the tasks sent to the first url, or negative to spread evenly
+    double skew = -1;
+    // Tasks to allocate in memory instead of submitting to servers
+    int allocations = 0;
+    // Tasks to register in memory and scan
+    int scan = 0;
+    HugePages::Mode hugePages = HugePages::Mode::Transparent;
+    // Tasks to register in memory and look up while evicting them
+    int churn = 0;
+    // Connections to keep a creation in flight on at once, from one thread
+    int connections = 0;
+    // Times to parse each request body, without a server
+    int parse = 0;
+    // Tasks to list in a response, without a server
+    int serialize = 0;
+    // Tasks to list in each media type, without a server
+    int formats = 0;
+};
+
+std::vector<std::string> splitUrls(const std::string& list) {
+    std::vector<std::string> urls;
+    std::stringstream stream(list);
+    std::string url;
+    while(std::getline(stream, url, ',')) {
+        if(!url.empty()) {
+            urls.push_back(url);
+        }
+    }
+    return urls;
+}
+
+// Server that the i-th task is submitted to
+size_t pickServer(const Options& options, int i) {
+    const auto servers = options.urls.size();
+    if(options.skew < 0 || servers == 1) {
+        return i % servers;
+    }
+    // Spreads the first url's share evenly over the run
+    const auto before = static_cast<int>(options.skew * i);
+    const auto after = static_cast<int>(options.skew * (i + 1));
+    if(after > before) {
+        return 0;
+    }
+    return 1 + (i - after) % (servers - 1);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--url") {
+            options.urls = splitUrls(argv[i + 1]);
+        } else if(arg == "--rpc") {
+            options.urls = splitUrls(argv[i + 1]);
+            options.rpc = true;
+        } else if(arg == "--inflight") {
+            options.inflight = std::stoul(argv[i + 1]);
+        } else if(arg == "--tasks") {
+            options.tasks = std::stoi(argv[i + 1]);
+        } else if(arg == "--duration") {
+            options.duration = std::stoi(argv[i + 1]);
+        } else if(arg == "--clients") {
+            options.clients = std::stoi(argv[i + 1]);
+        } else if(arg == "--skew") {
+            options.skew = std::stod(argv[i + 1]);
+        } else if(arg == "--allocations") {
+            options.allocations = std::stoi(argv[i + 1]);
+        } else if(arg == "--scan") {
+            options.scan = std::stoi(argv[i + 1]);
+        } else if(arg == "--huge-pages") {
+            auto hugePages = hugePagesFromString(argv[i + 1]);
+            if(!hugePages) {
+                return false;
+            }
+            options.hugePages = *hugePages;
+        } else if(arg == "--churn") {
+            options.churn = std::stoi(argv[i + 1]);
+        } else if(arg == "--connections") {
+            options.connections = std::stoi(argv[i + 1]);
+        } else if(arg == "--parse") {
+            options.parse = std::stoi(argv[i + 1]);
+        } else if(arg == "--serialize") {
+            options.serialize = std::stoi(argv[i + 1]);
+        } else if(arg == "--formats") {
+            options.formats = std::stoi(argv[i + 1]);
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && options.clients > 0 && !options.urls.empty() && options.skew <= 1
+        && options.inflight > 0 && (options.rpc || options.inflight == 1) && (!options.rpc || options.connections == 0);
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Creates count tasks with make, frees them and creates them again, then
+// reports the memory each took and the rates
+void benchmarkAllocation(const std::string& name, int count,
+                         const std::function<std::shared_ptr<MockTask>(const std::string&, const std::string&)>& make) {
+    std::vector<std::shared_ptr<MockTask>> tasks(count);
+    // UUID-shaped, rewritten in place so that building them allocates nothing
+    std::string id(36, '0');
+    auto create = [&](){
+        for(int i = 0; i < count; ++i) {
+            std::snprintf(&id[0], id.size() + 1, "%08x-0000-4000-8000-%012x", static_cast<unsigned>(i), static_cast<unsigned>(i));
+            tasks[i] = make(id, "bench");
+        }
+    };
+    auto destroy = [&](){
+        for(auto& task : tasks) {
+            task.reset();
+        }
+    };
+
+    const auto before = residentBytes();
+    auto start = std::chrono::steady_clock::now();
+    create();
+    const double createSeconds = secondsSince(start);
+    const auto bytes = residentBytes() - before;
+    start = std::chrono::steady_clock::now();
+    destroy();
+    const double destroySeconds = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    create();
+    const double recreateSeconds = secondsSince(start);
+    destroy();
+
+    std::cout << name << ": " << static_cast<double>(bytes) / count << " bytes per task, "
+              << count / createSeconds << " creations/s, " << count / destroySeconds << " destructions/s, "
+              << count / recreateSeconds << " creations/s reusing freed memory" << std::endl;
+}
+
+// Counts this thread's data TLB misses on reads, where the kernel and the
+// CPU allow it
+class TlbMisses {
+public:
+    TlbMisses() {
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~TlbMisses() {
+        if(m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    bool available() const {
+        return m_fd >= 0;
+    }
+    void start() {
+        if(m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    uint64_t stop() {
+        uint64_t misses = 0;
+        if(m_fd >= 0) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if(read(m_fd, &misses, sizeof(misses)) != sizeof(misses)) {
+                misses = 0;
+            }
+        }
+        return misses;
+    }
+private:
+    int m_fd;
+};
+
+// Kilobytes of this process backed by transparent and by explicit huge pages
+std::pair<size_t, size_t> hugePageKilobytes() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+    size_t transparent = 0;
+    size_t reserved = 0;
+    while(std::getline(smaps, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        size_t kilobytes = 0;
+        fields >> key >> kilobytes;
+        if(key == "AnonHugePages:") {
+            transparent = kilobytes;
+        } else if(key == "Private_Hugetlb:" || key == "Shared_Hugetlb:") {
+            reserved += kilobytes;
+        }
+    }
+    return {transparent, reserved};
+}
+
+// Runs scan a few times and reports the fastest, in milliseconds, with the
+// dTLB misses it took
+template<typename Scan>
+void timeScan(const std::string& name, Scan scan) {
+    TlbMisses tlbMisses;
+    double best = 0;
+    uint64_t misses = 0;
+    size_t found = 0;
+    for(int run = 0; run < 5; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        tlbMisses.start();
+        found = scan();
+        const auto runMisses = tlbMisses.stop();
+        const double seconds = secondsSince(start);
+        if(run == 0 || seconds < best) {
+            best = seconds;
+            misses = runMisses;
+        }
+    }
+    std::cout << name << ": " << best * 1000 << " ms (" << found << " tasks), ";
+    if(tlbMisses.available()) {
+        std::cout << misses << " dTLB misses" << std::endl;
+    } else {
+        std::cout << "dTLB misses unavailable" << std::endl;
+    }
+}
+
+// Registers count tasks both in a map, as nodes used to scan them, and in
+// status columns, then times counting and listing over each, and looking
+// tasks up by id in the index nodes use
+void benchmarkScan(int count) {
+    std::unordered_map<std::string, std::shared_ptr<MockTask>> tasks;
+    tasks.reserve(count);
+    TaskColumns columns;
+    TaskIndex index;
+    index.reserve(count);
+    std::vector<std::string> ids;
+    ids.reserve(count);
+    std::string id(36, '0');
+    for(int i = 0; i < count; ++i) {
+        std::snprintf(&id[0], id.size() + 1, "%08x-0000-4000-8000-%012x", static_cast<unsigned>(i), static_cast<unsigned>(i));
+        auto task = MockTask::create(id, "bench", 0);
+        // Mostly finished, as on a long-running node
+        const auto roll = i % 20;
+        task->setRemoteStatus(roll == 0 ? MockTask::Status::Waiting : roll == 1 ? MockTask::Status::Running
+            : roll == 2 ? MockTask::Status::Failed : roll == 3 ? MockTask::Status::Cancelled : MockTask::Status::Finished);
+        task->setRow(columns.add(*task));
+        index.insert(id, TaskHandle{static_cast<uint32_t>(i), 1}, task.get());
+        ids.push_back(id);
+        tasks.emplace(id, std::move(task));
+    }
+    const auto hugePages = hugePageKilobytes();
+    std::cout << "Backed by huge pages: " << hugePages.first / 1024 << " MB transparent, "
+              << hugePages.second / 1024 << " MB reserved" << std::endl;
+
+    timeScan("Count, map", [&tasks](){
+        TaskCounts counts = {};
+        for(const auto& entry : tasks) {
+            ++counts[entry.second->getStatus()];
+        }
+        return counts[MockTask::Status::Running];
+    });
+    timeScan("Count, columns", [&columns](){
+        return columns.count()[MockTask::Status::Running];
+    });
+    timeScan("List running, map", [&tasks](){
+        std::vector<MockTaskView> views;
+        for(const auto& entry : tasks) {
+            if(entry.second->getStatus() == MockTask::Status::Running) {
+                views.push_back(entry.second->getView());
+            }
+        }
+        return views.size();
+    });
+    timeScan("List running, columns", [&columns](){
+        return columns.view(MockTask::Status::Running).size();
+    });
+    // Ids in a fixed random order, so every run misses the same pages
+    std::shuffle(ids.begin(), ids.end(), std::mt19937(42));
+    timeScan("Look up all, index", [&index, &ids](){
+        size_t running = 0;
+        for(const auto& id : ids) {
+            running += index.find(id)->task->getStatus() == MockTask::Status::Running;
+        }
+        return running;
+    });
+}
+
+// Tasks in a map behind one lock, which lookups take too
+class LockedRegistry {
+public:
+    bool view(const std::string& id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_tasks.find(id);
+        if(it == m_tasks.end()) {
+            return false;
+        }
+        return !it->second->getView().id.empty();
+    }
+
+    void add(std::shared_ptr<MockTask> task) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks[task->getId()] = std::move(task);
+    }
+
+    void remove(const std::string& id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.erase(id);
+    }
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<MockTask>> m_tasks;
+};
+
+// Tasks kept as TaskManager keeps them: lookups take no lock, and removals
+// are deferred until no lookup can still see them
+class EpochRegistry {
+public:
+    bool view(const std::string& id) const {
+        Epochs::Guard guard;
+        auto* entry = m_index.find(id);
+        if(entry == nullptr) {
+            return false;
+        }
+        return !entry->task->getView().id.empty();
+    }
+
+    void add(std::shared_ptr<MockTask> task) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto id = task->getId();
+        auto* registered = task.get();
+        m_index.insert(id, m_slots.insert(std::move(task)), registered);
+    }
+
+    void remove(const std::string& id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto* entry = m_index.find(id);
+        if(entry == nullptr) {
+            return;
+        }
+        auto task = m_slots.erase(entry->handle);
+        m_index.erase(id);
+        Epochs::retire([task]() mutable { task.reset(); });
+    }
+private:
+    std::mutex m_mutex;
+    TaskSlots m_slots;
+    TaskIndex m_index;
+};
+
+// Registers count tasks, then times lookups from a thread per core against
+// one thread evicting tasks and registering them again
+template<typename Registry>
+void benchmarkChurn(const std::string& name, int count) {
+    Registry registry;
+    auto idOf = [](int i) {
+        std::string id(36, '0');
+        std::snprintf(&id[0], id.size() + 1, "%08x-0000-4000-8000-%012x", static_cast<unsigned>(i), static_cast<unsigned>(i));
+        return id;
+    };
+    for(int i = 0; i < count; ++i) {
+        registry.add(MockTask::create(idOf(i), "bench", 0));
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<size_t> lookups(0);
+    std::atomic<size_t> found(0);
+    std::vector<std::thread> readers;
+    const auto threads = std::max(1u, std::thread::hardware_concurrency() - 1);
+    for(unsigned t = 0; t < threads; ++t) {
+        readers.emplace_back([&, t](){
+            uint64_t random = t + 1;
+            size_t mine = 0;
+            size_t hits = 0;
+            while(!done.load(std::memory_order_relaxed)) {
+                random = random * 6364136223846793005ull + 1442695040888963407ull;
+                hits += registry.view(idOf(static_cast<int>((random >> 33) % count)));
+                ++mine;
+            }
+            lookups += mine;
+            found += hits;
+        });
+    }
+
+    size_t evictions = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while(secondsSince(start) < 3) {
+        const auto id = idOf(static_cast<int>(evictions % count));
+        registry.remove(id);
+        registry.add(MockTask::create(id, "bench", 0));
+        ++evictions;
+    }
+    done = true;
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    const double seconds = secondsSince(start);
+    std::cout << name << ": " << lookups / seconds << " lookups/s over " << threads << " threads ("
+              << 100.0 * found / std::max<size_t>(1, lookups) << "% found), " << evictions / seconds << " evictions/s"
+              << std::endl;
+}
+
+// Parses body count times as a JSON document and with the parser nodes use,
+// and reports the time and throughput of each
+void benchmarkParse(const std::string& name, const std::string& body, int count) {
+    auto report = [&](const std::string& parser, const std::function<size_t()>& parse) {
+        size_t check = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; ++i) {
+            check += parse();
+        }
+        const double seconds = secondsSince(start);
+        std::cout << name << ", " << parser << ": " << seconds * 1e9 / count << " ns/parse, "
+                  << body.size() * static_cast<double>(count) / seconds / 1e6 << " MB/s (" << check / count << ")"
+                  << std::endl;
+    };
+    report("document", [&body]() {
+        const json document = json::parse(body);
+        return document["description"].get<std::string>().size() + document["duration"].get<int>();
+    });
+    report("single pass", [&body]() {
+        const auto request = std::get<CreateTaskRequest>(parseCreateTask(body));
+        return request.descriptionString().size() + request.duration;
+    });
+}
+
+// Renders a response for a single task and one listing count tasks, count
+// times and once, as a crow::json::wvalue and with the writer nodes use, and
+// reports the time per task and throughput of each
+void benchmarkSerialize(int count) {
+    std::vector<MockTaskView> tasks;
+    tasks.reserve(count);
+    for(int i = 0; i < count; ++i) {
+        tasks.push_back(MockTask("bench serialize " + std::to_string(i % 1000), i % 5000).getView());
+    }
+
+    auto report = [](const std::string& name, int rounds, int perRound, const std::function<size_t()>& render) {
+        size_t bytes = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < rounds; ++i) {
+            bytes += render();
+        }
+        const double seconds = secondsSince(start);
+        std::cout << name << ": " << seconds * 1e9 / rounds / perRound << " ns/task, "
+                  << bytes / seconds / 1e6 << " MB/s" << std::endl;
+    };
+    auto toWvalue = [](const MockTaskView& task) {
+        crow::json::wvalue value;
+        value["id"] = task.id;
+        value["status"] = task.status;
+        value["description"] = task.description.str();
+        value["duration"] = task.duration;
+        return value;
+    };
+    JsonWriter writer;
+
+    report("One task, wvalue", count, 1, [&]() {
+        return toWvalue(tasks.front()).dump().size();
+    });
+    report("One task, writer", count, 1, [&]() {
+        writer.clear();
+        writer.task(tasks.front());
+        return writer.str().size();
+    });
+    const auto listing = std::to_string(count) + " tasks, ";
+    report(listing + "wvalue", 1, count, [&]() {
+        crow::json::wvalue value;
+        for(size_t i = 0; i < tasks.size(); ++i) {
+            value[i] = toWvalue(tasks[i]);
+        }
+        return value.dump().size();
+    });
+    report(listing + "writer", 1, count, [&]() {
+        writer.clear();
+        writer.tasks(tasks);
+        return writer.str().size();
+    });
+}
+
+// Lists count tasks in JSON, MessagePack and CBOR, and reports the size of
+// each listing, the time the node takes to write it and the time a client
+// takes to read it back with nlohmann
+void benchmarkFormats(int count) {
+    std::vector<MockTaskView> tasks;
+    tasks.reserve(count);
+    for(int i = 0; i < count; ++i) {
+        tasks.push_back(MockTask("bench formats " + std::to_string(i % 1000), i % 5000).getView());
+    }
+
+    JsonWriter json;
+    BinaryWriter messagePack(MediaType::MessagePack);
+    BinaryWriter cbor(MediaType::Cbor);
+    const std::vector<std::pair<ResponseWriter*, std::function<size_t(const std::string&)>>> formats = {
+        {&json, [](const std::string& body) { return json::parse(body).size(); }},
+        {&messagePack, [](const std::string& body) { return json::from_msgpack(body).size(); }},
+        {&cbor, [](const std::string& body) { return json::from_cbor(body).size(); }},
+    };
+    for(const auto& [writer, read] : formats) {
+        // Once to size the buffer, as a node's writer is after its first
+        // listing, then timed
+        writer->clear();
+        writer->tasks(tasks);
+        writer->clear();
+        auto start = std::chrono::steady_clock::now();
+        writer->tasks(tasks);
+        const double writeSeconds = secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        const size_t tasksRead = read(writer->str());
+        const double readSeconds = secondsSince(start);
+        std::cout << mediaTypeToString(writer->mediaType()) << ": " << writer->str().size() / 1e6 << " MB, written in "
+                  << writeSeconds * 1e3 << " ms, read in " << readSeconds * 1e3 << " ms (" << tasksRead << " tasks)"
+                  << std::endl;
+    }
+}
+
+// Creates tasks on the first url with a request in flight on each of the
+// connections, all driven from this thread, and reports the rate and
+// latencies
+void benchmarkConnections(const std::string& url, int connections, int tasks, int duration) {
+    struct Request {
+        CURL* handle;
+        std::string response;
+        std::chrono::steady_clock::time_point sent;
+    };
+    CURLM* multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(connections));
+    auto* headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    const auto target = url + "/taches";
+    const auto body = "{\"description\":\"bench connections\",\"duration\":" + std::to_string(duration) + "}";
+    std::vector<Request> requests(connections);
+    int sent = 0;
+    auto send = [&](Request& request) {
+        request.response.clear();
+        request.sent = std::chrono::steady_clock::now();
+        curl_multi_add_handle(multi, request.handle);
+        ++sent;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    for(auto& request : requests) {
+        request.handle = curl_easy_init();
+        curl_easy_setopt(request.handle, CURLOPT_URL, target.c_str());
+        curl_easy_setopt(request.handle, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(request.handle, CURLOPT_POSTFIELDS, body.c_str());
+        curl_easy_setopt(request.handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(request.handle, CURLOPT_WRITEDATA, &request.response);
+        curl_easy_setopt(request.handle, CURLOPT_PRIVATE, &request);
+        if(sent < tasks) {
+            send(request);
+        }
+    }
+    std::vector<double> latencies;
+    latencies.reserve(tasks);
+    int failed = 0;
+    while(static_cast<int>(latencies.size()) < tasks) {
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        int left = 0;
+        while(CURLMsg* message = curl_multi_info_read(multi, &left)) {
+            if(message->msg != CURLMSG_DONE) {
+                continue;
+            }
+            Request* request = nullptr;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &request);
+            latencies.push_back(secondsSince(request->sent));
+            if(message->data.result != CURLE_OK || request->response.find("\"id\"") == std::string::npos) {
+                ++failed;
+            }
+            curl_multi_remove_handle(multi, message->easy_handle);
+            if(sent < tasks) {
+                send(*request);
+            }
+        }
+        curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+    }
+    const double seconds = secondsSince(start);
+
+    for(auto& request : requests) {
+        curl_easy_cleanup(request.handle);
+    }
+    curl_slist_free_all(headers);
+    curl_multi_cleanup(multi);
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double share) {
+        return latencies.empty() ? 0 : latencies[static_cast<size_t>(share * (latencies.size() - 1))] * 1000;
+    };
+    std::cout << connections << " connections: " << tasks / seconds << " requests/s, latency p50 " << percentile(0.5)
+              << " ms, p99 " << percentile(0.99) << " ms, max " << percentile(1) << " ms (" << failed << " failed)"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if(!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--url URL,... | --rpc ADDRESS,... [--inflight N]] [--tasks N] [--duration MS] [--clients N] [--skew F] | --url URL --connections N [--tasks N] [--duration MS] | --allocations N | --scan N [--huge-pages off|transparent|explicit] | --churn N | --parse N | --serialize N | --formats N" << std::endl;
+        return 1;
+    }
+    if(options.allocations > 0) {
+        // Pooled first: the pool keeps its memory, so the heap run can't reuse it
+        benchmarkAllocation("Pooled", options.allocations, [](const std::string& id, const std::string& description) {
+            return MockTask::create(id, description, 0);
+        });
+        benchmarkAllocation("Heap", options.allocations, [](const std::string& id, const std::string& description) {
+            return std::make_shared<MockTask>(id, description, 0);
+        });
+        return 0;
+    }
+    if(options.scan > 0) {
+        HugePages::setMode(options.hugePages);
+        benchmarkScan(options.scan);
+        return 0;
+    }
+    if(options.churn > 0) {
+        benchmarkChurn<EpochRegistry>("Lock-free lookups", options.churn);
+        benchmarkChurn<LockedRegistry>("Locked lookups", options.churn);
+        return 0;
+    }
+    if(options.formats > 0) {
+        benchmarkFormats(options.formats);
+        return 0;
+    }
+    if(options.serialize > 0) {
+        benchmarkSerialize(options.serialize);
+        return 0;
+    }
+    if(options.parse > 0) {
+        benchmarkParse("Small body", "{\"description\": \"bench 12345\", \"duration\": 100}", options.parse);
+        std::string description;
+        while(description.size() < 4096) {
+            description += "step \\\"" + std::to_string(description.size()) + "\\\" of a longer job, ";
+        }
+        benchmarkParse("Large body", "{\"labels\": {\"team\": \"batch\", \"retries\": [1, 2, 4.5e1, null, true]}, "
+                       "\"description\": \"" + description + "\", \"priority\": -3, \"duration\": 100}",
+                       options.parse);
+        return 0;
+    }
+    curl_global_init(CURL_GLOBAL_ALL);
+    if(options.connections > 0) {
+        benchmarkConnections(options.urls.front(), options.connections, options.tasks, options.duration);
+        curl_global_cleanup();
+        return 0;
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for(int c = 0; c < options.clients; ++c) {
+        clients.emplace_back([&options, &next, &failed](){
+            if(options.rpc) {
+                std::vector<std::unique_ptr<RpcClient>> servers;
+                for(const auto& address : options.urls) {
+                    servers.push_back(std::make_unique<RpcClient>(address, options.inflight));
+                }
+                for(int i = next++; i < options.tasks; i = next++) {
+                    servers[pickServer(options, i)]->createTask("bench " + std::to_string(i), options.duration);
+                }
+                for(auto& server : servers) {
+                    failed += server->finish();
+                }
+                return;
+            }
+            std::vector<std::unique_ptr<Client>> servers;
+            for(const auto& url : options.urls) {
+                servers.push_back(std::make_unique<Client>(url));
+            }
+            for(int i = next++; i < options.tasks; i = next++) {
+                auto& client = *servers[pickServer(options, i)];
+                if(!client.createTask("bench " + std::to_string(i), options.duration)) {
+                    ++failed;
+                }
+            }
+        });
+    }
+    for(auto& client : clients) {
+        client.join();
+    }
+    const double submitSeconds = secondsSince(start);
+    std::cout << "Submitted " << options.tasks << " tasks in " << submitSeconds << " s ("
+              << options.tasks / submitSeconds << " requests/s, " << failed << " failed)" << std::endl;
+
+    // Count tasks that are done, ignoring anything left over from earlier runs
+    std::vector<std::function<json()>> pollers;
+    for(const auto& url : options.urls) {
+        if(options.rpc) {
+            auto client = std::make_shared<RpcClient>(url, 1);
+            pollers.push_back([client](){ return client->getAllTasks(); });
+        } else {
+            auto client = std::make_shared<Client>(url);
+            pollers.push_back([client](){ return client->getAllTasks(); });
+        }
+    }
+    for(;;) {
+        int pending = 0;
+        for(auto& poller : pollers) {
+            for(const auto& task : poller()) {
+                const bool ours = task.contains("description") && task["description"].get<std::string>().rfind("bench ", 0) == 0;
+                if(ours && (task["status"] == "Waiting" || task["status"] == "Running")) {
+                    ++pending;
+                }
+            }
+        }
+        if(pending == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    const double drainSeconds = secondsSince(start);
+    const double ideal = static_cast<double>(options.tasks) * options.duration / 1000;
+    std::cout << "All tasks done after " << drainSeconds << " s ("
+              << options.tasks / drainSeconds << " tasks/s, " << ideal << " s of task time)" << std::endl;
+
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+    MessagePack and CBOR responses written straight to bytes
+*/
+
+#include "BinaryWriter.hpp"
+
+namespace {
+    // CBOR major types
+    const uint8_t cborUnsigned = 0;
+    const uint8_t cborNegative = 1;
+    const uint8_t cborText = 3;
+    const uint8_t cborArray = 4;
+    const uint8_t cborMap = 5;
+}
+
+BinaryWriter::BinaryWriter(MediaType format) : m_format(format) {}
+
+MediaType BinaryWriter::mediaType() const {
+    return m_format;
+}
+
+void BinaryWriter::task(const MockTaskView& task) {
+    header(Container::Map, 4);
+    string("id");
+    string(task.id);
+    string("status");
+    string(task.status);
+    string("description");
+    string(task.description.str());
+    string("duration");
+    integer(task.duration);
+}
+
+void BinaryWriter::tasks(const std::vector<MockTaskView>& tasks) {
+    // Ids, statuses and keys take about 70 bytes; reserving for the
+    // descriptions too spares the growth copies of a long listing
+    size_t size = 5;
+    for(const auto& task : tasks) {
+        size += 72 + task.description.size();
+    }
+    m_buffer.reserve(m_buffer.size() + size);
+    header(Container::Array, tasks.size());
+    for(const auto& task : tasks) {
+        BinaryWriter::task(task);
+    }
+}
+
+void BinaryWriter::counts(const TaskCounts& counts) {
+    header(Container::Map, counts.size());
+    for(size_t status = 0; status < counts.size(); ++status) {
+        string(MockTask::statusToString(static_cast<MockTask::Status>(status)));
+        integer(static_cast<int64_t>(counts[status]));
+    }
+}
+
+void BinaryWriter::message(std::string_view key, std::string_view value) {
+    header(Container::Map, 1);
+    string(key);
+    string(value);
+}
+
+void BinaryWriter::header(Container container, size_t length) {
+    if(m_format == MediaType::Cbor) {
+        cborHead(container == Container::Map ? cborMap : container == Container::Array ? cborArray : cborText, length);
+        return;
+    }
+    switch(container) {
+    case Container::Map:
+        if(length < 16) {
+            m_buffer += static_cast<char>(0x80 | length);
+        } else if(length <= 0xffff) {
+            typed(0xde, length, 2);
+        } else {
+            typed(0xdf, length, 4);
+        }
+        break;
+    case Container::Array:
+        if(length < 16) {
+            m_buffer += static_cast<char>(0x90 | length);
+        } else if(length <= 0xffff) {
+            typed(0xdc, length, 2);
+        } else {
+            typed(0xdd, length, 4);
+        }
+        break;
+    case Container::String:
+        if(length < 32) {
+            m_buffer += static_cast<char>(0xa0 | length);
+        } else if(length <= 0xff) {
+            typed(0xd9, length, 1);
+        } else if(length <= 0xffff) {
+            typed(0xda, length, 2);
+        } else {
+            typed(0xdb, length, 4);
+        }
+        break;
+    }
+}
+
+void BinaryWriter::string(std::string_view value) {
+    header(Container::String, value.size());
+    m_buffer.append(value.data(), value.size());
+}
+
+void BinaryWriter::integer(int64_t value) {
+    if(m_format == MediaType::Cbor) {
+        if(value >= 0) {
+            cborHead(cborUnsigned, static_cast<uint64_t>(value));
+        } else {
+            // -1 - value, without overflowing on the lowest value
+            cborHead(cborNegative, ~static_cast<uint64_t>(value));
+        }
+        return;
+    }
+    if(value >= 0) {
+        if(value < 0x80) {
+            m_buffer += static_cast<char>(value);
+        } else if(value <= 0xff) {
+            typed(0xcc, value, 1);
+        } else if(value <= 0xffff) {
+            typed(0xcd, value, 2);
+        } else if(value <= 0xffffffff) {
+            typed(0xce, value, 4);
+        } else {
+            typed(0xcf, value, 8);
+        }
+    } else if(value >= -32) {
+        m_buffer += static_cast<char>(value);
+    } else if(value >= INT8_MIN) {
+        typed(0xd0, static_cast<uint64_t>(value), 1);
+    } else if(value >= INT16_MIN) {
+        typed(0xd1, static_cast<uint64_t>(value), 2);
+    } else if(value >= INT32_MIN) {
+        typed(0xd2, static_cast<uint64_t>(value), 4);
+    } else {
+        typed(0xd3, static_cast<uint64_t>(value), 8);
+    }
+}
+
+void BinaryWriter::typed(uint8_t type, uint64_t value, int bytes) {
+    m_buffer += static_cast<char>(type);
+    for(int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        m_buffer += static_cast<char>(value >> shift);
+    }
+}
+
+void BinaryWriter::cborHead(uint8_t major, uint64_t value) {
+    const uint8_t type = major << 5;
+    if(value < 24) {
+        m_buffer += static_cast<char>(type | value);
+    } else if(value <= 0xff) {
+        typed(type | 24, value, 1);
+    } else if(value <= 0xffff) {
+        typed(type | 25, value, 2);
+    } else if(value <= 0xffffffff) {
+        typed(type | 26, value, 4);
+    } else {
+        typed(type | 27, value, 8);
+    }
+}
@@ -0,0 +1,210 @@
+/*
+    Client connection speaking the binary protocol to another node
+*/
+
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include "Connection.hpp"
+
+using boost::asio::ip::tcp;
+using boost::asio::local::stream_protocol;
+namespace generic = boost::asio::generic;
+
+namespace {
+    const std::string unixPrefix = "unix:";
+
+    bool isUnixAddress(const std::string& address) {
+        return address.compare(0, unixPrefix.size(), unixPrefix) == 0;
+    }
+
+    std::pair<std::string, std::string> splitHostPort(const std::string& address) {
+        auto separator = address.rfind(':');
+        if(separator == std::string::npos) {
+            throw std::invalid_argument("Expected host:port or unix:path, got " + address);
+        }
+        return {address.substr(0, separator), address.substr(separator + 1)};
+    }
+}
+
+protocol::Socket connectTo(boost::asio::io_context& io, const std::string& address) {
+    if(isUnixAddress(address)) {
+        stream_protocol::socket socket(io);
+        socket.connect(stream_protocol::endpoint(address.substr(unixPrefix.size())));
+        return protocol::Socket(std::move(socket));
+    }
+
+    auto [host, port] = splitHostPort(address);
+    tcp::resolver resolver(io);
+    tcp::socket socket(io);
+    boost::asio::connect(socket, resolver.resolve(host, port));
+    socket.set_option(tcp::no_delay(true));
+    return protocol::Socket(std::move(socket));
+}
+
+Acceptor listenOn(boost::asio::io_context& io, const std::string& address) {
+    if(isUnixAddress(address)) {
+        const auto path = address.substr(unixPrefix.size());
+        ::unlink(path.c_str());
+        return Acceptor(io, generic::stream_protocol::endpoint(stream_protocol::endpoint(path)));
+    }
+
+    tcp::endpoint endpoint(tcp::v4(), 0);
+    if(address.find(':') == std::string::npos) {
+        endpoint.port(static_cast<unsigned short>(std::stoi(address)));
+    } else {
+        auto [host, port] = splitHostPort(address);
+        tcp::resolver resolver(io);
+        endpoint = *resolver.resolve(tcp::v4(), host, port).begin();
+    }
+    return Acceptor(io, generic::stream_protocol::endpoint(endpoint));
+}
+
+Connection::Connection(const std::string& address) : m_address(address), m_nextRequestId(0) {
+    if(!isUnixAddress(address)) {
+        splitHostPort(address);
+    }
+}
+
+Connection::~Connection() {
+    std::shared_ptr<protocol::Socket> socket;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        socket = m_socket;
+    }
+    if(socket) {
+        boost::system::error_code ignored;
+        socket->shutdown(protocol::Socket::shutdown_both, ignored);
+    }
+    if(m_reader.thread.joinable()) {
+        m_reader.thread.join();
+    }
+    for(auto& reader : m_retiredReaders) {
+        reader.thread.join();
+    }
+}
+
+const std::string& Connection::getAddress() const {
+    return m_address;
+}
+
+std::shared_ptr<protocol::Socket> Connection::open(bool& reused, std::vector<std::thread>& finished) {
+    reused = m_socket != nullptr;
+    if(reused) {
+        return m_socket;
+    }
+    // The previous reader may be waiting for m_mutex to fail its requests,
+    // so it can't be joined here
+    if(m_reader.thread.joinable()) {
+        m_retiredReaders.push_back(std::move(m_reader));
+    }
+    m_socket = std::make_shared<protocol::Socket>(connectTo(m_io, m_address));
+    m_reader.done = std::make_shared<std::atomic<bool>>(false);
+    m_reader.thread = std::thread(&Connection::readResponses, this, m_socket, m_reader.done);
+    // Only once connected, so that a failure leaves nothing to join. Readers
+    // that are done hold no lock, so joining them doesn't wait long, and a
+    // peer that keeps dropping the connection leaves at most a few behind.
+    for(auto reader = m_retiredReaders.begin(); reader != m_retiredReaders.end();) {
+        if(reader->done->load(std::memory_order_acquire)) {
+            finished.push_back(std::move(reader->thread));
+            reader = m_retiredReaders.erase(reader);
+        } else {
+            ++reader;
+        }
+    }
+    return m_socket;
+}
+
+std::future<protocol::Frame> Connection::send(protocol::MessageType type, const protocol::Writer& request) {
+    bool unsent;
+    return send(type, request, unsent);
+}
+
+std::future<protocol::Frame> Connection::send(protocol::MessageType type, const protocol::Writer& request, bool& unsent) {
+    unsent = false;
+    bool reused;
+    std::shared_ptr<protocol::Socket> socket;
+    uint32_t requestId;
+    std::future<protocol::Frame> response;
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        socket = open(reused, finished);
+        requestId = m_nextRequestId++;
+        auto& pending = m_pending[requestId];
+        pending.type = type;
+        response = pending.response.get_future();
+    }
+    for(auto& reader : finished) {
+        reader.join();
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        protocol::writeFrame(*socket, type, requestId, request);
+    } catch(const std::exception&) {
+        unsent = reused;
+        fail(socket, std::current_exception());
+    }
+    return response;
+}
+
+protocol::Frame Connection::call(protocol::MessageType type, const protocol::Writer& request) {
+    // A pooled connection may have been closed by the peer since the last call,
+    // so a request that couldn't be written to a reused socket gets one retry
+    // on a fresh connection. Once written, the peer may have run it, and
+    // running ReleaseTask or SubmitTask twice would lose or duplicate a task.
+    for(int attempt = 0; ; ++attempt) {
+        bool unsent = false;
+        try {
+            return send(type, request, unsent).get();
+        } catch(const protocol::ProtocolError&) {
+            throw;
+        } catch(const std::exception&) {
+            if(!unsent || attempt > 0) {
+                throw;
+            }
+        }
+    }
+}
+
+void Connection::readResponses(std::shared_ptr<protocol::Socket> socket, std::shared_ptr<std::atomic<bool>> done) {
+    try {
+        for(;;) {
+            auto frame = protocol::readFrame(*socket);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto pending = m_pending.find(frame.requestId);
+            if(pending == m_pending.end()) {
+                throw protocol::ProtocolError("response to an unknown request");
+            }
+            if(pending->second.type != frame.type) {
+                throw protocol::ProtocolError("response type mismatch");
+            }
+            pending->second.response.set_value(std::move(frame));
+            m_pending.erase(pending);
+        }
+    } catch(const std::exception&) {
+        fail(socket, std::current_exception());
+    }
+    done->store(true, std::memory_order_release);
+}
+
+void Connection::fail(const std::shared_ptr<protocol::Socket>& socket, std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_socket != socket) {
+        return;
+    }
+    boost::system::error_code ignored;
+    socket->shutdown(protocol::Socket::shutdown_both, ignored);
+    m_socket.reset();
+    // Every request in flight was sent on this socket
+    for(auto& [id, pending] : m_pending) {
+        pending.response.set_exception(error);
+    }
+    m_pending.clear();
+}
@@ -0,0 +1,289 @@
+/*
+    Coordinator that spreads tasks over remote worker nodes
+*/
+
+#include <cmath>
+#include <iostream>
+#include <unordered_set>
+
+#include "Coordinator.hpp"
+#include "Utils.hpp"
+
+namespace {
+    // Ids drawn before giving up on finding a node under the load bound
+    const int maxDraws = 64;
+    // How often tasks that were running during a hand-off are retried, and
+    // loads are counted again
+    const auto moveRetryInterval = std::chrono::seconds(1);
+}
+
+Coordinator::Coordinator(const std::vector<std::string>& workerAddresses, size_t virtualNodes, double loadFactor)
+: m_ring(virtualNodes), m_loadFactor(loadFactor), m_totalLoad(0) {
+    for(const auto& address : workerAddresses) {
+        m_nodes[address] = std::make_shared<RemoteNode>(address);
+        m_ring.addNode(address);
+    }
+
+    m_mover = std::thread([this](){
+        for(;;) {
+            std::this_thread::sleep_for(moveRetryInterval);
+            std::lock_guard<std::mutex> membershipLock(m_membershipMutex);
+            retryPendingMoves();
+            refreshLoads();
+        }
+    });
+}
+
+std::string Coordinator::executeCreateTask(const std::string& description, int duration) {
+    std::unordered_set<std::string> unreachable;
+    for(;;) {
+        MockTaskView task{"", description, duration, MockTask::statusToString(MockTask::Status::Waiting)};
+        std::string owner;
+        std::shared_ptr<RemoteNode> node;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(unreachable.size() >= m_ring.getNodes().size()) {
+                return "";
+            }
+
+            const auto capacity = static_cast<size_t>(std::ceil(m_loadFactor * (m_totalLoad + 1) / m_ring.getNodes().size()));
+            for(int draw = 0; draw < maxDraws; ++draw) {
+                auto id = utils::generateUUID();
+                const auto& candidate = m_ring.ownerOf(id);
+                if(unreachable.count(candidate) > 0) {
+                    continue;
+                }
+                task.id = id;
+                owner = candidate;
+                if(m_loads[candidate] < capacity) {
+                    break;
+                }
+            }
+            if(task.id.empty()) {
+                return "";
+            }
+            node = m_nodes[owner];
+        }
+
+        if(node->submitTask(task)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_loads[owner];
+            ++m_totalLoad;
+            return task.id;
+        }
+        unreachable.insert(owner);
+    }
+}
+
+std::shared_ptr<RemoteNode> Coordinator::findHolder(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto pending = m_pendingMoves.find(id);
+    if(pending != m_pendingMoves.end()) {
+        return pending->second;
+    }
+    if(m_ring.empty()) {
+        return nullptr;
+    }
+    return m_nodes.at(m_ring.ownerOf(id));
+}
+
+MockTaskView Coordinator::viewTask(const std::string& id) const {
+    auto node = findHolder(id);
+    if(node == nullptr) {
+        return MockTaskView();
+    }
+    return node->viewTask(id);
+}
+
+std::vector<MockTaskView> Coordinator::viewAllTasks() const {
+    std::vector<std::shared_ptr<RemoteNode>> holders;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& node : m_nodes) {
+            holders.push_back(node.second);
+        }
+    }
+
+    std::vector<MockTaskView> views;
+    for(const auto& node : holders) {
+        auto nodeViews = node->viewAllTasks();
+        views.insert(views.end(), nodeViews.begin(), nodeViews.end());
+    }
+    return views;
+}
+
+bool Coordinator::cancelTask(const std::string& id) {
+    auto node = findHolder(id);
+    if(node == nullptr) {
+        return false;
+    }
+    return node->cancelTask(id);
+}
+
+TaskCounts Coordinator::countTasks() const {
+    std::vector<std::shared_ptr<RemoteNode>> nodes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& node : m_nodes) {
+            nodes.push_back(node.second);
+        }
+    }
+
+    TaskCounts counts = {};
+    for(const auto& node : nodes) {
+        const auto nodeCounts = node->countTasks();
+        for(size_t status = 0; status < counts.size(); ++status) {
+            counts[status] += nodeCounts[status];
+        }
+    }
+    return counts;
+}
+
+void Coordinator::refreshLoads() {
+    std::vector<std::shared_ptr<RemoteNode>> nodes;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& node : m_nodes) {
+            nodes.push_back(node.second);
+        }
+    }
+
+    std::unordered_map<std::string, size_t> loads;
+    for(const auto& node : nodes) {
+        const auto counts = node->countTasks();
+        loads[node->getAddress()] = counts[MockTask::Status::Waiting] + counts[MockTask::Status::Running];
+    }
+
+    // Placements made while counting are dropped until the next refresh.
+    // Membership can't change meanwhile: the caller holds m_membershipMutex.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_totalLoad = 0;
+    for(const auto& [address, load] : loads) {
+        m_loads[address] = load;
+        m_totalLoad += load;
+    }
+}
+
+void Coordinator::addNode(const std::string& address) {
+    std::lock_guard<std::mutex> membershipLock(m_membershipMutex);
+    std::vector<std::shared_ptr<RemoteNode>> others;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_ring.hasNode(address)) {
+            return;
+        }
+        for(const auto& node : m_nodes) {
+            others.push_back(node.second);
+        }
+        m_nodes[address] = std::make_shared<RemoteNode>(address);
+        m_ring.addNode(address);
+    }
+    std::cout << "Node " << address << " joined, rebalancing" << std::endl;
+
+    retryPendingMoves();
+    for(const auto& node : others) {
+        handOff(node);
+    }
+}
+
+void Coordinator::removeNode(const std::string& address) {
+    std::lock_guard<std::mutex> membershipLock(m_membershipMutex);
+    std::shared_ptr<RemoteNode> leaving;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_ring.hasNode(address) || m_ring.getNodes().size() == 1) {
+            return;
+        }
+        leaving = m_nodes[address];
+        m_ring.removeNode(address);
+        m_nodes.erase(address);
+        m_totalLoad -= m_loads[address];
+        m_loads.erase(address);
+    }
+    std::cout << "Node " << address << " left, handing off its tasks" << std::endl;
+
+    retryPendingMoves();
+    handOff(leaving);
+}
+
+std::vector<std::string> Coordinator::getNodes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ring.getNodes();
+}
+
+void Coordinator::handOff(const std::shared_ptr<RemoteNode>& source) {
+    // Everything that changes hands is looked up on its old node until it
+    // has moved. The ring already points at the new owners, so there is a
+    // short window where a lookup for a task being listed here misses.
+    std::vector<std::string> moving;
+    for(const auto& view : source->viewAllTasks()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_ring.ownerOf(view.id) != source->getAddress()) {
+            m_pendingMoves[view.id] = source;
+            moving.push_back(view.id);
+        }
+    }
+
+    size_t moved = 0;
+    for(const auto& id : moving) {
+        if(moveTask(id, *source)) {
+            ++moved;
+        }
+    }
+    std::cout << "Moved " << moved << " of " << moving.size() << " tasks off " << source->getAddress() << std::endl;
+}
+
+bool Coordinator::moveTask(const std::string& id, RemoteNode& from) {
+    {
+        // The ring may have changed back since the move was planned
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_ring.ownerOf(id) == from.getAddress()) {
+            m_pendingMoves.erase(id);
+            return true;
+        }
+    }
+
+    auto task = from.releaseTask(id);
+    if(task.id.empty()) {
+        // Still running, or already gone. Either way it stays where it is.
+        return false;
+    }
+
+    std::string owner;
+    std::shared_ptr<RemoteNode> to;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        owner = m_ring.ownerOf(id);
+        to = m_nodes.at(owner);
+    }
+    if(!to->submitTask(task)) {
+        // Put it back rather than lose it; the move is retried later
+        from.submitTask(task);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pendingMoves.erase(id);
+    ++m_loads[owner];
+    ++m_totalLoad;
+    if(m_loads.count(from.getAddress()) > 0 && m_loads[from.getAddress()] > 0) {
+        --m_loads[from.getAddress()];
+        --m_totalLoad;
+    }
+    return true;
+}
+
+void Coordinator::retryPendingMoves() {
+    std::vector<std::pair<std::string, std::shared_ptr<RemoteNode>>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.assign(m_pendingMoves.begin(), m_pendingMoves.end());
+    }
+    for(const auto& move : pending) {
+        if(!moveTask(move.first, *move.second) && move.second->viewTask(move.first).id.empty()) {
+            // The task vanished with its node, there is nothing left to move
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pendingMoves.erase(move.first);
+        }
+    }
+}
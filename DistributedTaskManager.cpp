@@ -6,349 +6,766 @@ Implements a multithreaded mock task manager with a RESTful API
 
 #include <condition_variable>
 #include <chrono>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <unordered_map>
 #include <queue>
+#include <string>
 #include <thread>
+#include <variant>
 #include <vector>
 
 #include <crow.h>
-#include "nlohmann/json.hpp"
 
+#include "BinaryWriter.hpp"
+#include "Coordinator.hpp"
+#include "HugePages.hpp"
+#include "JsonWriter.hpp"
+#include "LeaseWorker.hpp"
+#include "MediaType.hpp"
+#include "Membership.hpp"
 #include "MockTask.hpp"
+#include "NodeServer.hpp"
+#include "ReplicatedTaskManager.hpp"
+#include "RpcServer.hpp"
+#include "TaskArchive.hpp"
+#include "TaskLog.hpp"
+#include "TaskRequest.hpp"
+#include "TaskTable.hpp"
+#include "WorkStealer.hpp"
+#include "TaskManager.hpp"
 #include "Utils.hpp"
 
-using json = nlohmann::json;
 
-class TaskManager {
-public:
-    TaskManager(size_t nTasks){
-        for(size_t i = 0; i < nTasks; ++i) {
-            m_workers.emplace_back([this](){
-                for(;;) {
-                    std::unique_lock<std::mutex> lock(m_mutex);
-                    m_condition.wait(lock, [this](){ return !m_waitingTasks.empty();});
-                    auto task = m_waitingTasks.front();
-                    m_waitingTasks.pop();
-                    lock.unlock();
-
-                    if(task->isCancelled()){
-                        continue;
-                    }
-                    task->compute();
-                }
-            });
-        }
-    };
+// REST operations, queued to the Controller and run on its thread. Each is
+// a plain value, so queuing one allocates nothing beyond the strings it
+// carries.
+struct CreateTaskCommand {
+    std::string description;
+    int duration;
+};
 
-    std::string executeCreateTask(const std::string& description, int duration){
-        auto newTask = std::make_shared<MockTask>(description, duration);
-        auto id = newTask->getId();
-        m_tasks[id] = newTask;
-        
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_waitingTasks.push(newTask);
-        }
-        m_condition.notify_one();
-        return id;
-    }
+struct GetTaskCommand {
+    std::string id;
+};
 
-    MockTaskView viewTask(const std::string& id) const {
-        auto it = m_tasks.find(id);
-        if(it == m_tasks.end()){
-            return MockTaskView();
+struct GetAllTasksCommand {
+    // Lists only the tasks in status, if given
+    std::optional<MockTask::Status> status;
+};
+
+struct CountTasksCommand {};
+
+struct CancelTaskCommand {
+    std::string id;
+};
+
+using Command = std::variant<CreateTaskCommand, GetTaskCommand, GetAllTasksCommand, CountTasksCommand,
+                             CancelTaskCommand>;
 
+// What a command returned: the task created or looked up, empty if there is
+// none, the tasks listed, the counts, or whether the cancelled task exists
+using CommandResult = std::variant<MockTaskView, std::vector<MockTaskView>, TaskCounts, bool>;
+
+// Runs a command against the backend
+struct CommandRunner {
+    TaskBackend& manager;
+
+    CommandResult operator()(const CreateTaskCommand& command) const {
+        auto id = manager.executeCreateTask(command.description, command.duration);
+        auto taskView = manager.viewTask(id);
+        if(taskView.id.empty()){
+            std::cout << "Error: Unable to create the task" << std::endl;
         }
-        return it->second->getView();
+        return taskView;
     }
 
-    std::vector<MockTaskView> viewAllTasks() const {
-        std::vector<MockTaskView> views;
-        std::transform(m_tasks.begin(), m_tasks.end(), std::back_inserter(views), 
-            [](const std::pair<std::string, std::shared_ptr<MockTask>>& pair) { return pair.second->getView();});
-        return views;
+    CommandResult operator()(const GetTaskCommand& command) const {
+        return manager.viewTask(command.id);
     }
 
-    bool cancelTask(const std::string& id){
-        auto it = m_tasks.find(id);
-        if(it == m_tasks.end()){
-            return false;
-        }
+    CommandResult operator()(const GetAllTasksCommand& command) const {
+        return command.status ? manager.viewTasks(*command.status) : manager.viewAllTasks();
+    }
 
-        it->second->abort();
-        return true;
+    CommandResult operator()(const CountTasksCommand&) const {
+        return manager.countTasks();
     }
-private:
-    std::unordered_map<std::string, std::shared_ptr<MockTask>> m_tasks;
-    std::queue<std::shared_ptr<MockTask>> m_waitingTasks;
-    std::vector<std::thread> m_workers;
-    std::condition_variable m_condition;
-    std::mutex m_mutex;
-};
 
-class Command {
-public:
-    Command(TaskManager& manager) : m_manager(manager), m_executed(false) {};
-    virtual void execute() = 0;
+    CommandResult operator()(const CancelTaskCommand& command) const {
+        return manager.cancelTask(command.id);
+    }
+};
 
-    void waitToBeExecuted() {
-        std::unique_lock lock(m_mutex);
-        m_condition.wait(lock, [this] {return m_executed; });
-        lock.unlock();
-    };
+// Writes the answer to a request from its command's result, on the controller
+// thread, in whatever media type the client accepts. The request thread
+// doesn't wait for it: it leaves the response open and goes back to reading
+// requests, so a handful of Crow threads can keep any number of them in
+// flight.
+using Responder = void (*)(ResponseWriter& writer, CommandResult& result);
+
+// The calling thread's writer for type, cleared
+ResponseWriter& responseWriter(MediaType type) {
+    thread_local JsonWriter json;
+    thread_local BinaryWriter messagePack(MediaType::MessagePack);
+    thread_local BinaryWriter cbor(MediaType::Cbor);
+    ResponseWriter& writer = type == MediaType::MessagePack ? static_cast<ResponseWriter&>(messagePack)
+        : type == MediaType::Cbor ? static_cast<ResponseWriter&>(cbor) : json;
+    writer.clear();
+    return writer;
+}
 
-protected:
-    std::condition_variable m_condition;
-    std::mutex m_mutex;
-    bool m_executed;
-    TaskManager& m_manager;
-};
+// Completes a response left open by its handler, from any thread
+void respond(crow::response& res, const ResponseWriter& body) {
+    res.set_header("Content-Type", mediaTypeToString(body.mediaType()));
+    res.write(body.str());
+    res.end();
+}
 
-class CommandFactory {
+// Runs queued commands one at a time. They wait in a ring allocated up
+// front, each with the response it answers and how.
+class Controller {
 public:
-    CommandFactory(TaskManager& manager) : m_manager(manager) {};
-    
-    template<typename T, typename... Args>
-    std::shared_ptr<Command> create(Args... args) {
-        return std::make_shared<T>(m_manager, std::forward<Args>(args)...);
-    }
-protected:
-    TaskManager& m_manager;
-};
+    explicit Controller(TaskBackend& manager) : m_runner{manager}, m_ring(ringSize), m_head(0), m_count(0) {}
 
-class CreateTaskCommand : public Command {
-public:
-    CreateTaskCommand(TaskManager& manager, const std::string& description, int duration)
-    : Command(manager), m_description(description), m_duration(duration){};
-    void execute() override {
+    // Waits for room if the controller is a whole ring behind
+    void addCommand(Command command, crow::response& res, MediaType type, Responder responder) {
         {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            
-            m_id = m_manager.executeCreateTask(m_description, m_duration);
-            auto m_taskView = m_manager.viewTask(m_id);
-            
-            if(m_taskView.id.empty()){
-                std::cout << "Error: Unable to create the task" << std::endl;
-            }
-            m_executed = true;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_count < m_ring.size(); });
+            auto& slot = m_ring[(m_head + m_count) % m_ring.size()];
+            slot.command = std::move(command);
+            slot.response = &res;
+            slot.type = type;
+            slot.responder = responder;
+            ++m_count;
         }
-
-        m_condition.notify_one();
+        m_notEmpty.notify_one();
     }
 
-    MockTaskView getTaskView() const {
-        return m_manager.viewTask(m_id);
+    void run() {
+        while(true) {
+            std::unique_lock lock(m_mutex);
+            m_notEmpty.wait(lock, [this] {return m_count > 0;});
+            auto& slot = m_ring[m_head];
+            auto command = std::move(slot.command);
+            auto* response = slot.response;
+            auto type = slot.type;
+            auto responder = slot.responder;
+            m_head = (m_head + 1) % m_ring.size();
+            --m_count;
+            // Request threads keep queuing meanwhile
+            lock.unlock();
+            m_notFull.notify_one();
+            // The backend throws if it can't persist a change; the request
+            // is answered anyway, and the next one is run
+            try {
+                auto result = std::visit(m_runner, command);
+                auto& writer = responseWriter(type);
+                responder(writer, result);
+                respond(*response, writer);
+            } catch(const std::exception& e) {
+                std::cout << "Error: request failed: " << e.what() << std::endl;
+                auto& writer = responseWriter(type);
+                writer.message("error", "Internal error");
+                response->code = 500;
+                respond(*response, writer);
+            }
+        }
     }
+private:
+    static const size_t ringSize = 4096;
 
-    std::string getId() const {
-        return m_id;
-    }
+    struct Slot {
+        Command command;
+        crow::response* response = nullptr;
+        MediaType type = MediaType::Json;
+        Responder responder = nullptr;
+    };
 
-private:
-    std::string m_id;
-    std::string m_description;
-    int m_duration;
-    MockTaskView m_taskView;
-   
+    CommandRunner m_runner;
+    std::vector<Slot> m_ring;
+    size_t m_head;
+    size_t m_count;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::mutex m_mutex;
 };
 
-class GetTaskCommand : public Command {
-public:    
-    GetTaskCommand(TaskManager& manager, std::string id) : Command(manager), m_id(id) {}
-    void execute() override {
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_view = m_manager.viewTask(m_id);
-            m_executed = true;
-        }
-        m_condition.notify_one();
+// For the routes that don't negotiate, always in JSON
+void respond(crow::response& res, const crow::json::wvalue& body) {
+    res.set_header("Content-Type", "application/json");
+    res.write(body.dump());
+    res.end();
+}
+
+// The media type to answer req in, or nothing once it has been answered with
+// 406 for accepting none that is served
+std::optional<MediaType> negotiate(const crow::request& req, crow::response& res) {
+    auto type = acceptedMediaType(req.get_header_value("Accept"));
+    if(!type) {
+        auto& writer = responseWriter(MediaType::Json);
+        writer.message("error", "Only application/json, application/msgpack and application/cbor are served");
+        res.code = 406;
+        respond(res, writer);
     }
+    return type;
+}
 
-    bool noTaskFound() const {
-        return m_view.id.empty();
+// The task a POST /taches body asks for, in the media type of its
+// Content-Type, or what is wrong with the body
+std::variant<CreateTaskCommand, const char*> readCreateTask(const crow::request& req) {
+    const auto type = requestMediaType(req.get_header_value("Content-Type"));
+    if(type != MediaType::Json) {
+        auto decoded = decodeCreateTask(req.body, type);
+        if(auto error = std::get_if<const char*>(&decoded)) {
+            return *error;
+        }
+        auto& request = std::get<DecodedCreateTask>(decoded);
+        return CreateTaskCommand{std::move(request.description), request.duration};
     }
+    auto parsed = parseCreateTask(req.body);
+    if(auto error = std::get_if<const char*>(&parsed)) {
+        return *error;
+    }
+    const auto& request = std::get<CreateTaskRequest>(parsed);
+    return CreateTaskCommand{request.descriptionString(), request.duration};
+}
 
-    MockTaskView getTaskView() const {
-        return m_view;
+crow::json::wvalue toCrowJson(const std::map<std::string, TaskStats>& groups) {
+    crow::json::wvalue j;
+    size_t i = 0;
+    for(const auto& [key, stats] : groups) {
+        auto& group = j[i++];
+        group["prefix"] = key;
+        group["tasks"] = stats.tasks;
+        group["finished"] = stats.statuses[MockTask::Status::Finished];
+        group["cancelled"] = stats.statuses[MockTask::Status::Cancelled];
+        group["failed"] = stats.statuses[MockTask::Status::Failed];
+        group["failureRate"] = static_cast<double>(stats.statuses[MockTask::Status::Failed]) / stats.tasks;
+        group["meanDuration"] = static_cast<double>(stats.durationSum) / stats.tasks;
+        group["minDuration"] = stats.durationMin;
+        group["maxDuration"] = stats.durationMax;
     }
-private:
-    std::string m_id;
-    MockTaskView m_view;
+    return j;
+}
+
+enum class Mode {
+    Standalone,
+    Worker,
+    Coordinator
 };
 
-class GetAllTasksCommand : public Command {
-public:
-    GetAllTasksCommand(TaskManager& manager) : Command(manager) {}
+struct Options {
+    Mode mode = Mode::Standalone;
+    unsigned short port = 3000;
+    size_t threads = 2;
+    std::vector<std::string> workers;
+    std::optional<unsigned short> leasePort;
+    std::string leaseFrom;
+    std::vector<std::string> peers;
+    std::string listen;
+    std::vector<std::string> rpcAddresses;
+    std::optional<unsigned short> gossipPort;
+    std::vector<std::string> seeds;
+    std::string host = "localhost";
+    size_t virtualNodes = 128;
+    double loadFactor = 1.25;
+    std::vector<std::string> replicas;
+    std::optional<size_t> replicaId;
+    std::string dataDirectory = ".";
+    bool syncWrites = true;
+    std::optional<Durability> durability;
+    std::optional<int> syncIntervalMs;
+    bool taskTable = false;
+    std::optional<int> retentionSeconds;
+    bool archive = false;
+    HugePages::Mode hugePages = HugePages::Mode::Transparent;
+    std::optional<size_t> memoryBudgetMb;
+};
 
-    void execute() override {
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_taskViews = m_manager.viewAllTasks();
-            m_executed = true;
+std::optional<Options> parseOptions(int argc, char* argv[]) {
+    Options options;
+    bool portGiven = false;
+    try {
+        for(int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if(arg == "--worker") {
+                options.mode = Mode::Worker;
+            } else if(arg == "--coordinator") {
+                options.mode = Mode::Coordinator;
+            } else if(arg == "--port" && hasValue) {
+                options.port = static_cast<unsigned short>(std::stoi(argv[++i]));
+                portGiven = true;
+            } else if(arg == "--threads" && hasValue) {
+                options.threads = std::stoul(argv[++i]);
+            } else if(arg == "--workers" && hasValue) {
+                options.workers = utils::split(argv[++i], ',');
+            } else if(arg == "--lease-port" && hasValue) {
+                options.leasePort = static_cast<unsigned short>(std::stoi(argv[++i]));
+            } else if(arg == "--lease-from" && hasValue) {
+                options.leaseFrom = argv[++i];
+            } else if(arg == "--listen" && hasValue) {
+                options.listen = argv[++i];
+            } else if(arg == "--rpc" && hasValue) {
+                options.rpcAddresses = utils::split(argv[++i], ',');
+            } else if(arg == "--peers" && hasValue) {
+                options.peers = utils::split(argv[++i], ',');
+            } else if(arg == "--gossip-port" && hasValue) {
+                options.gossipPort = static_cast<unsigned short>(std::stoi(argv[++i]));
+            } else if(arg == "--seeds" && hasValue) {
+                options.seeds = utils::split(argv[++i], ',');
+            } else if(arg == "--host" && hasValue) {
+                options.host = argv[++i];
+            } else if(arg == "--vnodes" && hasValue) {
+                options.virtualNodes = std::stoul(argv[++i]);
+            } else if(arg == "--load-factor" && hasValue) {
+                options.loadFactor = std::stod(argv[++i]);
+            } else if(arg == "--replicas" && hasValue) {
+                options.replicas = utils::split(argv[++i], ',');
+            } else if(arg == "--replica-id" && hasValue) {
+                options.replicaId = std::stoul(argv[++i]);
+            } else if(arg == "--data-dir" && hasValue) {
+                options.dataDirectory = argv[++i];
+            } else if(arg == "--no-fsync") {
+                options.syncWrites = false;
+            } else if(arg == "--durability" && hasValue) {
+                options.durability = durabilityFromString(argv[++i]);
+                if(!options.durability) {
+                    return std::nullopt;
+                }
+            } else if(arg == "--sync-interval" && hasValue) {
+                options.syncIntervalMs = std::stoi(argv[++i]);
+            } else if(arg == "--task-table") {
+                options.taskTable = true;
+            } else if(arg == "--retention" && hasValue) {
+                options.retentionSeconds = std::stoi(argv[++i]);
+            } else if(arg == "--archive") {
+                options.archive = true;
+            } else if(arg == "--huge-pages" && hasValue) {
+                auto hugePages = hugePagesFromString(argv[++i]);
+                if(!hugePages) {
+                    return std::nullopt;
+                }
+                options.hugePages = *hugePages;
+            } else if(arg == "--memory-budget" && hasValue) {
+                options.memoryBudgetMb = std::stoul(argv[++i]);
+            } else {
+                return std::nullopt;
+            }
         }
-        m_condition.notify_one();
+    } catch(const std::exception&) {
+        return std::nullopt;
     }
 
-    std::vector<MockTaskView> getTaskViews() const {
-        return m_taskViews;
+    if(options.mode == Mode::Worker && !portGiven) {
+        options.port = 4000;
     }
-private:
-    std::vector<MockTaskView> m_taskViews;
-};
-
-class CancelTaskCommand : public Command {
-public:
-    CancelTaskCommand(TaskManager& manager, std::string id) : Command(manager), m_id(id) {}
-    enum Status {
-        Canceled,
-        NotFound
-    };
+    // A coordinator either pushes to workers, known up front or found by
+    // gossip, or lets workers pull
+    if(options.mode == Mode::Coordinator && !options.workers.empty() && options.leasePort) {
+        return std::nullopt;
+    }
+    if(options.mode == Mode::Coordinator && options.workers.empty() && !options.leasePort && !options.gossipPort) {
+        return std::nullopt;
+    }
+    if((options.gossipPort || !options.seeds.empty()) && (options.mode == Mode::Standalone || !options.gossipPort)) {
+        return std::nullopt;
+    }
+    // Leased tasks belong to the coordinator, only pushed ones can be stolen.
+    // Thieves are reached back on their TCP port.
+    if(!options.peers.empty() && (options.mode != Mode::Worker || !options.leaseFrom.empty() || !options.listen.empty())) {
+        return std::nullopt;
+    }
+    if(!options.listen.empty() && (options.mode != Mode::Worker || !options.leaseFrom.empty())) {
+        return std::nullopt;
+    }
+    if(!options.rpcAddresses.empty() && options.mode == Mode::Worker) {
+        return std::nullopt;
+    }
+    if(options.loadFactor < 1) {
+        return std::nullopt;
+    }
+    if(!options.replicas.empty() && (options.mode != Mode::Standalone
+                                     || !options.replicaId || *options.replicaId >= options.replicas.size())) {
+        return std::nullopt;
+    }
+    // Only a node whose own registry holds the tasks stores them; replicas
+    // already have the Raft log
+    const bool holdsTasks = options.mode == Mode::Standalone ? options.replicas.empty()
+        : options.mode == Mode::Worker ? options.leaseFrom.empty() : options.leasePort.has_value();
+    if((options.durability && !holdsTasks) || (options.syncIntervalMs && !options.durability)
+       || (options.syncIntervalMs && *options.syncIntervalMs < 0)
+       || (options.taskTable && (!holdsTasks || options.durability))) {
+        return std::nullopt;
+    }
+    // The task table already keeps finished tasks out of memory
+    if((options.retentionSeconds && (!holdsTasks || options.taskTable || *options.retentionSeconds <= 0))
+       || (options.archive && !options.retentionSeconds)) {
+        return std::nullopt;
+    }
+    if(options.memoryBudgetMb && (!holdsTasks || *options.memoryBudgetMb == 0)) {
+        return std::nullopt;
+    }
+    return options;
+}
 
-    void execute() override {
-         {
-            std::lock_guard<std::mutex> lock(m_mutex);
+const char* usage = R"(
+Modes:
+  (default)                  standalone: REST API and task execution here
+  --worker                   runs tasks for a coordinator, on port 4000 by default
+  --coordinator              REST API here, tasks run on worker nodes
+
+Worker options:
+  --listen ADDRESS           serve pushed tasks on ADDRESS (port, host:port or
+                             unix:/path) instead of --port
+  --lease-from HOST:PORT     pull tasks from a coordinator's lease port
+  --peers HOST:PORT,...      steal waiting tasks from these workers when idle
+
+Coordinator options:
+  --workers ADDRESS,...      push tasks to these workers, partitioned by a
+                             consistent hash of their id; workers join and
+                             leave through POST and DELETE /nodes/<address>
+  --vnodes N                 ring points per worker (128)
+  --load-factor X            largest share of unfinished tasks a worker takes,
+                             relative to the average (1.25)
+  --lease-port N             queue tasks here for workers to lease
+
+Membership, for workers and coordinators:
+  --gossip-port N            find other nodes and detect failures by gossip
+  --seeds HOST:PORT,...      gossip addresses to join through
+  --host H                   name advertised to the others (localhost)
+
+Replication, for standalone nodes:
+  --replicas HOST:PORT,...   keep the registry in a Raft log shared with these
+  --replica-id N             this node's position in --replicas
+  --no-fsync                 don't flush the Raft log
+
+Storage, for nodes holding their own tasks:
+  --data-dir D               where files are kept (.)
+  --durability MODE          log every change: none survives a crash of the
+                             process, batch flushes every --sync-interval,
+                             every-op before each change returns
+  --sync-interval MS         batch: flush interval (10); every-op: wait for
+                             more changes to share a flush (0)
+  --task-table               keep tasks in a memory-mapped table instead
+  --retention SECONDS        forget finished tasks that long after they finish
+  --archive                  archive forgotten tasks, served by /taches/<id>
+                             and aggregated by GET /stats
+  --memory-budget MB         spill waiting tasks to disk past this much memory
+  --huge-pages MODE          off, transparent (default) or explicit
+
+Serving:
+  --port N                   REST port (3000)
+  --threads N                task execution threads (2)
+  --rpc ADDRESS,...          also serve the task operations over the binary
+                             protocol, for standalone nodes and coordinators
+)";
+
+int main(int argc, char* argv[]) {
+    auto options = parseOptions(argc, argv);
+    if(!options) {
+        std::cout << "Usage: " << argv[0] << " [--worker [--lease-from host:port | --peers host:port,... | --listen ADDRESS] | --coordinator (--workers host:port,... [--vnodes N] [--load-factor X] | --lease-port N) | --replicas host:port,... --replica-id N [--data-dir D] [--no-fsync]] [--durability none|batch|every-op [--sync-interval MS] [--data-dir D] | --task-table [--data-dir D]] [--retention SECONDS [--archive [--data-dir D]]] [--memory-budget MB [--data-dir D]] [--huge-pages off|transparent|explicit] [--rpc ADDRESS,...] [--gossip-port N [--seeds host:port,...] [--host H]] [--port N] [--threads N]" << usage << std::endl;
+        return 1;
+    }
+    HugePages::setMode(options->hugePages);
 
-            m_status = m_manager.cancelTask(m_id) ? Canceled : NotFound;
-            m_executed = true;
+    std::unique_ptr<Membership> membership;
+    auto joinGossip = [&options, &membership](const std::string& id, MemberRole role, Membership::Listener listener) {
+        if(!options->gossipPort) {
+            return;
         }
-        m_condition.notify_one();
-    }
+        MemberInfo self{id, role, options->host + ":" + std::to_string(*options->gossipPort)};
+        membership = std::make_unique<Membership>(self, *options->gossipPort, options->seeds, std::move(listener));
+        membership->start();
+    };
+    const auto ownAddress = options->host + ":" + std::to_string(options->port);
+
+    auto openStore = [&options](TaskManager& taskManager) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto basePath = options->dataDirectory + "/tasks-" + std::to_string(options->port);
+        std::string path;
+        size_t recovered = 0;
+        if(options->durability) {
+            const auto defaultInterval = *options->durability == Durability::Batch ? 10 : 0;
+            const auto syncInterval = std::chrono::milliseconds(options->syncIntervalMs.value_or(defaultInterval));
+            path = basePath + ".log";
+            recovered = taskManager.setStore(std::make_unique<TaskLog>(path, *options->durability, syncInterval));
+        } else if(options->taskTable) {
+            path = basePath + ".table";
+            recovered = taskManager.setStore(std::make_unique<TaskTable>(path));
+        } else {
+            return;
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "Recovered " << recovered << " tasks from " << path << " in " << elapsed.count() << " ms" << std::endl;
+    };
 
-    Status getStatus() const {
-        return m_status;
-    }
-private:
-   std::string m_id;
-   Status m_status;
-};
+    auto limitMemory = [&options](TaskManager& taskManager) {
+        if(!options->memoryBudgetMb) {
+            return;
+        }
+        const auto path = options->dataDirectory + "/tasks-" + std::to_string(options->port) + ".spill";
+        taskManager.setMemoryBudget(*options->memoryBudgetMb << 20, std::make_unique<SpillQueue>(path));
+        std::cout << "Spilling waiting tasks past " << *options->memoryBudgetMb << " MB to " << path << std::endl;
+    };
 
-class Controller {
-public:
-    void addCommand(std::shared_ptr<Command> command) {
-        {
-            std::lock_guard<std::mutex> lg(m_mutex);
-            m_commands.push(command);
-        } 
-        m_condition.notify_one();
-    }
+    TaskArchive* archive = nullptr;
+    auto startRetention = [&options, &archive](TaskManager& taskManager) {
+        if(!options->retentionSeconds) {
+            return;
+        }
+        std::unique_ptr<TaskArchive> ownArchive;
+        if(options->archive) {
+            const auto path = options->dataDirectory + "/tasks-" + std::to_string(options->port) + ".archive";
+            ownArchive = std::make_unique<TaskArchive>(path);
+            archive = ownArchive.get();
+            std::cout << "Archiving finished tasks to " << path << ", holding " << archive->size() << std::endl;
+        }
+        taskManager.setRetention(std::chrono::seconds(*options->retentionSeconds), std::move(ownArchive));
+    };
 
-    void run() {
-        while(true) {
-            std::unique_lock lock(m_mutex);
-            m_condition.wait(lock, [this] {return !m_commands.empty();});
-            auto cmd = m_commands.front();
-            cmd->execute();
-            m_commands.pop();
-            lock.unlock();
+    if(options->mode == Mode::Worker) {
+        TaskManager taskManager(options->threads);
+        if(!options->leaseFrom.empty()) {
+            // Keep one extra task per thread on hand so threads don't idle
+            // while the next lease is in flight
+            LeaseWorker worker(taskManager, options->leaseFrom, 2 * options->threads);
+            joinGossip(worker.getWorkerId(), MemberRole::LeaseWorker, [](const MemberInfo&, bool){});
+            worker.run();
+            return 0;
+        }
+        limitMemory(taskManager);
+        openStore(taskManager);
+        startRetention(taskManager);
+        joinGossip(ownAddress, MemberRole::Worker, [](const MemberInfo&, bool){});
+        std::unique_ptr<WorkStealer> stealer;
+        if(!options->peers.empty()) {
+            stealer = std::make_unique<WorkStealer>(taskManager, options->port, options->peers);
+            std::thread([&stealer](){ stealer->run(); }).detach();
         }
+        const auto listenAddress = options->listen.empty() ? std::to_string(options->port) : options->listen;
+        NodeServer server(taskManager, listenAddress, stealer.get());
+        std::cout << "Worker node listening on " << listenAddress << std::endl;
+        server.run();
+        return 0;
     }
-private:
-    std::queue<std::shared_ptr<Command>> m_commands;
-    std::condition_variable m_condition;
-    std::mutex m_mutex;
-};
 
-crow::json::wvalue toCrowJson(MockTaskView taskView) {
-    crow::json::wvalue response;
-    response["id"] = taskView.id;
-    response["status"] = taskView.status;
-    response["description"] = taskView.description;
-    response["duration"] = taskView.duration;
-    return response;
-}
-
-crow::json::wvalue toCrowJson(const std::vector<MockTaskView>& allTasksViews) {
-    crow::json::wvalue j;
-    for(size_t i = 0; i < allTasksViews.size(); ++i) {
-        j[i] = toCrowJson(allTasksViews[i]);
+    std::unique_ptr<TaskBackend> backend;
+    std::unique_ptr<NodeServer> leaseServer;
+    Coordinator* coordinator = nullptr;
+    if(options->mode == Mode::Coordinator && options->leasePort) {
+        // Tasks only leave this queue through leases, so no local threads
+        auto taskManager = std::make_unique<TaskManager>(0);
+        limitMemory(*taskManager);
+        openStore(*taskManager);
+        startRetention(*taskManager);
+        leaseServer = std::make_unique<NodeServer>(*taskManager, std::to_string(*options->leasePort));
+        std::thread([&leaseServer](){ leaseServer->run(); }).detach();
+        std::cout << "Leasing tasks to workers on port " << *options->leasePort << std::endl;
+        auto leaser = taskManager.get();
+        joinGossip(ownAddress, MemberRole::Coordinator, [leaser](const MemberInfo& member, bool alive) {
+            if(member.role == MemberRole::LeaseWorker && !alive) {
+                leaser->revokeLeases(member.id);
+            }
+        });
+        backend = std::move(taskManager);
+    } else if(options->mode == Mode::Coordinator) {
+        auto pushCoordinator = std::make_unique<Coordinator>(options->workers, options->virtualNodes, options->loadFactor);
+        coordinator = pushCoordinator.get();
+        joinGossip(ownAddress, MemberRole::Coordinator, [coordinator](const MemberInfo& member, bool alive) {
+            if(member.role != MemberRole::Worker) {
+                return;
+            }
+            if(alive) {
+                coordinator->addNode(member.id);
+            } else {
+                coordinator->removeNode(member.id);
+            }
+        });
+        backend = std::move(pushCoordinator);
+    } else if(!options->replicas.empty()) {
+        backend = std::make_unique<ReplicatedTaskManager>(options->threads, *options->replicaId, options->replicas,
+                                                          options->dataDirectory, options->syncWrites);
+    } else {
+        auto taskManager = std::make_unique<TaskManager>(options->threads);
+        limitMemory(*taskManager);
+        openStore(*taskManager);
+        startRetention(*taskManager);
+        backend = std::move(taskManager);
     }
-    return j;
-}
 
-int main() {
+    std::vector<std::unique_ptr<RpcServer>> rpcServers;
+    for(const auto& address : options->rpcAddresses) {
+        auto& rpcServer = rpcServers.emplace_back(std::make_unique<RpcServer>(*backend, address));
+        std::thread([server = rpcServer.get()](){ server->run(); }).detach();
+        std::cout << "Serving binary clients on " << address << std::endl;
+    }
 
     crow::SimpleApp app;
-    TaskManager taskManager(2);
-    CommandFactory commandFactory(taskManager);
-    Controller controller;
+    Controller controller(*backend);
 
 
+    // Each handler queues a command and returns at once, leaving the response
+    // for the controller to complete in the media type negotiated here
     CROW_ROUTE(app, "/taches")
     .methods("POST"_method, "GET"_method)
-    ([&commandFactory, &controller](const crow::request& req ){
-        crow::json::wvalue response;
+    ([&controller](const crow::request& req, crow::response& res){
+        auto type = negotiate(req, res);
+        if(!type) {
+            return;
+        }
         if(req.method == "POST"_method) {
-            std::string description;
-            int duration;
-            json reqData =  json::parse(req.body);
-            reqData["description"].get_to(description);
-            reqData["duration"].get_to(duration);
-
-            auto command = commandFactory.create<CreateTaskCommand>(description, duration);
-            controller.addCommand(command);
-            command->waitToBeExecuted();
+            auto command = readCreateTask(req);
+            if(auto error = std::get_if<const char*>(&command)) {
+                auto& writer = responseWriter(*type);
+                writer.message("error", *error);
+                res.code = 400;
+                respond(res, writer);
+                return;
+            }
 
-            auto createTaskCommand = std::dynamic_pointer_cast<CreateTaskCommand>(command);
-            auto taskView = createTaskCommand->getTaskView();
+            controller.addCommand(std::move(std::get<CreateTaskCommand>(command)), res, *type,
+                                  [](ResponseWriter& writer, CommandResult& result){
+                const auto& taskView = std::get<MockTaskView>(result);
+                if(taskView.id.empty()) {
+                    writer.message("error", "Couldn't create a new task");
+                } else {
+                    writer.task(taskView);
+                }
+            });
+            return;
+        }
 
-            
-            if(taskView.id.empty()) {
-                response["error"] = "Couldn't create a new task";
-            } else {
-                response = toCrowJson(taskView);
+        std::optional<MockTask::Status> status;
+        if(auto name = req.url_params.get("status")) {
+            status = MockTask::statusFromString(name);
+            if(MockTask::statusToString(*status) != name) {
+                auto& writer = responseWriter(*type);
+                writer.message("error", "Unknown status");
+                res.code = 400;
+                respond(res, writer);
+                return;
             }
         }
-        
-        if(req.method == "GET"_method) {
-            auto command = commandFactory.create<GetAllTasksCommand>();
-            controller.addCommand(command);
-            command->waitToBeExecuted();
-
-            auto getAllTasksCommand = std::dynamic_pointer_cast<GetAllTasksCommand>(command);
-            response = toCrowJson(getAllTasksCommand->getTaskViews());
-        }
-        
-        return response;
+        controller.addCommand(GetAllTasksCommand{status}, res, *type, [](ResponseWriter& writer, CommandResult& result){
+            writer.tasks(std::get<std::vector<MockTaskView>>(result));
+        });
     });
 
 
-    CROW_ROUTE(app,"/taches/<string>")
+    CROW_ROUTE(app, "/counts")
     .methods("GET"_method)
-    ([&commandFactory, &controller](std::string id){
-        auto command = commandFactory.create<GetTaskCommand>(id);
-        controller.addCommand(command);
-        command->waitToBeExecuted();
+    ([&controller](const crow::request& req, crow::response& res){
+        auto type = negotiate(req, res);
+        if(!type) {
+            return;
+        }
+        controller.addCommand(CountTasksCommand{}, res, *type, [](ResponseWriter& writer, CommandResult& result){
+            writer.counts(std::get<TaskCounts>(result));
+        });
+    });
 
-        auto getTaskCommand = std::dynamic_pointer_cast<GetTaskCommand>(command);
-        if(getTaskCommand->noTaskFound()) {
-            crow::json::wvalue response;
-            response["error"] = "Task not found";
-            return response;
+    CROW_ROUTE(app,"/taches/<string>")
+    .methods("GET"_method)
+    ([&controller](const crow::request& req, crow::response& res, std::string id){
+        auto type = negotiate(req, res);
+        if(!type) {
+            return;
         }
-        return toCrowJson(getTaskCommand->getTaskView());
+        controller.addCommand(GetTaskCommand{std::move(id)}, res, *type, [](ResponseWriter& writer, CommandResult& result){
+            const auto& taskView = std::get<MockTaskView>(result);
+            if(taskView.id.empty()) {
+                writer.message("error", "Task not found");
+            } else {
+                writer.task(taskView);
+            }
+        });
      });
 
     CROW_ROUTE(app, "/taches/<string>")
     .methods("DELETE"_method)
-    ([&commandFactory, &controller](std::string id){
-        auto command = commandFactory.create<CancelTaskCommand>(id);
-        controller.addCommand(command);
-        command->waitToBeExecuted();
-        
-        auto cancelTaskCommand = std::dynamic_pointer_cast<CancelTaskCommand>(command);
-        crow::json::wvalue response;
-        if(cancelTaskCommand->getStatus() == CancelTaskCommand::Status::Canceled) {
-            response["message"] = "Task canceled";
-        } else {
-            response["error"] = "Task not found";
+    ([&controller](const crow::request& req, crow::response& res, std::string id){
+        auto type = negotiate(req, res);
+        if(!type) {
+            return;
         }
-        return response;
+        controller.addCommand(CancelTaskCommand{std::move(id)}, res, *type, [](ResponseWriter& writer, CommandResult& result){
+            if(std::get<bool>(result)) {
+                writer.message("message", "Task canceled");
+            } else {
+                writer.message("error", "Task not found");
+            }
+        });
     });
 
-    auto var = app.port(3000).multithreaded().run_async();
+    // Aggregates can scan millions of archived tasks, so they too run on the
+    // request thread
+    if(archive != nullptr) {
+        CROW_ROUTE(app, "/stats")
+        .methods("GET"_method)
+        ([archive](const crow::request& req){
+            ArchiveQuery query;
+            try {
+                if(auto prefix = req.url_params.get("prefix")) {
+                    query.prefix = prefix;
+                }
+                if(auto from = req.url_params.get("from")) {
+                    query.from = std::stoll(from);
+                }
+                if(auto to = req.url_params.get("to")) {
+                    query.to = std::stoll(to);
+                }
+                if(auto group = req.url_params.get("group")) {
+                    query.groupLength = std::stoul(group);
+                }
+            } catch(const std::exception&) {
+                crow::json::wvalue response;
+                response["error"] = "Expected numbers for from, to and group";
+                return response;
+            }
+            return toCrowJson(archive->aggregate(query));
+        });
+    }
+
+    // Membership changes hand tasks between nodes, which can take a while, so
+    // they run on the request thread instead of holding up the controller.
+    if(coordinator != nullptr) {
+        CROW_ROUTE(app, "/nodes")
+        .methods("GET"_method)
+        ([coordinator](){
+            crow::json::wvalue response;
+            auto nodes = coordinator->getNodes();
+            for(size_t i = 0; i < nodes.size(); ++i) {
+                response[i] = nodes[i];
+            }
+            return response;
+        });
+
+        CROW_ROUTE(app, "/nodes/<string>")
+        .methods("POST"_method, "DELETE"_method)
+        ([coordinator](const crow::request& req, std::string address){
+            crow::json::wvalue response;
+            if(address.find(':') == std::string::npos) {
+                response["error"] = "Expected host:port";
+                return response;
+            }
+            if(req.method == "POST"_method) {
+                coordinator->addNode(address);
+                response["message"] = "Node added";
+            } else {
+                coordinator->removeNode(address);
+                response["message"] = "Node removed";
+            }
+            return response;
+        });
+    }
+
+    auto var = app.port(options->port).multithreaded().run_async();
     controller.run();
     return 0;
 }
\ No newline at end of file
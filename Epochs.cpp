@@ -0,0 +1,137 @@
+/*
+    Epoch-based reclamation of shared objects
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Epochs.hpp"
+
+namespace {
+    // Retirements between attempts to free
+    const size_t reclaimInterval = 64;
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> free;
+    };
+
+    // Starts above 0, which marks a thread outside any guard
+    std::atomic<uint64_t> globalEpoch(1);
+
+    std::mutex retiredMutex;
+    std::deque<Retired> retired;
+    size_t retiredSinceReclaim = 0;
+}
+
+// One per thread that has held a guard, reused once the thread exits.
+// Records are never freed, so the list can be walked without a lock.
+struct Epochs::Record {
+    // The epoch the thread's outermost guard started in, or 0
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> taken{true};
+    unsigned depth = 0;
+    Record* next = nullptr;
+};
+
+std::atomic<Epochs::Record*>& Epochs::records() {
+    static std::atomic<Record*> head(nullptr);
+    return head;
+}
+
+Epochs::Record& Epochs::record() {
+    struct Owner {
+        Record* record = nullptr;
+        ~Owner() {
+            if(record != nullptr) {
+                record->taken.store(false);
+            }
+        }
+    };
+    static thread_local Owner owner;
+    if(owner.record != nullptr) {
+        return *owner.record;
+    }
+    for(auto* record = records().load(); record != nullptr; record = record->next) {
+        bool taken = false;
+        if(record->taken.compare_exchange_strong(taken, true)) {
+            owner.record = record;
+            return *record;
+        }
+    }
+    auto* record = new Record();
+    record->next = records().load();
+    while(!records().compare_exchange_weak(record->next, record)) {}
+    owner.record = record;
+    return *record;
+}
+
+Epochs::Guard::Guard() {
+    auto& record = Epochs::record();
+    if(record.depth++ == 0) {
+        // Published before any shared object is read, so a writer that
+        // retires one afterwards sees this guard
+        record.epoch.store(globalEpoch.load());
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+Epochs::Guard::~Guard() {
+    auto& record = Epochs::record();
+    if(--record.depth == 0) {
+        record.epoch.store(0, std::memory_order_release);
+    }
+}
+
+void Epochs::retire(std::function<void()> free) {
+    bool reclaimNow = false;
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        retired.push_back({globalEpoch.load(), std::move(free)});
+        if(++retiredSinceReclaim >= reclaimInterval) {
+            retiredSinceReclaim = 0;
+            reclaimNow = true;
+        }
+    }
+    if(reclaimNow) {
+        reclaim();
+    }
+}
+
+void Epochs::reclaim() {
+    auto epoch = globalEpoch.load();
+    bool everyoneCaughtUp = true;
+    for(auto* record = records().load(); record != nullptr; record = record->next) {
+        const auto seen = record->epoch.load();
+        if(seen != 0 && seen != epoch) {
+            everyoneCaughtUp = false;
+            break;
+        }
+    }
+    if(everyoneCaughtUp && globalEpoch.compare_exchange_strong(epoch, epoch + 1)) {
+        ++epoch;
+    }
+
+    // Retired in order, so the ones old enough are at the front
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        while(!retired.empty() && retired.front().epoch + 2 <= epoch) {
+            ready.push_back(std::move(retired.front().free));
+            retired.pop_front();
+        }
+    }
+    // Outside the lock, since freeing may retire more
+    for(auto& free : ready) {
+        free();
+    }
+}
+
+size_t Epochs::pending() {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    return retired.size();
+}
@@ -0,0 +1,62 @@
+/*
+    Accept loop shared by the servers speaking the binary protocol
+*/
+
+#include <sys/socket.h>
+
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include "FrameServer.hpp"
+
+using boost::asio::ip::tcp;
+
+namespace {
+    std::string remoteHostOf(protocol::Socket& socket) {
+        const auto endpoint = socket.remote_endpoint();
+        if(endpoint.protocol().family() != AF_INET) {
+            return "localhost";
+        }
+        tcp::endpoint address;
+        std::memcpy(address.data(), endpoint.data(), endpoint.size());
+        return address.address().to_string();
+    }
+}
+
+FrameServer::FrameServer(const std::string& listenAddress) : m_acceptor(listenOn(m_io, listenAddress)) {}
+
+void FrameServer::run() {
+    for(;;) {
+        protocol::Socket socket(m_io);
+        m_acceptor.accept(socket);
+        if(socket.local_endpoint().protocol().family() == AF_INET) {
+            socket.set_option(tcp::no_delay(true));
+        }
+        std::thread(&FrameServer::serve, this, std::move(socket)).detach();
+    }
+}
+
+void FrameServer::serve(protocol::Socket socket) {
+    try {
+        const auto remoteHost = remoteHostOf(socket);
+        for(;;) {
+            auto request = protocol::readFrame(socket);
+            protocol::Writer response;
+            handle(request, response, remoteHost);
+            protocol::writeFrame(socket, request.type, request.requestId, response);
+        }
+    } catch(const boost::system::system_error& e) {
+        if(e.code() != boost::asio::error::eof) {
+            std::cout << "Error: connection dropped: " << e.what() << std::endl;
+        }
+    } catch(const protocol::ProtocolError& e) {
+        std::cout << "Error: closing connection after bad request: " << e.what() << std::endl;
+    } catch(const std::exception& e) {
+        // Such as a write failing in the task log; it would end the node on
+        // this detached thread
+        std::cout << "Error: closing connection after a failed request: " << e.what() << std::endl;
+    }
+}
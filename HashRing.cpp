@@ -0,0 +1,75 @@
+/*
+    Consistent hash ring mapping task ids to the nodes that own them
+*/
+
+#include <algorithm>
+
+#include "HashRing.hpp"
+
+HashRing::HashRing(size_t virtualNodes) : m_virtualNodes(std::max<size_t>(1, virtualNodes)) {}
+
+uint64_t HashRing::hash(const std::string& key) {
+    // FNV-1a, then the splitmix64 finalizer to spread FNV's weak low bits
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+void HashRing::addNode(const std::string& node) {
+    if(hasNode(node)) {
+        return;
+    }
+    m_nodes.push_back(node);
+    rebuild();
+}
+
+void HashRing::removeNode(const std::string& node) {
+    auto it = std::find(m_nodes.begin(), m_nodes.end(), node);
+    if(it == m_nodes.end()) {
+        return;
+    }
+    m_nodes.erase(it);
+    rebuild();
+}
+
+bool HashRing::hasNode(const std::string& node) const {
+    return std::find(m_nodes.begin(), m_nodes.end(), node) != m_nodes.end();
+}
+
+const std::vector<std::string>& HashRing::getNodes() const {
+    return m_nodes;
+}
+
+bool HashRing::empty() const {
+    return m_nodes.empty();
+}
+
+const std::string& HashRing::ownerOf(const std::string& key) const {
+    auto position = hash(key);
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), std::make_pair(position, size_t(0)));
+    if(it == m_points.end()) {
+        it = m_points.begin();
+    }
+    return m_nodes[it->second];
+}
+
+void HashRing::rebuild() {
+    // Points only depend on the node names, so every process that knows the
+    // same members builds the same ring
+    m_points.clear();
+    m_points.reserve(m_nodes.size() * m_virtualNodes);
+    for(size_t i = 0; i < m_nodes.size(); ++i) {
+        for(size_t v = 0; v < m_virtualNodes; ++v) {
+            m_points.emplace_back(hash(m_nodes[i] + "#" + std::to_string(v)), i);
+        }
+    }
+    std::sort(m_points.begin(), m_points.end());
+}
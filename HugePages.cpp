@@ -0,0 +1,92 @@
+/*
+    Large allocations backed by huge pages
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+#include "HugePages.hpp"
+
+namespace {
+    std::atomic<HugePages::Mode> currentMode(HugePages::Mode::Transparent);
+    // Whether the explicit pool is known to be empty or missing, so later
+    // allocations don't keep asking
+    std::atomic<bool> explicitExhausted(false);
+
+    size_t roundUp(size_t bytes) {
+        return (bytes + HugePages::pageSize - 1) / HugePages::pageSize * HugePages::pageSize;
+    }
+
+    void* mapAnonymous(size_t bytes, int flags) {
+        auto* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        return memory == MAP_FAILED ? nullptr : memory;
+    }
+
+    // Maps bytes, a multiple of the huge page size, starting on a huge page
+    // boundary so the kernel can back all of it with huge pages
+    void* mapAligned(size_t bytes) {
+        auto* mapped = static_cast<uint8_t*>(mapAnonymous(bytes + HugePages::pageSize, 0));
+        if(mapped == nullptr) {
+            return nullptr;
+        }
+        const auto address = reinterpret_cast<uintptr_t>(mapped);
+        auto* aligned = reinterpret_cast<uint8_t*>(roundUp(address));
+        const size_t head = aligned - mapped;
+        if(head > 0) {
+            munmap(mapped, head);
+        }
+        munmap(aligned + bytes, HugePages::pageSize - head);
+        return aligned;
+    }
+}
+
+void HugePages::setMode(Mode mode) {
+    currentMode = mode;
+}
+
+HugePages::Mode HugePages::getMode() {
+    return currentMode;
+}
+
+void* HugePages::allocate(size_t bytes) {
+    if(bytes < pageSize) {
+        return ::operator new(bytes);
+    }
+    const auto size = roundUp(bytes);
+    const auto mode = currentMode.load();
+    if(mode == Mode::Explicit && !explicitExhausted) {
+        if(auto* memory = mapAnonymous(size, MAP_HUGETLB)) {
+            return memory;
+        }
+        explicitExhausted = true;
+    }
+    auto* memory = mode == Mode::Off ? mapAnonymous(size, 0) : mapAligned(size);
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    madvise(memory, size, mode == Mode::Off ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    return memory;
+}
+
+void HugePages::deallocate(void* memory, size_t bytes) {
+    if(bytes < pageSize) {
+        ::operator delete(memory);
+        return;
+    }
+    munmap(memory, roundUp(bytes));
+}
+
+std::optional<HugePages::Mode> hugePagesFromString(const std::string& mode) {
+    if(mode == "off") {
+        return HugePages::Mode::Off;
+    }
+    if(mode == "transparent") {
+        return HugePages::Mode::Transparent;
+    }
+    if(mode == "explicit") {
+        return HugePages::Mode::Explicit;
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,112 @@
+/*
+    String stored once however many objects hold it
+*/
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "InternedString.hpp"
+
+namespace {
+    const size_t shardCount = 64;
+}
+
+struct InternedString::Entry {
+    std::atomic<uint32_t> references;
+    size_t hash;
+    std::string value;
+};
+
+struct InternedString::Shard {
+    std::mutex mutex;
+    // Keyed by views of the entries' own strings
+    std::unordered_map<std::string_view, Entry*> entries;
+};
+
+InternedString::Shard& InternedString::shard(size_t hash) {
+    // Never destroyed, so handles can still be released while the process
+    // shuts down
+    static Shard* shards = new Shard[shardCount];
+    return shards[hash % shardCount];
+}
+
+InternedString::InternedString(const std::string& value) : m_entry(nullptr) {
+    if(value.empty()) {
+        return;
+    }
+    const auto hash = std::hash<std::string>()(value);
+    auto& shard = InternedString::shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(value);
+    if(it != shard.entries.end()) {
+        m_entry = it->second;
+        ++m_entry->references;
+        return;
+    }
+    m_entry = new Entry{{1}, hash, value};
+    shard.entries.emplace(m_entry->value, m_entry);
+}
+
+InternedString::InternedString(const char* value) : InternedString(std::string(value)) {}
+
+InternedString::InternedString(const InternedString& other) : m_entry(other.m_entry) {
+    if(m_entry != nullptr) {
+        ++m_entry->references;
+    }
+}
+
+InternedString::InternedString(InternedString&& other) noexcept : m_entry(other.m_entry) {
+    other.m_entry = nullptr;
+}
+
+InternedString& InternedString::operator=(InternedString other) noexcept {
+    std::swap(m_entry, other.m_entry);
+    return *this;
+}
+
+InternedString::~InternedString() {
+    if(m_entry == nullptr) {
+        return;
+    }
+    auto references = m_entry->references.load();
+    while(references > 1) {
+        if(m_entry->references.compare_exchange_weak(references, references - 1)) {
+            return;
+        }
+    }
+    // Maybe the last handle: dropped under the lock, so that a lookup can't
+    // hand the entry out again in between
+    auto& shard = InternedString::shard(m_entry->hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if(--m_entry->references == 0) {
+        shard.entries.erase(m_entry->value);
+        delete m_entry;
+    }
+}
+
+const std::string& InternedString::str() const {
+    static const std::string empty;
+    return m_entry != nullptr ? m_entry->value : empty;
+}
+
+size_t InternedString::size() const {
+    return str().size();
+}
+
+bool InternedString::empty() const {
+    return m_entry == nullptr;
+}
+
+size_t InternedString::poolSize() {
+    size_t size = 0;
+    for(size_t i = 0; i < shardCount; ++i) {
+        auto& shard = InternedString::shard(i);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.entries.size();
+    }
+    return size;
+}
@@ -0,0 +1,107 @@
+/*
+    JSON responses written straight to text
+*/
+
+#include <charconv>
+
+#include "JsonWriter.hpp"
+
+namespace {
+    const char hexDigits[] = "0123456789abcdef";
+
+    // Whether c has to be escaped in a JSON string
+    bool needsEscape(unsigned char c) {
+        return c == '"' || c == '\\' || c < 0x20;
+    }
+}
+
+MediaType JsonWriter::mediaType() const {
+    return MediaType::Json;
+}
+
+void JsonWriter::task(const MockTaskView& task) {
+    m_buffer += "{\"id\":";
+    string(task.id);
+    m_buffer += ",\"status\":";
+    string(task.status);
+    m_buffer += ",\"description\":";
+    string(task.description.str());
+    m_buffer += ",\"duration\":";
+    integer(task.duration);
+    m_buffer += '}';
+}
+
+void JsonWriter::tasks(const std::vector<MockTaskView>& tasks) {
+    // Ids and statuses take about 60 bytes with the keys; reserving for the
+    // descriptions too spares the growth copies of a long listing
+    size_t size = 2;
+    for(const auto& task : tasks) {
+        size += 80 + task.id.size() + task.description.size();
+    }
+    m_buffer.reserve(m_buffer.size() + size);
+    m_buffer += '[';
+    for(size_t i = 0; i < tasks.size(); ++i) {
+        if(i > 0) {
+            m_buffer += ',';
+        }
+        task(tasks[i]);
+    }
+    m_buffer += ']';
+}
+
+void JsonWriter::counts(const TaskCounts& counts) {
+    m_buffer += '{';
+    for(size_t status = 0; status < counts.size(); ++status) {
+        if(status > 0) {
+            m_buffer += ',';
+        }
+        string(MockTask::statusToString(static_cast<MockTask::Status>(status)));
+        m_buffer += ':';
+        integer(static_cast<int64_t>(counts[status]));
+    }
+    m_buffer += '}';
+}
+
+void JsonWriter::message(std::string_view key, std::string_view value) {
+    m_buffer += '{';
+    string(key);
+    m_buffer += ':';
+    string(value);
+    m_buffer += '}';
+}
+
+void JsonWriter::string(std::string_view value) {
+    m_buffer += '"';
+    size_t start = 0;
+    for(size_t i = 0; i < value.size(); ++i) {
+        const auto c = static_cast<unsigned char>(value[i]);
+        if(!needsEscape(c)) {
+            continue;
+        }
+        // Copy the run before the escape whole
+        m_buffer.append(value.data() + start, i - start);
+        start = i + 1;
+        m_buffer += '\\';
+        switch(c) {
+        case '"': m_buffer += '"'; break;
+        case '\\': m_buffer += '\\'; break;
+        case '\b': m_buffer += 'b'; break;
+        case '\f': m_buffer += 'f'; break;
+        case '\n': m_buffer += 'n'; break;
+        case '\r': m_buffer += 'r'; break;
+        case '\t': m_buffer += 't'; break;
+        default:
+            m_buffer += "u00";
+            m_buffer += hexDigits[c >> 4];
+            m_buffer += hexDigits[c & 0xf];
+        }
+    }
+    m_buffer.append(value.data() + start, value.size() - start);
+    m_buffer += '"';
+}
+
+void JsonWriter::integer(int64_t value) {
+    char digits[20];
+    const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    m_buffer.append(digits, end - digits);
+}
@@ -0,0 +1,89 @@
+/*
+    Worker node side of the lease protocol
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "LeaseWorker.hpp"
+#include "Utils.hpp"
+
+namespace {
+    // How long to wait before asking again when the coordinator had no work,
+    // or when every local slot is busy
+    const auto idlePollInterval = std::chrono::milliseconds(50);
+    const auto reconnectDelay = std::chrono::seconds(1);
+}
+
+LeaseWorker::LeaseWorker(TaskManager& taskManager, const std::string& coordinatorAddress, size_t capacity)
+: m_taskManager(taskManager),
+  m_coordinator(coordinatorAddress),
+  m_workerId(utils::generateUUID()),
+  m_capacity(std::max<size_t>(1, capacity)),
+  m_heartbeatInterval(std::chrono::seconds(1)) {}
+
+const std::string& LeaseWorker::getWorkerId() const {
+    return m_workerId;
+}
+
+void LeaseWorker::run() {
+    std::cout << "Worker " << m_workerId << " leasing tasks from " << m_coordinator.getAddress() << std::endl;
+    for(;;) {
+        try {
+            if(std::chrono::steady_clock::now() >= m_nextHeartbeat) {
+                sendHeartbeat();
+            }
+
+            const auto active = countActiveTasks();
+            if(active >= m_capacity) {
+                std::this_thread::sleep_for(idlePollInterval);
+                continue;
+            }
+
+            auto grant = m_coordinator.leaseTasks(m_workerId, m_capacity - active);
+            // Renew well before the lease can lapse
+            m_heartbeatInterval = grant.leaseDuration / 3;
+            m_nextHeartbeat = std::min(m_nextHeartbeat, std::chrono::steady_clock::now() + m_heartbeatInterval);
+            for(const auto& task : grant.tasks) {
+                m_taskManager.submitTask(task);
+                m_held.push_back(task.id);
+            }
+            if(grant.tasks.empty()) {
+                std::this_thread::sleep_for(idlePollInterval);
+            }
+        } catch(const std::exception& e) {
+            std::cout << "Error: lost contact with coordinator " << m_coordinator.getAddress() << ": " << e.what() << std::endl;
+            std::this_thread::sleep_for(reconnectDelay);
+        }
+    }
+}
+
+void LeaseWorker::sendHeartbeat() {
+    std::vector<TaskReport> reports;
+    reports.reserve(m_held.size());
+    for(const auto& id : m_held) {
+        reports.push_back({id, MockTask::statusFromString(m_taskManager.viewTask(id).status)});
+    }
+
+    auto cancels = m_coordinator.heartbeat(m_workerId, reports);
+    m_nextHeartbeat = std::chrono::steady_clock::now() + m_heartbeatInterval;
+
+    // Once the coordinator has seen a final status we can stop reporting it.
+    // Cancelled tasks stay held until their abort shows up in a report.
+    m_held.clear();
+    for(const auto& report : reports) {
+        if(!MockTask::isFinal(report.status)) {
+            m_held.push_back(report.id);
+        }
+    }
+    for(const auto& id : cancels) {
+        m_taskManager.cancelTask(id);
+    }
+}
+
+size_t LeaseWorker::countActiveTasks() const {
+    return std::count_if(m_held.begin(), m_held.end(), [this](const std::string& id) {
+        return !MockTask::isFinal(MockTask::statusFromString(m_taskManager.viewTask(id).status));
+    });
+}
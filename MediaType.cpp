@@ -0,0 +1,113 @@
+/*
+    Media types of REST request and response bodies
+*/
+
+#include <cctype>
+#include <cstdlib>
+#include <string>
+
+#include "MediaType.hpp"
+
+namespace {
+    std::string_view trim(std::string_view text) {
+        while(!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+            text.remove_prefix(1);
+        }
+        while(!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    bool equalsIgnoringCase(std::string_view a, std::string_view b) {
+        if(a.size() != b.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < a.size(); ++i) {
+            if(std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The quality an Accept entry's parameters give it, 1 unless q says
+    // otherwise
+    double quality(std::string_view parameters) {
+        while(!parameters.empty()) {
+            const auto end = parameters.find(';');
+            const auto parameter = trim(parameters.substr(0, end));
+            if(parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+                const std::string value(parameter.substr(2));
+                char* valueEnd = nullptr;
+                const double q = std::strtod(value.c_str(), &valueEnd);
+                return valueEnd == value.c_str() ? 1 : q;
+            }
+            if(end == std::string_view::npos) {
+                break;
+            }
+            parameters.remove_prefix(end + 1);
+        }
+        return 1;
+    }
+}
+
+const char* mediaTypeToString(MediaType type) {
+    switch(type) {
+    case MediaType::MessagePack:
+        return "application/msgpack";
+    case MediaType::Cbor:
+        return "application/cbor";
+    default:
+        return "application/json";
+    }
+}
+
+std::optional<MediaType> mediaTypeFromString(std::string_view type) {
+    type = trim(type.substr(0, type.find(';')));
+    if(equalsIgnoringCase(type, "application/json")) {
+        return MediaType::Json;
+    }
+    if(equalsIgnoringCase(type, "application/msgpack") || equalsIgnoringCase(type, "application/x-msgpack")
+       || equalsIgnoringCase(type, "application/vnd.msgpack")) {
+        return MediaType::MessagePack;
+    }
+    if(equalsIgnoringCase(type, "application/cbor")) {
+        return MediaType::Cbor;
+    }
+    return std::nullopt;
+}
+
+MediaType requestMediaType(std::string_view contentType) {
+    return mediaTypeFromString(contentType).value_or(MediaType::Json);
+}
+
+std::optional<MediaType> acceptedMediaType(std::string_view accept) {
+    if(trim(accept).empty()) {
+        return MediaType::Json;
+    }
+    std::optional<MediaType> best;
+    double bestQuality = 0;
+    while(!accept.empty()) {
+        const auto end = accept.find(',');
+        const auto entry = accept.substr(0, end);
+        const auto parametersStart = entry.find(';');
+        const auto name = trim(entry.substr(0, parametersStart));
+        auto type = mediaTypeFromString(name);
+        if(!type && (name == "*/*" || equalsIgnoringCase(name, "application/*"))) {
+            type = MediaType::Json;
+        }
+        if(type) {
+            const double q = parametersStart == std::string_view::npos ? 1 : quality(entry.substr(parametersStart + 1));
+            if(q > bestQuality) {
+                best = type;
+                bestQuality = q;
+            }
+        }
+        if(end == std::string_view::npos) {
+            break;
+        }
+        accept.remove_prefix(end + 1);
+    }
+    return best;
+}
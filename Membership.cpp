@@ -0,0 +1,440 @@
+/*
+    Cluster membership and failure detection by SWIM-style gossip over UDP
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include "Membership.hpp"
+
+using boost::asio::ip::udp;
+
+namespace {
+    const auto protocolPeriod = std::chrono::milliseconds(200);
+    // How long a direct ping may take before helpers are asked to try
+    const auto pingTimeout = std::chrono::milliseconds(80);
+    // Members asked to ping an unresponsive one on our behalf
+    const size_t indirectPings = 3;
+    // Updates piggybacked on one message, which bounds the message size
+    const size_t maxPiggyback = 8;
+    const size_t retransmitMultiplier = 3;
+    const double suspicionMultiplier = 4;
+    // Members sent in answer to a join, which keeps it in one datagram
+    const size_t maxJoinMembers = 512;
+    const size_t maxDatagram = 65507;
+
+    std::mt19937& randomGenerator() {
+        static thread_local std::mt19937 generator(std::random_device{}());
+        return generator;
+    }
+}
+
+Membership::Membership(const MemberInfo& self, unsigned short port, const std::vector<std::string>& seeds, Listener listener)
+: m_self(self),
+  m_incarnation(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()),
+  m_seeds(seeds), m_listener(std::move(listener)),
+  m_socket(m_io, udp::endpoint(udp::v4(), port)),
+  m_probeIndex(0), m_nextSeq(0) {}
+
+void Membership::start() {
+    std::cout << "Gossiping as " << m_self.id << " on " << m_self.gossipAddress << std::endl;
+    m_threads.emplace_back(&Membership::runNotifier, this);
+    m_threads.emplace_back(&Membership::runReceiver, this);
+    m_threads.emplace_back(&Membership::runProber, this);
+}
+
+std::vector<MemberInfo> Membership::getAliveMembers() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<MemberInfo> alive;
+    for(const auto& [id, member] : m_members) {
+        if(member.state != State::Dead) {
+            alive.push_back(member.info);
+        }
+    }
+    return alive;
+}
+
+void Membership::writeMember(protocol::Writer& writer, const Member& member) const {
+    writer.writeString(member.info.id);
+    writer.writeU8(static_cast<uint8_t>(member.info.role));
+    writer.writeString(member.info.gossipAddress);
+    writer.writeU64(member.incarnation);
+    writer.writeU8(static_cast<uint8_t>(member.state));
+}
+
+void Membership::writeUpdates(protocol::Writer& writer, bool everyone) {
+    // Every message starts with the sender, which is how members learn about
+    // a newcomer and how a suspected member's refutation reaches whoever
+    // it talks to
+    std::vector<const Member*> updates;
+    const Member self{m_self, State::Alive, m_incarnation, {}, {}};
+    updates.push_back(&self);
+
+    if(everyone) {
+        for(const auto& [id, member] : m_members) {
+            if(updates.size() > maxJoinMembers) {
+                break;
+            }
+            updates.push_back(&member);
+        }
+    } else {
+        // The least retransmitted updates are the newest, send those first
+        std::vector<std::pair<size_t, std::string>> pending;
+        for(const auto& [id, remaining] : m_broadcasts) {
+            pending.emplace_back(remaining, id);
+        }
+        const auto count = std::min(pending.size(), maxPiggyback);
+        std::partial_sort(pending.begin(), pending.begin() + count, pending.end(), std::greater<>());
+        for(size_t i = 0; i < count; ++i) {
+            const auto& id = pending[i].second;
+            if(--m_broadcasts[id] == 0) {
+                m_broadcasts.erase(id);
+            }
+            auto member = m_members.find(id);
+            if(member != m_members.end()) {
+                updates.push_back(&member->second);
+            }
+        }
+    }
+
+    writer.writeU32(static_cast<uint32_t>(updates.size()));
+    for(const auto* member : updates) {
+        writeMember(writer, *member);
+    }
+}
+
+void Membership::merge(const MemberInfo& info, State state, uint64_t incarnation) {
+    if(info.id == m_self.id) {
+        if(state != State::Alive && incarnation >= m_incarnation) {
+            // Refute: nobody but this member may raise its incarnation. Every
+            // message carries it, and whoever hears it spreads it further.
+            m_incarnation = incarnation + 1;
+            std::cout << "Refuting suspicion of this node" << std::endl;
+        }
+        return;
+    }
+
+    auto it = m_members.find(info.id);
+    if(it == m_members.end()) {
+        Member member{info, State::Dead, incarnation, {}, {}};
+        it = m_members.emplace(info.id, member).first;
+        if(state != State::Dead) {
+            changeState(it->second, state, incarnation);
+        }
+        return;
+    }
+
+    auto& member = it->second;
+    const bool newer = incarnation > member.incarnation;
+    if(newer) {
+        if(member.info.gossipAddress != info.gossipAddress) {
+            member.endpoint.reset();
+        }
+        member.info = info;
+    }
+    switch(state) {
+        case State::Alive:
+            if(newer) {
+                changeState(member, State::Alive, incarnation);
+            }
+            break;
+        case State::Suspect:
+            if(newer || (member.state == State::Alive && incarnation == member.incarnation)) {
+                changeState(member, State::Suspect, incarnation);
+            }
+            break;
+        case State::Dead:
+            if(member.state != State::Dead && incarnation >= member.incarnation) {
+                changeState(member, State::Dead, incarnation);
+            }
+            break;
+    }
+}
+
+void Membership::changeState(Member& member, State state, uint64_t incarnation) {
+    const auto previous = member.state;
+    member.state = state;
+    member.incarnation = incarnation;
+    if(state == State::Suspect) {
+        member.suspectedAt = std::chrono::steady_clock::now();
+    }
+    broadcast(member.info.id);
+
+    if(previous == State::Dead && state != State::Dead) {
+        std::cout << "Member " << member.info.id << " is alive" << std::endl;
+        m_events.push_back({member.info, true});
+        m_eventsChanged.notify_one();
+    } else if(previous != State::Dead && state == State::Dead) {
+        std::cout << "Member " << member.info.id << " is dead" << std::endl;
+        m_events.push_back({member.info, false});
+        m_eventsChanged.notify_one();
+    }
+}
+
+void Membership::broadcast(const std::string& id) {
+    m_broadcasts[id] = retransmissions();
+}
+
+size_t Membership::retransmissions() const {
+    return retransmitMultiplier * static_cast<size_t>(std::ceil(std::log2(m_members.size() + 2)));
+}
+
+std::chrono::milliseconds Membership::suspicionTimeout() const {
+    const double scale = std::max(1.0, std::log10(static_cast<double>(m_members.size() + 1)));
+    return std::chrono::milliseconds(static_cast<long>(suspicionMultiplier * scale * protocolPeriod.count()));
+}
+
+std::optional<udp::endpoint> Membership::endpointOf(Member& member) {
+    if(!member.endpoint) {
+        const auto& address = member.info.gossipAddress;
+        const auto colon = address.rfind(':');
+        try {
+            udp::resolver resolver(m_io);
+            auto results = resolver.resolve(udp::v4(), address.substr(0, colon), address.substr(colon + 1));
+            member.endpoint = results.begin()->endpoint();
+        } catch(const std::exception& e) {
+            std::cout << "Error: can't resolve gossip address " << address << ": " << e.what() << std::endl;
+        }
+    }
+    return member.endpoint;
+}
+
+void Membership::send(const udp::endpoint& to, MessageKind kind, uint32_t seq, const std::string& target) {
+    protocol::Writer message;
+    message.writeU8(static_cast<uint8_t>(kind));
+    message.writeU32(seq);
+    if(kind == MessageKind::PingRequest) {
+        message.writeString(target);
+    }
+    writeUpdates(message, false);
+    if(message.buffer().size() > maxDatagram) {
+        return;
+    }
+    boost::system::error_code ignored;
+    // Lost datagrams are what the protocol is built to tolerate
+    m_socket.send_to(boost::asio::buffer(message.buffer()), to, 0, ignored);
+}
+
+void Membership::expireSuspects() {
+    const auto now = std::chrono::steady_clock::now();
+    const auto timeout = suspicionTimeout();
+    for(auto& [id, member] : m_members) {
+        if(member.state == State::Suspect && now - member.suspectedAt >= timeout) {
+            changeState(member, State::Dead, member.incarnation);
+        }
+    }
+}
+
+std::optional<std::string> Membership::nextProbeTarget() {
+    for(size_t attempts = 0; attempts < 2; ++attempts) {
+        while(m_probeIndex < m_probeOrder.size()) {
+            const auto& id = m_probeOrder[m_probeIndex++];
+            auto it = m_members.find(id);
+            if(it != m_members.end() && it->second.state != State::Dead) {
+                return id;
+            }
+        }
+        // Each round visits every member once, in a fresh order, which
+        // bounds the time until a failed member is probed
+        m_probeOrder.clear();
+        for(const auto& [id, member] : m_members) {
+            if(member.state != State::Dead) {
+                m_probeOrder.push_back(id);
+            }
+        }
+        std::shuffle(m_probeOrder.begin(), m_probeOrder.end(), randomGenerator());
+        m_probeIndex = 0;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string> Membership::pickHelpers(const std::string& target) {
+    std::vector<std::string> candidates;
+    for(const auto& [id, member] : m_members) {
+        if(id != target && member.state == State::Alive) {
+            candidates.push_back(id);
+        }
+    }
+    std::shuffle(candidates.begin(), candidates.end(), randomGenerator());
+    candidates.resize(std::min(candidates.size(), indirectPings));
+    return candidates;
+}
+
+void Membership::runProber() {
+    for(;;) {
+        const auto periodStart = std::chrono::steady_clock::now();
+        const auto periodEnd = periodStart + protocolPeriod;
+        std::optional<std::string> target;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            expireSuspects();
+            // Acks that came in after their probe gave up
+            m_acks.clear();
+            for(auto it = m_relays.begin(); it != m_relays.end();) {
+                it = periodStart - it->second.sentAt > protocolPeriod ? m_relays.erase(it) : std::next(it);
+            }
+
+            const bool alone = std::none_of(m_members.begin(), m_members.end(),
+                [](const auto& member){ return member.second.state != State::Dead; });
+            if(alone) {
+                // Keep knocking until a seed answers, it may start after us
+                for(const auto& seed : m_seeds) {
+                    Member contact{{"", MemberRole::Coordinator, seed}, State::Alive, 0, {}, {}};
+                    if(auto endpoint = endpointOf(contact)) {
+                        send(*endpoint, MessageKind::Join, m_nextSeq++);
+                    }
+                }
+            }
+            target = nextProbeTarget();
+        }
+
+        if(target) {
+            probe(*target, periodEnd);
+        }
+        std::this_thread::sleep_until(periodEnd);
+    }
+}
+
+void Membership::probe(const std::string& id, std::chrono::steady_clock::time_point periodEnd) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_members.find(id);
+    if(it == m_members.end()) {
+        return;
+    }
+    auto endpoint = endpointOf(it->second);
+    if(!endpoint) {
+        return;
+    }
+
+    const auto seq = m_nextSeq++;
+    auto acked = [this, seq](){ return m_acks.count(seq) > 0; };
+    send(*endpoint, MessageKind::Ping, seq);
+    if(!m_acked.wait_until(lock, std::chrono::steady_clock::now() + pingTimeout, acked)) {
+        for(const auto& helperId : pickHelpers(id)) {
+            if(auto helper = endpointOf(m_members.at(helperId))) {
+                send(*helper, MessageKind::PingRequest, seq, id);
+            }
+        }
+        // Leave the rest of the period for the helpers' answers
+        m_acked.wait_until(lock, periodEnd - protocolPeriod / 10, acked);
+    }
+
+    const bool answered = m_acks.erase(seq) > 0;
+    it = m_members.find(id);
+    if(!answered && it != m_members.end() && it->second.state == State::Alive) {
+        std::cout << "Member " << id << " didn't answer, suspecting it" << std::endl;
+        changeState(it->second, State::Suspect, it->second.incarnation);
+    }
+}
+
+void Membership::runReceiver() {
+    std::vector<uint8_t> buffer(maxDatagram);
+    for(;;) {
+        udp::endpoint from;
+        boost::system::error_code error;
+        auto size = m_socket.receive_from(boost::asio::buffer(buffer), from, 0, error);
+        if(error) {
+            continue;
+        }
+        handle(std::vector<uint8_t>(buffer.begin(), buffer.begin() + size), from);
+    }
+}
+
+void Membership::handle(const std::vector<uint8_t>& datagram, const udp::endpoint& from) {
+    struct Update {
+        MemberInfo info;
+        State state;
+        uint64_t incarnation;
+    };
+
+    MessageKind kind;
+    uint32_t seq;
+    std::string target;
+    std::vector<Update> updates;
+    try {
+        protocol::Reader reader(datagram);
+        kind = static_cast<MessageKind>(reader.readU8());
+        seq = reader.readU32();
+        if(kind == MessageKind::PingRequest) {
+            target = reader.readString();
+        }
+        updates.resize(reader.readCount());
+        for(auto& update : updates) {
+            update.info.id = reader.readString();
+            const auto role = reader.readU8();
+            if(role > static_cast<uint8_t>(MemberRole::LeaseWorker)) {
+                throw protocol::ProtocolError("unknown member role");
+            }
+            update.info.role = static_cast<MemberRole>(role);
+            update.info.gossipAddress = reader.readString();
+            update.incarnation = reader.readU64();
+            const auto state = reader.readU8();
+            if(state > static_cast<uint8_t>(State::Dead)) {
+                throw protocol::ProtocolError("unknown member state");
+            }
+            update.state = static_cast<State>(state);
+        }
+    } catch(const protocol::ProtocolError& e) {
+        std::cout << "Error: dropping bad gossip message from " << from << ": " << e.what() << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& update : updates) {
+        merge(update.info, update.state, update.incarnation);
+    }
+
+    switch(kind) {
+        case MessageKind::Ping:
+            send(from, MessageKind::Ack, seq);
+            break;
+        case MessageKind::Join: {
+            protocol::Writer message;
+            message.writeU8(static_cast<uint8_t>(MessageKind::Ack));
+            message.writeU32(seq);
+            writeUpdates(message, true);
+            boost::system::error_code ignored;
+            m_socket.send_to(boost::asio::buffer(message.buffer()), from, 0, ignored);
+            break;
+        }
+        case MessageKind::Ack: {
+            auto relay = m_relays.find(seq);
+            if(relay != m_relays.end()) {
+                send(relay->second.requester, MessageKind::Ack, relay->second.requesterSeq);
+                m_relays.erase(relay);
+            } else {
+                m_acks.insert(seq);
+                m_acked.notify_all();
+            }
+            break;
+        }
+        case MessageKind::PingRequest: {
+            auto it = m_members.find(target);
+            if(it == m_members.end()) {
+                break;
+            }
+            if(auto endpoint = endpointOf(it->second)) {
+                const auto relaySeq = m_nextSeq++;
+                m_relays[relaySeq] = {from, seq, std::chrono::steady_clock::now()};
+                send(*endpoint, MessageKind::Ping, relaySeq);
+            }
+            break;
+        }
+        default:
+            std::cout << "Error: unknown gossip message from " << from << std::endl;
+    }
+}
+
+void Membership::runNotifier() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        m_eventsChanged.wait(lock, [this](){ return !m_events.empty(); });
+        auto event = m_events.front();
+        m_events.pop_front();
+        lock.unlock();
+        m_listener(event.member, event.alive);
+        lock.lock();
+    }
+}
@@ -3,9 +3,13 @@
 */
 
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <vector>
 #include <iostream>
+#include <mutex>
 #include "MockTask.hpp"
+#include "TaskPool.hpp"
 #include "Utils.hpp"
 
 
@@ -15,59 +19,154 @@ namespace{
                                                     "Finished", 
                                                     "Cancelled",
                                                     "Failed"};
-
-std::string getStatusString (MockTask::Status status){
-    return statusStrings[status];
+    const size_t parkingCount = 256;
 }
+
+// Shared by tasks, since only running tasks ever sleep in one
+struct MockTask::Parking {
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+MockTask::Parking& MockTask::parking() const {
+    static Parking parkings[parkingCount];
+    // Pooled tasks sit a block apart, so the address is mixed before picking
+    const auto address = reinterpret_cast<uintptr_t>(this) >> 4;
+    return parkings[(address * 0x9e3779b97f4a7c15ull) >> 56];
 }
 
+MockTask::MockTask(InternedString description, int sleepTime) 
+: m_id(utils::generateUUID()), m_description(std::move(description)), m_sleepTimeMs(sleepTime), m_row(0), m_state(Status::Waiting){}
+
+MockTask::MockTask(const std::string& id, InternedString description, int sleepTime)
+: m_id(id), m_description(std::move(description)), m_sleepTimeMs(sleepTime), m_row(0), m_state(Status::Waiting){}
 
+std::shared_ptr<MockTask> MockTask::create(InternedString description, int sleepTime) {
+    return std::allocate_shared<MockTask>(PoolAllocator<MockTask>(), std::move(description), sleepTime);
+}
 
-MockTask::MockTask(const std::string& description, int sleepTime) 
-: m_description(description), m_sleepTimeMs(sleepTime), m_status(Status::Waiting), m_abort(false){
-    m_id = utils::generateUUID();
+std::shared_ptr<MockTask> MockTask::create(const std::string& id, InternedString description, int sleepTime) {
+    return std::allocate_shared<MockTask>(PoolAllocator<MockTask>(), id, std::move(description), sleepTime);
+}
+
+bool MockTask::start() {
+    auto state = m_state.load();
+    do {
+        if((state & statusMask) == Status::Cancelled) {
+            return false;
+        }
+    } while(!m_state.compare_exchange_weak(state, (state & abortFlag) | Status::Running));
+    return true;
 }
 
 void MockTask::compute() {
-    std::cout << "Task " << m_id << " started, sleeping for " << m_sleepTimeMs << " miliseconds..." << std::endl;
+    if(!start()) {
+        return;
+    }
+
+    const auto id = m_id.str();
+    std::cout << "Task " << id << " started, sleeping for " << m_sleepTimeMs << " miliseconds..." << std::endl;
     const auto start = std::chrono::steady_clock::now();
     const auto jobDuration = std::chrono::milliseconds(m_sleepTimeMs);
 
-    std::unique_lock<std::mutex> lock(m_mutex);
-    if(m_status != Status::Cancelled) {
-        m_status = Status::Running;
-        if(!m_condition.wait_for(lock, jobDuration, [this]{ return m_abort; })){
-            m_status = Status::Finished;
-            const auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
-            std::cout << "Task " << m_id << " finished after " << timeMs.count() << " miliseconds." << std::endl;
-        } else {
-            m_status = Status::Failed;
-            const auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
-            std::cout << "Task " << m_id << " aborted and didn't get time to finish. Stopped after " << timeMs.count() << " miliseconds." << std::endl;
-        }
-    }
+    auto& parking = this->parking();
+    std::unique_lock<std::mutex> lock(parking.mutex);
+    const bool aborted = parking.condition.wait_for(lock, jobDuration, [this]{ return isAborted(); });
     lock.unlock();
+
+    auto state = m_state.load();
+    while(!m_state.compare_exchange_weak(state, (state & abortFlag) | (aborted ? Status::Failed : Status::Finished))) {}
+    const auto timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if(!aborted) {
+        std::cout << "Task " << id << " finished after " << timeMs.count() << " miliseconds." << std::endl;
+    } else {
+        std::cout << "Task " << id << " aborted and didn't get time to finish. Stopped after " << timeMs.count() << " miliseconds." << std::endl;
+    }
 }
 
 void MockTask::abort() {
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_abort = true;
-        if(m_status == Status::Waiting) {
-            m_status = Status::Cancelled;
+    auto state = m_state.load();
+    uint8_t next;
+    do {
+        next = state | abortFlag;
+        if((state & statusMask) == Status::Waiting) {
+            next = abortFlag | Status::Cancelled;
         }
+    } while(!m_state.compare_exchange_weak(state, next));
+
+    if((state & statusMask) == Status::Running) {
+        // compute() checks the flag with the lock held before sleeping, so
+        // taking it here means it either saw the flag or is asleep to be woken
+        auto& parking = this->parking();
+        { std::lock_guard<std::mutex> lock(parking.mutex); }
+        parking.condition.notify_all();
     }
-    m_condition.notify_one();
+}
+
+bool MockTask::withdraw() {
+    auto state = m_state.load();
+    do {
+        if((state & statusMask) != Status::Waiting) {
+            return false;
+        }
+    } while(!m_state.compare_exchange_weak(state, abortFlag | Status::Cancelled));
+    return true;
+}
+
+void MockTask::setRemoteStatus(Status status) {
+    auto state = m_state.load();
+    do {
+        if(isFinal(static_cast<Status>(state & statusMask)) && !isFinal(status)) {
+            return;
+        }
+    } while(!m_state.compare_exchange_weak(state, (state & abortFlag) | status));
 }
 
 MockTaskView MockTask::getView() const {
-    return {m_id, m_description, m_sleepTimeMs, getStatusString(m_status)};
+    return {m_id.str(), m_description, m_sleepTimeMs, statusToString(getStatus())};
 }
 
 std::string MockTask::getId() const {
-    return m_id;
+    return m_id.str();
+}
+
+const InternedString& MockTask::getDescription() const {
+    return m_description;
+}
+
+MockTask::Status MockTask::getStatus() const {
+    return static_cast<Status>(m_state.load() & statusMask);
 }
 
 bool MockTask::isCancelled() const {
-    return m_status == Status::Cancelled;
+    return getStatus() == Status::Cancelled;
+}
+
+bool MockTask::isAborted() const {
+    return (m_state.load() & abortFlag) != 0;
+}
+
+void MockTask::setRow(uint32_t row) {
+    m_row = row;
+}
+
+uint32_t MockTask::getRow() const {
+    return m_row;
+}
+
+std::string MockTask::statusToString(Status status) {
+    return statusStrings[status];
+}
+
+MockTask::Status MockTask::statusFromString(const std::string& status) {
+    for(size_t i = 0; i < statusStrings.size(); ++i) {
+        if(statusStrings[i] == status) {
+            return static_cast<Status>(i);
+        }
+    }
+    return Status::Failed;
+}
+
+bool MockTask::isFinal(Status status) {
+    return status == Status::Finished || status == Status::Cancelled || status == Status::Failed;
 }
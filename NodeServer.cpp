@@ -0,0 +1,116 @@
+/*
+    Serves a task manager to remote nodes over the binary protocol
+*/
+
+#include "NodeServer.hpp"
+
+NodeServer::NodeServer(TaskManager& taskManager, const std::string& listenAddress, WorkStealer* stealer)
+: FrameServer(listenAddress), m_taskManager(taskManager), m_stealer(stealer) {}
+
+void NodeServer::handle(const protocol::Frame& request, protocol::Writer& response, const std::string& remoteHost) {
+    protocol::Reader reader(request.payload);
+    switch(request.type) {
+        case protocol::MessageType::CreateTask: {
+            auto description = reader.readString();
+            auto duration = reader.readI32();
+            auto id = m_taskManager.executeCreateTask(description, duration);
+            response.writeView(m_taskManager.viewTask(id));
+            break;
+        }
+        case protocol::MessageType::GetTask: {
+            auto id = reader.readString();
+            auto view = m_taskManager.viewTask(id);
+            if(view.id.empty() && m_stealer != nullptr) {
+                if(auto thief = m_stealer->findThief(id)) {
+                    view = thief->viewTask(id);
+                }
+            }
+            response.writeView(view);
+            break;
+        }
+        case protocol::MessageType::ListTasks:
+            response.writeViews(m_taskManager.viewAllTasks());
+            break;
+        case protocol::MessageType::CountTasks:
+            for(auto count : m_taskManager.countTasks()) {
+                response.writeU64(count);
+            }
+            break;
+        case protocol::MessageType::CancelTask: {
+            auto id = reader.readString();
+            bool cancelled = m_taskManager.cancelTask(id);
+            if(!cancelled && m_stealer != nullptr) {
+                if(auto thief = m_stealer->findThief(id)) {
+                    cancelled = thief->cancelTask(id);
+                }
+            }
+            response.writeU8(cancelled);
+            break;
+        }
+        case protocol::MessageType::SubmitTask: {
+            auto task = reader.readView();
+            if(task.id.empty()) {
+                throw protocol::ProtocolError("task without an id");
+            }
+            if(task.id.size() > MockTask::maxIdLength) {
+                throw protocol::ProtocolError("task id too long");
+            }
+            m_taskManager.submitTask(task);
+            if(m_stealer != nullptr) {
+                m_stealer->taskReturned(task.id);
+            }
+            response.writeU8(1);
+            break;
+        }
+        case protocol::MessageType::ReleaseTask:
+            response.writeView(m_taskManager.releaseTask(reader.readString()));
+            break;
+        case protocol::MessageType::LeaseTasks: {
+            auto workerId = reader.readString();
+            auto maxTasks = reader.readU32();
+            response.writeU32(static_cast<uint32_t>(m_taskManager.getLeaseDuration().count()));
+            response.writeViews(m_taskManager.leaseTasks(workerId, maxTasks));
+            break;
+        }
+        case protocol::MessageType::Heartbeat: {
+            auto workerId = reader.readString();
+            std::vector<TaskReport> reports(reader.readCount());
+            for(auto& report : reports) {
+                report.id = reader.readString();
+                auto status = reader.readU8();
+                if(status > MockTask::Status::Failed) {
+                    throw protocol::ProtocolError("unknown task status");
+                }
+                report.status = static_cast<MockTask::Status>(status);
+            }
+
+            auto cancels = m_taskManager.heartbeat(workerId, reports);
+            response.writeU32(static_cast<uint32_t>(cancels.size()));
+            for(const auto& id : cancels) {
+                response.writeString(id);
+            }
+            break;
+        }
+        case protocol::MessageType::PeerHeartbeat: {
+            if(m_stealer == nullptr) {
+                throw protocol::ProtocolError("work stealing is off on this node");
+            }
+            auto load = m_stealer->getLoad();
+            response.writeU32(static_cast<uint32_t>(load.waiting));
+            response.writeU32(static_cast<uint32_t>(load.idleWorkers));
+            break;
+        }
+        case protocol::MessageType::StealTasks: {
+            if(m_stealer == nullptr) {
+                throw protocol::ProtocolError("work stealing is off on this node");
+            }
+            auto thiefPort = reader.readU32();
+            auto maxTasks = reader.readU32();
+            auto thiefAddress = remoteHost + ":" + std::to_string(thiefPort);
+            response.writeViews(m_stealer->giveTasks(thiefAddress, maxTasks));
+            break;
+        }
+        default:
+            throw protocol::ProtocolError("unknown message type");
+    }
+}
@@ -0,0 +1,199 @@
+/*
+    Compact binary protocol spoken between the coordinator and worker nodes
+*/
+
+#include <array>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include "Protocol.hpp"
+
+namespace protocol {
+
+namespace {
+    // Upper bound on a frame, so a corrupt length can't make us allocate gigabytes
+    const uint32_t maxFrameSize = 64 * 1024 * 1024;
+    // Length, message type and request id
+    const size_t frameHeaderSize = 9;
+}
+
+void Writer::writeU8(uint8_t value) {
+    m_buffer.push_back(value);
+}
+
+void Writer::writeU32(uint32_t value) {
+    for(int shift = 0; shift < 32; shift += 8) {
+        m_buffer.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void Writer::writeI32(int32_t value) {
+    writeU32(static_cast<uint32_t>(value));
+}
+
+void Writer::writeU64(uint64_t value) {
+    writeU32(static_cast<uint32_t>(value));
+    writeU32(static_cast<uint32_t>(value >> 32));
+}
+
+void Writer::writeString(const std::string& value) {
+    writeU32(static_cast<uint32_t>(value.size()));
+    m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+}
+
+void Writer::writeBytes(const std::vector<uint8_t>& value) {
+    writeU32(static_cast<uint32_t>(value.size()));
+    m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+}
+
+void Writer::writeView(const MockTaskView& view) {
+    writeString(view.id);
+    if(view.id.empty()) {
+        return;
+    }
+    writeString(view.description.str());
+    writeI32(view.duration);
+    writeU8(static_cast<uint8_t>(MockTask::statusFromString(view.status)));
+}
+
+void Writer::writeViews(const std::vector<MockTaskView>& views) {
+    writeU32(static_cast<uint32_t>(views.size()));
+    for(const auto& view : views) {
+        writeView(view);
+    }
+}
+
+size_t Writer::size() const {
+    return m_buffer.size();
+}
+
+const std::vector<uint8_t>& Writer::buffer() const {
+    return m_buffer;
+}
+
+Reader::Reader(const std::vector<uint8_t>& buffer, size_t offset) : m_buffer(buffer), m_offset(offset) {}
+
+size_t Reader::getOffset() const {
+    return m_offset;
+}
+
+void Reader::require(size_t count) const {
+    if(m_buffer.size() - m_offset < count) {
+        throw ProtocolError("truncated message");
+    }
+}
+
+uint8_t Reader::readU8() {
+    require(1);
+    return m_buffer[m_offset++];
+}
+
+uint32_t Reader::readU32() {
+    require(4);
+    uint32_t value = 0;
+    for(int shift = 0; shift < 32; shift += 8) {
+        value |= static_cast<uint32_t>(m_buffer[m_offset++]) << shift;
+    }
+    return value;
+}
+
+int32_t Reader::readI32() {
+    return static_cast<int32_t>(readU32());
+}
+
+uint64_t Reader::readU64() {
+    uint64_t low = readU32();
+    uint64_t high = readU32();
+    return low | (high << 32);
+}
+
+std::string Reader::readString() {
+    auto size = readU32();
+    require(size);
+    std::string value(reinterpret_cast<const char*>(m_buffer.data()) + m_offset, size);
+    m_offset += size;
+    return value;
+}
+
+std::vector<uint8_t> Reader::readBytes() {
+    auto size = readU32();
+    require(size);
+    std::vector<uint8_t> value(m_buffer.begin() + m_offset, m_buffer.begin() + m_offset + size);
+    m_offset += size;
+    return value;
+}
+
+uint32_t Reader::readCount() {
+    auto count = readU32();
+    // Every list element takes at least one byte
+    if(count > m_buffer.size() - m_offset) {
+        throw ProtocolError("list longer than its message");
+    }
+    return count;
+}
+
+MockTaskView Reader::readView() {
+    MockTaskView view;
+    view.id = readString();
+    if(view.id.empty()) {
+        return view;
+    }
+    view.description = readString();
+    view.duration = readI32();
+    auto status = readU8();
+    if(status > MockTask::Status::Failed) {
+        throw ProtocolError("unknown task status");
+    }
+    view.status = MockTask::statusToString(static_cast<MockTask::Status>(status));
+    return view;
+}
+
+std::vector<MockTaskView> Reader::readViews() {
+    auto count = readCount();
+    std::vector<MockTaskView> views;
+    views.reserve(count);
+    for(uint32_t i = 0; i < count; ++i) {
+        views.push_back(readView());
+    }
+    return views;
+}
+
+void writeFrame(Socket& socket, MessageType type, uint32_t requestId, const Writer& payload) {
+    const auto length = static_cast<uint32_t>(payload.size() + frameHeaderSize - 4);
+    std::array<uint8_t, frameHeaderSize> header = {
+        static_cast<uint8_t>(length),
+        static_cast<uint8_t>(length >> 8),
+        static_cast<uint8_t>(length >> 16),
+        static_cast<uint8_t>(length >> 24),
+        static_cast<uint8_t>(type),
+        static_cast<uint8_t>(requestId),
+        static_cast<uint8_t>(requestId >> 8),
+        static_cast<uint8_t>(requestId >> 16),
+        static_cast<uint8_t>(requestId >> 24)
+    };
+    // One gathered write, so header and body leave in the same segment
+    const std::array<boost::asio::const_buffer, 2> blocks = {
+        boost::asio::buffer(header),
+        boost::asio::buffer(payload.buffer())
+    };
+    boost::asio::write(socket, blocks);
+}
+
+Frame readFrame(Socket& socket) {
+    std::array<uint8_t, frameHeaderSize> header;
+    boost::asio::read(socket, boost::asio::buffer(header));
+    const uint32_t length = header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24);
+    if(length < frameHeaderSize - 4 || length > maxFrameSize) {
+        throw ProtocolError("invalid frame length");
+    }
+
+    Frame frame;
+    frame.type = static_cast<MessageType>(header[4]);
+    frame.requestId = header[5] | (header[6] << 8) | (header[7] << 16) | (static_cast<uint32_t>(header[8]) << 24);
+    frame.payload.resize(length - (frameHeaderSize - 4));
+    boost::asio::read(socket, boost::asio::buffer(frame.payload));
+    return frame;
+}
+}
@@ -0,0 +1,716 @@
+/*
+    Raft consensus replicating an opaque command log between a few nodes
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include "Raft.hpp"
+
+using boost::asio::ip::tcp;
+
+namespace {
+    const auto heartbeatInterval = std::chrono::milliseconds(50);
+    const int minElectionTimeoutMs = 150;
+    const int maxElectionTimeoutMs = 300;
+    const auto reconnectDelay = std::chrono::milliseconds(100);
+    // AppendEntries requests a follower may have unanswered at once
+    const size_t maxInflight = 8;
+    const size_t maxEntriesPerRequest = 512;
+
+    // An entry on disk is its term, the command length, then the command
+    const size_t entryHeaderSize = 12;
+
+    void writeAll(int fd, const uint8_t* data, size_t size) {
+        while(size > 0) {
+            auto written = ::write(fd, data, size);
+            if(written < 0) {
+                throw std::runtime_error("Raft log write failed");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+}
+
+RaftStorage::RaftStorage(const std::string& directory, size_t selfIndex, bool syncWrites)
+: m_logPath(directory + "/raft-" + std::to_string(selfIndex) + ".log"),
+  m_statePath(directory + "/raft-" + std::to_string(selfIndex) + ".state"),
+  m_syncWrites(syncWrites), m_fd(-1), m_term(0), m_votedFor(-1) {
+    load();
+    m_fd = ::open(m_logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(m_fd < 0) {
+        throw std::runtime_error("Can't open Raft log " + m_logPath);
+    }
+}
+
+RaftStorage::~RaftStorage() {
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void RaftStorage::load() {
+    std::ifstream state(m_statePath);
+    state >> m_term >> m_votedFor;
+
+    std::ifstream log(m_logPath, std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+    protocol::Reader reader(bytes);
+    uint64_t offset = 0;
+    // A crash can leave a torn entry at the end, which was never acknowledged
+    while(bytes.size() - offset >= entryHeaderSize) {
+        try {
+            RaftEntry entry;
+            entry.term = reader.readU64();
+            entry.command = reader.readBytes();
+            offset += entryHeaderSize + entry.command.size();
+            m_entryEnds.push_back(offset);
+            m_loadedEntries.push_back(std::move(entry));
+        } catch(const protocol::ProtocolError&) {
+            break;
+        }
+    }
+    if(offset != bytes.size()) {
+        std::cout << "Dropping a torn entry at the end of " << m_logPath << std::endl;
+        ::truncate(m_logPath.c_str(), offset);
+    }
+}
+
+uint64_t RaftStorage::getTerm() const {
+    return m_term;
+}
+
+int64_t RaftStorage::getVotedFor() const {
+    return m_votedFor;
+}
+
+const std::vector<RaftEntry>& RaftStorage::getLoadedEntries() const {
+    return m_loadedEntries;
+}
+
+void RaftStorage::saveState(uint64_t term, int64_t votedFor) {
+    m_term = term;
+    m_votedFor = votedFor;
+    const auto temporary = m_statePath + ".tmp";
+    {
+        std::ofstream state(temporary, std::ios::trunc);
+        state << term << " " << votedFor << "\n";
+    }
+    if(m_syncWrites) {
+        int fd = ::open(temporary.c_str(), O_RDONLY);
+        if(fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+    std::rename(temporary.c_str(), m_statePath.c_str());
+}
+
+void RaftStorage::append(const RaftEntry& entry) {
+    protocol::Writer record;
+    record.writeU64(entry.term);
+    record.writeBytes(entry.command);
+    writeAll(m_fd, record.buffer().data(), record.buffer().size());
+    auto previousEnd = m_entryEnds.empty() ? 0 : m_entryEnds.back();
+    m_entryEnds.push_back(previousEnd + record.buffer().size());
+}
+
+void RaftStorage::truncate(uint64_t index) {
+    if(index > m_entryEnds.size()) {
+        return;
+    }
+    m_entryEnds.resize(index - 1);
+    auto size = m_entryEnds.empty() ? 0 : m_entryEnds.back();
+    if(::ftruncate(m_fd, size) != 0) {
+        throw std::runtime_error("Raft log truncation failed");
+    }
+}
+
+void RaftStorage::sync() {
+    if(m_syncWrites && ::fdatasync(m_fd) != 0) {
+        throw std::runtime_error("Raft log flush failed");
+    }
+}
+
+Raft::Raft(size_t selfIndex, const std::vector<std::string>& members, const std::string& dataDirectory,
+           bool syncWrites, ApplyCallback apply, LeadershipCallback onLeadership)
+: m_self(selfIndex), m_members(members), m_apply(std::move(apply)), m_onLeadership(std::move(onLeadership)),
+  m_storage(dataDirectory, selfIndex, syncWrites),
+  m_role(Role::Follower), m_votes(0), m_truncations(0), m_storageFailed(false), m_commitIndex(0), m_lastApplied(0),
+  m_leaderReadyIndex(0), m_announcedLeading(false) {
+    if(selfIndex >= members.size()) {
+        throw std::invalid_argument("Raft member index out of range");
+    }
+
+    m_currentTerm = m_storage.getTerm();
+    m_votedFor = m_storage.getVotedFor();
+    m_log = m_storage.getLoadedEntries();
+    m_durableIndex = m_log.size();
+    for(size_t i = 0; i < members.size(); ++i) {
+        if(i == selfIndex) {
+            m_peers.push_back(nullptr);
+            continue;
+        }
+        auto peer = std::make_unique<Peer>();
+        peer->address = members[i];
+        peer->calls = std::make_unique<Connection>(members[i]);
+        m_peers.push_back(std::move(peer));
+    }
+    resetElectionDeadline();
+}
+
+void Raft::start() {
+    m_threads.emplace_back(&Raft::runServer, this);
+    m_threads.emplace_back(&Raft::runApplier, this);
+    m_threads.emplace_back(&Raft::runSyncer, this);
+    for(size_t i = 0; i < m_peers.size(); ++i) {
+        if(m_peers[i] != nullptr) {
+            m_threads.emplace_back(&Raft::replicateTo, this, i);
+        }
+    }
+    m_threads.emplace_back(&Raft::runTimer, this);
+}
+
+uint64_t Raft::lastIndex() const {
+    return m_log.size();
+}
+
+uint64_t Raft::termAt(uint64_t index) const {
+    return index == 0 ? 0 : m_log[index - 1].term;
+}
+
+size_t Raft::majority() const {
+    return m_members.size() / 2 + 1;
+}
+
+void Raft::resetElectionDeadline() {
+    static thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_int_distribution<int> timeout(minElectionTimeoutMs, maxElectionTimeoutMs);
+    m_electionDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout(generator));
+}
+
+void Raft::persistState() {
+    m_storage.saveState(m_currentTerm, m_votedFor);
+}
+
+void Raft::appendEntry(RaftEntry entry) {
+    if(m_storageFailed) {
+        throw std::runtime_error("Raft log failed to flush and takes no more entries");
+    }
+    m_storage.append(entry);
+    m_log.push_back(std::move(entry));
+    m_changed.notify_all();
+}
+
+void Raft::truncateFrom(uint64_t index) {
+    m_storage.truncate(index);
+    m_log.resize(index - 1);
+    m_durableIndex = std::min(m_durableIndex, index - 1);
+    ++m_truncations;
+}
+
+void Raft::startElection() {
+    // A member that can't flush its log can't lead
+    if(m_storageFailed) {
+        return;
+    }
+    m_role = Role::Candidate;
+    ++m_currentTerm;
+    m_votedFor = static_cast<int64_t>(m_self);
+    m_leader.reset();
+    persistState();
+    m_votes = 1;
+    resetElectionDeadline();
+    std::cout << "Raft: starting election for term " << m_currentTerm << std::endl;
+
+    if(m_votes >= majority()) {
+        becomeLeader();
+        return;
+    }
+    for(size_t i = 0; i < m_peers.size(); ++i) {
+        if(m_peers[i] != nullptr) {
+            std::thread(&Raft::requestVote, this, i, m_currentTerm, lastIndex(), termAt(lastIndex())).detach();
+        }
+    }
+}
+
+void Raft::becomeLeader() {
+    m_role = Role::Leader;
+    m_leader = m_self;
+    for(auto& peer : m_peers) {
+        if(peer != nullptr) {
+            peer->matchIndex = 0;
+            resetPeer(*peer);
+            peer->nextIndex = lastIndex() + 1;
+        }
+    }
+    std::cout << "Raft: leading term " << m_currentTerm << std::endl;
+    // Entries from earlier terms only commit along with one from this term
+    appendEntry({m_currentTerm, {}});
+    m_leaderReadyIndex = lastIndex();
+    advanceCommitIndex();
+}
+
+void Raft::stepDown(uint64_t term) {
+    if(term > m_currentTerm) {
+        m_currentTerm = term;
+        m_votedFor = -1;
+        persistState();
+    }
+    if(m_role == Role::Leader) {
+        std::cout << "Raft: no longer leading, now in term " << m_currentTerm << std::endl;
+    }
+    m_role = Role::Follower;
+    m_changed.notify_all();
+}
+
+void Raft::advanceCommitIndex() {
+    // Only entries from the current term are committed by counting replicas
+    for(uint64_t index = lastIndex(); index > m_commitIndex && termAt(index) == m_currentTerm; --index) {
+        size_t replicas = m_durableIndex >= index ? 1 : 0;
+        for(const auto& peer : m_peers) {
+            if(peer != nullptr && peer->matchIndex >= index) {
+                ++replicas;
+            }
+        }
+        if(replicas >= majority()) {
+            m_commitIndex = index;
+            m_changed.notify_all();
+            return;
+        }
+    }
+}
+
+void Raft::resetPeer(Peer& peer) {
+    if(peer.replication) {
+        boost::system::error_code ignored;
+        peer.replication->shutdown(protocol::Socket::shutdown_both, ignored);
+        peer.replication.reset();
+    }
+    ++peer.generation;
+    peer.inflight = 0;
+    peer.nextIndex = peer.matchIndex + 1;
+    m_changed.notify_all();
+}
+
+std::optional<Raft::Proposal> Raft::propose(const std::vector<uint8_t>& command) {
+    if(m_role != Role::Leader || m_storageFailed) {
+        return std::nullopt;
+    }
+    appendEntry({m_currentTerm, command});
+    return Proposal{lastIndex(), m_currentTerm};
+}
+
+bool Raft::waitApplied(std::unique_lock<std::mutex>& lock, uint64_t index, std::chrono::milliseconds timeout) {
+    return m_changed.wait_for(lock, timeout, [this, index](){ return m_lastApplied >= index; });
+}
+
+bool Raft::proposeIfLeader(const std::vector<uint8_t>& command) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return propose(command).has_value();
+}
+
+bool Raft::isLeader() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_role == Role::Leader;
+}
+
+bool Raft::replicate(const std::vector<uint8_t>& command, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(auto proposal = propose(command)) {
+        // A new leader may have replaced the entry before it committed
+        return waitApplied(lock, proposal->index, timeout) && termAt(proposal->index) == proposal->term;
+    }
+    if(!m_leader || *m_leader == m_self) {
+        return false;
+    }
+
+    Connection& leader = *m_peers[*m_leader]->calls;
+    lock.unlock();
+    protocol::Writer request;
+    request.writeBytes(command);
+    uint64_t index;
+    try {
+        auto response = leader.call(protocol::MessageType::Propose, request);
+        protocol::Reader reader(response.payload);
+        if(reader.readU8() == 0) {
+            return false;
+        }
+        index = reader.readU64();
+    } catch(const std::exception& e) {
+        std::cout << "Error: couldn't forward to Raft leader " << leader.getAddress() << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    // Committed on the leader; wait for it here so callers can read their write
+    lock.lock();
+    return waitApplied(lock, index, timeout);
+}
+
+void Raft::runTimer() {
+    for(;;) {
+        std::chrono::steady_clock::time_point wakeUp;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const auto now = std::chrono::steady_clock::now();
+            if(m_role != Role::Leader && now >= m_electionDeadline) {
+                startElection();
+            }
+            wakeUp = m_role == Role::Leader ? now + heartbeatInterval : m_electionDeadline;
+        }
+        std::this_thread::sleep_until(wakeUp);
+    }
+}
+
+void Raft::runApplier() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto leading = [this](){ return m_role == Role::Leader && m_lastApplied >= m_leaderReadyIndex; };
+    for(;;) {
+        m_changed.wait(lock, [this, &leading](){ return m_commitIndex > m_lastApplied || leading() != m_announcedLeading; });
+        while(m_lastApplied < m_commitIndex) {
+            auto command = m_log[m_lastApplied].command;
+            lock.unlock();
+            if(!command.empty()) {
+                m_apply(command);
+            }
+            lock.lock();
+            ++m_lastApplied;
+            m_changed.notify_all();
+        }
+
+        if(leading() != m_announcedLeading) {
+            m_announcedLeading = !m_announcedLeading;
+            const bool announcement = m_announcedLeading;
+            lock.unlock();
+            m_onLeadership(announcement);
+            lock.lock();
+        }
+    }
+}
+
+void Raft::runSyncer() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        m_changed.wait(lock, [this](){ return lastIndex() > m_durableIndex; });
+        // Everything appended so far shares this fsync
+        const auto target = lastIndex();
+        const auto truncations = m_truncations;
+        lock.unlock();
+        try {
+            m_storage.sync();
+        } catch(const std::exception& e) {
+            lock.lock();
+            std::cout << "Error: " << e.what() << ", acknowledging no more entries" << std::endl;
+            m_storageFailed = true;
+            m_changed.notify_all();
+            return;
+        }
+        lock.lock();
+        if(truncations != m_truncations) {
+            continue;
+        }
+        m_durableIndex = std::max(m_durableIndex, target);
+        if(m_role == Role::Leader) {
+            advanceCommitIndex();
+        }
+        m_changed.notify_all();
+    }
+}
+
+void Raft::replicateTo(size_t member) {
+    Peer& peer = *m_peers[member];
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        m_changed.wait_for(lock, heartbeatInterval, [this, &peer](){
+            const bool hasNews = peer.nextIndex <= lastIndex() || peer.commitSent < m_commitIndex;
+            return m_role == Role::Leader && (!peer.replication || (hasNews && peer.inflight < maxInflight));
+        });
+        if(m_role != Role::Leader) {
+            continue;
+        }
+
+        if(!peer.replication) {
+            lock.unlock();
+            std::shared_ptr<protocol::Socket> socket;
+            try {
+                socket = std::make_shared<protocol::Socket>(connectTo(m_io, peer.address));
+            } catch(const std::exception&) {
+                std::this_thread::sleep_for(reconnectDelay);
+                lock.lock();
+                continue;
+            }
+            lock.lock();
+            resetPeer(peer);
+            peer.replication = socket;
+            std::thread(&Raft::receiveFrom, this, member, socket, peer.generation).detach();
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const bool hasNews = peer.nextIndex <= lastIndex() || peer.commitSent < m_commitIndex;
+        if(peer.inflight >= maxInflight || (!hasNews && now - peer.lastSend < heartbeatInterval)) {
+            continue;
+        }
+
+        // Send everything not yet sent, assuming earlier requests will succeed
+        const auto prevIndex = peer.nextIndex - 1;
+        const auto count = std::min<uint64_t>(lastIndex() - prevIndex, maxEntriesPerRequest);
+        protocol::Writer request;
+        request.writeU64(m_currentTerm);
+        request.writeU32(static_cast<uint32_t>(m_self));
+        request.writeU64(prevIndex);
+        request.writeU64(termAt(prevIndex));
+        request.writeU64(m_commitIndex);
+        request.writeU32(static_cast<uint32_t>(count));
+        for(uint64_t index = prevIndex + 1; index <= prevIndex + count; ++index) {
+            request.writeU64(m_log[index - 1].term);
+            request.writeBytes(m_log[index - 1].command);
+        }
+        peer.nextIndex += count;
+        peer.commitSent = m_commitIndex;
+        ++peer.inflight;
+        peer.lastSend = now;
+
+        auto socket = peer.replication;
+        const auto generation = peer.generation;
+        lock.unlock();
+        try {
+            // Followers answer in order, so responses need no matching by id
+            protocol::writeFrame(*socket, protocol::MessageType::AppendEntries, 0, request);
+            lock.lock();
+        } catch(const std::exception&) {
+            lock.lock();
+            if(peer.generation == generation) {
+                resetPeer(peer);
+            }
+        }
+    }
+}
+
+void Raft::receiveFrom(size_t member, std::shared_ptr<protocol::Socket> socket, uint64_t generation) {
+    Peer& peer = *m_peers[member];
+    try {
+        for(;;) {
+            auto frame = protocol::readFrame(*socket);
+            protocol::Reader reader(frame.payload);
+            const auto term = reader.readU64();
+            const bool success = reader.readU8() != 0;
+            const auto index = reader.readU64();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(peer.generation != generation) {
+                return;
+            }
+            if(peer.inflight > 0) {
+                --peer.inflight;
+            }
+            if(term > m_currentTerm) {
+                stepDown(term);
+                continue;
+            }
+            if(m_role != Role::Leader || term != m_currentTerm) {
+                continue;
+            }
+
+            if(success) {
+                peer.matchIndex = std::max(peer.matchIndex, index);
+                peer.nextIndex = std::max(peer.nextIndex, index + 1);
+                advanceCommitIndex();
+            } else {
+                // index is where the follower's log stops agreeing with ours
+                peer.nextIndex = std::max(peer.matchIndex + 1, std::min(peer.nextIndex, index + 1));
+            }
+            m_changed.notify_all();
+        }
+    } catch(const std::exception&) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(peer.generation == generation) {
+            resetPeer(peer);
+        }
+    }
+}
+
+void Raft::requestVote(size_t member, uint64_t term, uint64_t lastLogIndex, uint64_t lastLogTerm) {
+    protocol::Writer request;
+    request.writeU64(term);
+    request.writeU32(static_cast<uint32_t>(m_self));
+    request.writeU64(lastLogIndex);
+    request.writeU64(lastLogTerm);
+
+    uint64_t responseTerm;
+    bool granted;
+    try {
+        auto response = m_peers[member]->calls->call(protocol::MessageType::RequestVote, request);
+        protocol::Reader reader(response.payload);
+        responseTerm = reader.readU64();
+        granted = reader.readU8() != 0;
+    } catch(const std::exception&) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(responseTerm > m_currentTerm) {
+        stepDown(responseTerm);
+        return;
+    }
+    if(m_role != Role::Candidate || m_currentTerm != term || !granted) {
+        return;
+    }
+    if(++m_votes >= majority()) {
+        becomeLeader();
+    }
+}
+
+void Raft::runServer() {
+    auto address = m_members[m_self];
+    auto port = address.substr(address.rfind(':') + 1);
+    auto acceptor = listenOn(m_io, port);
+    std::cout << "Raft member " << m_self << " listening on port " << port << std::endl;
+    for(;;) {
+        protocol::Socket socket(m_io);
+        acceptor.accept(socket);
+        socket.set_option(tcp::no_delay(true));
+        std::thread(&Raft::serve, this, std::move(socket)).detach();
+    }
+}
+
+void Raft::serve(protocol::Socket socket) {
+    try {
+        for(;;) {
+            auto request = protocol::readFrame(socket);
+            protocol::Reader reader(request.payload);
+            protocol::Writer response;
+            switch(request.type) {
+                case protocol::MessageType::RequestVote:
+                    handleRequestVote(reader, response);
+                    break;
+                case protocol::MessageType::AppendEntries:
+                    handleAppendEntries(reader, response);
+                    break;
+                case protocol::MessageType::Propose:
+                    handlePropose(reader, response);
+                    break;
+                default:
+                    throw protocol::ProtocolError("unexpected message on the Raft port");
+            }
+            protocol::writeFrame(socket, request.type, request.requestId, response);
+        }
+    } catch(const boost::system::system_error&) {
+        // Peer went away; it reconnects when it needs us again
+    } catch(const protocol::ProtocolError& e) {
+        std::cout << "Error: closing Raft connection after bad request: " << e.what() << std::endl;
+    } catch(const std::exception& e) {
+        // Such as the log failing to write; the leader retries the entries
+        std::cout << "Error: closing Raft connection after a failed request: " << e.what() << std::endl;
+    }
+}
+
+void Raft::handleRequestVote(protocol::Reader& request, protocol::Writer& response) {
+    const auto term = request.readU64();
+    const auto candidate = request.readU32();
+    const auto candidateLastIndex = request.readU64();
+    const auto candidateLastTerm = request.readU64();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(term > m_currentTerm) {
+        stepDown(term);
+    }
+    const bool upToDate = candidateLastTerm > termAt(lastIndex())
+        || (candidateLastTerm == termAt(lastIndex()) && candidateLastIndex >= lastIndex());
+    const bool granted = term == m_currentTerm && upToDate
+        && (m_votedFor < 0 || m_votedFor == static_cast<int64_t>(candidate));
+    if(granted) {
+        m_votedFor = candidate;
+        persistState();
+        resetElectionDeadline();
+    }
+    response.writeU64(m_currentTerm);
+    response.writeU8(granted);
+}
+
+void Raft::handleAppendEntries(protocol::Reader& request, protocol::Writer& response) {
+    const auto term = request.readU64();
+    const auto leader = request.readU32();
+    const auto prevIndex = request.readU64();
+    const auto prevTerm = request.readU64();
+    const auto leaderCommit = request.readU64();
+    std::vector<RaftEntry> entries(request.readCount());
+    for(auto& entry : entries) {
+        entry.term = request.readU64();
+        entry.command = request.readBytes();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto reply = [this, &response](bool success, uint64_t index) {
+        response.writeU64(m_currentTerm);
+        response.writeU8(success);
+        response.writeU64(index);
+    };
+    if(term < m_currentTerm) {
+        reply(false, lastIndex());
+        return;
+    }
+    if(term > m_currentTerm || m_role != Role::Follower) {
+        stepDown(term);
+    }
+    m_leader = leader;
+    resetElectionDeadline();
+
+    if(prevIndex > lastIndex()) {
+        reply(false, lastIndex());
+        return;
+    }
+    if(termAt(prevIndex) != prevTerm) {
+        // Skip back over the whole conflicting term in one round trip
+        auto conflict = prevIndex;
+        while(conflict > 1 && termAt(conflict - 1) == termAt(prevIndex)) {
+            --conflict;
+        }
+        reply(false, conflict - 1);
+        return;
+    }
+
+    auto index = prevIndex;
+    for(auto& entry : entries) {
+        ++index;
+        if(index <= lastIndex()) {
+            if(termAt(index) == entry.term) {
+                continue;
+            }
+            truncateFrom(index);
+        }
+        appendEntry(std::move(entry));
+    }
+
+    if(leaderCommit > m_commitIndex) {
+        m_commitIndex = std::min(leaderCommit, index);
+        m_changed.notify_all();
+    }
+    // Acknowledge only what is on disk
+    m_changed.wait(lock, [this, index](){ return m_durableIndex >= index || lastIndex() < index || m_storageFailed; });
+    if(m_durableIndex < index && lastIndex() >= index) {
+        throw std::runtime_error("Raft log failed to flush");
+    }
+    reply(lastIndex() >= index, index);
+}
+
+void Raft::handlePropose(protocol::Reader& request, protocol::Writer& response) {
+    auto command = request.readBytes();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto proposal = propose(command);
+    const bool committed = proposal
+        && m_changed.wait_for(lock, std::chrono::seconds(2), [this, &proposal](){ return m_commitIndex >= proposal->index; })
+        && termAt(proposal->index) == proposal->term;
+    response.writeU8(committed);
+    response.writeU64(committed ? proposal->index : 0);
+}
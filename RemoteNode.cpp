@@ -0,0 +1,151 @@
+/*
+    Client side of a connection to a worker node
+*/
+
+#include <iostream>
+
+#include "RemoteNode.hpp"
+
+RemoteNode::RemoteNode(const std::string& address) : m_connection(address) {}
+
+const std::string& RemoteNode::getAddress() const {
+    return m_connection.getAddress();
+}
+
+protocol::Frame RemoteNode::call(protocol::MessageType type, const protocol::Writer& request) const {
+    return m_connection.call(type, request);
+}
+
+std::string RemoteNode::executeCreateTask(const std::string& description, int duration) {
+    protocol::Writer request;
+    request.writeString(description);
+    request.writeI32(duration);
+    try {
+        auto response = call(protocol::MessageType::CreateTask, request);
+        return protocol::Reader(response.payload).readView().id;
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't create the task: " << e.what() << std::endl;
+        return "";
+    }
+}
+
+MockTaskView RemoteNode::viewTask(const std::string& id) const {
+    protocol::Writer request;
+    request.writeString(id);
+    try {
+        auto response = call(protocol::MessageType::GetTask, request);
+        return protocol::Reader(response.payload).readView();
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't look up the task: " << e.what() << std::endl;
+        return MockTaskView();
+    }
+}
+
+std::vector<MockTaskView> RemoteNode::viewAllTasks() const {
+    try {
+        auto response = call(protocol::MessageType::ListTasks, protocol::Writer());
+        return protocol::Reader(response.payload).readViews();
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't list its tasks: " << e.what() << std::endl;
+        return {};
+    }
+}
+
+bool RemoteNode::cancelTask(const std::string& id) {
+    protocol::Writer request;
+    request.writeString(id);
+    try {
+        auto response = call(protocol::MessageType::CancelTask, request);
+        return protocol::Reader(response.payload).readU8() != 0;
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't cancel the task: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+TaskCounts RemoteNode::countTasks() const {
+    TaskCounts counts = {};
+    try {
+        auto response = call(protocol::MessageType::CountTasks, protocol::Writer());
+        protocol::Reader reader(response.payload);
+        for(auto& count : counts) {
+            count = reader.readU64();
+        }
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't count its tasks: " << e.what() << std::endl;
+        return {};
+    }
+    return counts;
+}
+
+bool RemoteNode::submitTask(const MockTaskView& task) {
+    protocol::Writer request;
+    request.writeView(task);
+    try {
+        auto response = call(protocol::MessageType::SubmitTask, request);
+        return protocol::Reader(response.payload).readU8() != 0;
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't take task " << task.id << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+MockTaskView RemoteNode::releaseTask(const std::string& id) {
+    protocol::Writer request;
+    request.writeString(id);
+    try {
+        auto response = call(protocol::MessageType::ReleaseTask, request);
+        return protocol::Reader(response.payload).readView();
+    } catch(const std::exception& e) {
+        std::cout << "Error: node " << getAddress() << " couldn't release task " << id << ": " << e.what() << std::endl;
+        return MockTaskView();
+    }
+}
+
+LeaseGrant RemoteNode::leaseTasks(const std::string& workerId, size_t maxTasks) {
+    protocol::Writer request;
+    request.writeString(workerId);
+    request.writeU32(static_cast<uint32_t>(maxTasks));
+    auto response = call(protocol::MessageType::LeaseTasks, request);
+
+    protocol::Reader reader(response.payload);
+    LeaseGrant grant;
+    grant.leaseDuration = std::chrono::milliseconds(reader.readU32());
+    grant.tasks = reader.readViews();
+    return grant;
+}
+
+std::vector<std::string> RemoteNode::heartbeat(const std::string& workerId, const std::vector<TaskReport>& reports) {
+    protocol::Writer request;
+    request.writeString(workerId);
+    request.writeU32(static_cast<uint32_t>(reports.size()));
+    for(const auto& report : reports) {
+        request.writeString(report.id);
+        request.writeU8(static_cast<uint8_t>(report.status));
+    }
+    auto response = call(protocol::MessageType::Heartbeat, request);
+
+    protocol::Reader reader(response.payload);
+    std::vector<std::string> cancels(reader.readCount());
+    for(auto& id : cancels) {
+        id = reader.readString();
+    }
+    return cancels;
+}
+
+TaskLoad RemoteNode::heartbeatPeer() {
+    auto response = call(protocol::MessageType::PeerHeartbeat, protocol::Writer());
+    protocol::Reader reader(response.payload);
+    TaskLoad load;
+    load.waiting = reader.readU32();
+    load.idleWorkers = reader.readU32();
+    return load;
+}
+
+std::vector<MockTaskView> RemoteNode::stealTasks(unsigned short thiefPort, size_t maxTasks) {
+    protocol::Writer request;
+    request.writeU32(thiefPort);
+    request.writeU32(static_cast<uint32_t>(maxTasks));
+    auto response = call(protocol::MessageType::StealTasks, request);
+    return protocol::Reader(response.payload).readViews();
+}
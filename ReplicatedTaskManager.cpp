@@ -0,0 +1,115 @@
+/*
+    Task registry replicated between coordinators through a Raft log
+*/
+
+#include <iostream>
+
+#include "ReplicatedTaskManager.hpp"
+#include "Utils.hpp"
+
+namespace {
+    // How long a REST call waits for its change to commit
+    const auto commitTimeout = std::chrono::milliseconds(2000);
+
+    enum class Operation : uint8_t {
+        Create = 1,
+        Status,
+        Cancel
+    };
+
+    protocol::Writer operation(Operation type, const std::string& id) {
+        protocol::Writer command;
+        command.writeU8(static_cast<uint8_t>(type));
+        command.writeString(id);
+        return command;
+    }
+}
+
+ReplicatedTaskManager::ReplicatedTaskManager(size_t nTasks, size_t selfIndex, const std::vector<std::string>& members,
+                                             const std::string& dataDirectory, bool syncWrites)
+: m_taskManager(nTasks),
+  m_raft(selfIndex, members, dataDirectory, syncWrites,
+         [this](const std::vector<uint8_t>& command){ apply(command); },
+         [this](bool leading){ m_taskManager.setExecuting(leading); }) {
+    m_taskManager.setExecuting(false);
+    m_taskManager.setStatusListener([this](const std::string& id, MockTask::Status status) {
+        auto command = operation(Operation::Status, id);
+        command.writeU8(static_cast<uint8_t>(status));
+        // Lost if leadership moved meanwhile; the new leader reruns the task
+        m_raft.proposeIfLeader(command.buffer());
+    });
+    m_raft.start();
+}
+
+std::string ReplicatedTaskManager::executeCreateTask(const std::string& description, int duration) {
+    const auto id = utils::generateUUID();
+    auto command = operation(Operation::Create, id);
+    command.writeString(description);
+    command.writeI32(duration);
+    if(!m_raft.replicate(command.buffer(), commitTimeout)) {
+        std::cout << "Error: task creation didn't commit" << std::endl;
+        return "";
+    }
+    return id;
+}
+
+MockTaskView ReplicatedTaskManager::viewTask(const std::string& id) const {
+    return m_taskManager.viewTask(id);
+}
+
+std::vector<MockTaskView> ReplicatedTaskManager::viewAllTasks() const {
+    return m_taskManager.viewAllTasks();
+}
+
+bool ReplicatedTaskManager::cancelTask(const std::string& id) {
+    if(m_taskManager.viewTask(id).id.empty()) {
+        return false;
+    }
+    if(!m_raft.replicate(operation(Operation::Cancel, id).buffer(), commitTimeout)) {
+        std::cout << "Error: cancellation of task " << id << " didn't commit" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<MockTaskView> ReplicatedTaskManager::viewTasks(MockTask::Status status) const {
+    return m_taskManager.viewTasks(status);
+}
+
+TaskCounts ReplicatedTaskManager::countTasks() const {
+    return m_taskManager.countTasks();
+}
+
+void ReplicatedTaskManager::apply(const std::vector<uint8_t>& command) {
+    try {
+        protocol::Reader reader(command);
+        const auto type = static_cast<Operation>(reader.readU8());
+        const auto id = reader.readString();
+        switch(type) {
+            case Operation::Create: {
+                MockTaskView task;
+                task.id = id;
+                task.description = reader.readString();
+                task.duration = reader.readI32();
+                task.status = MockTask::statusToString(MockTask::Status::Waiting);
+                m_taskManager.submitTask(task);
+                break;
+            }
+            case Operation::Status: {
+                const auto status = reader.readU8();
+                if(status > MockTask::Status::Failed) {
+                    throw protocol::ProtocolError("unknown task status");
+                }
+                m_taskManager.setTaskStatus(id, static_cast<MockTask::Status>(status));
+                break;
+            }
+            case Operation::Cancel:
+                m_taskManager.cancelTask(id);
+                break;
+            default:
+                std::cout << "Error: unknown operation in the replicated log" << std::endl;
+        }
+    } catch(const protocol::ProtocolError& e) {
+        std::cout << "Error: malformed entry in the replicated log: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,32 @@
+/*
+    Binary protocol endpoint for clients, alongside the REST API
+*/
+
+#include "RpcServer.hpp"
+
+RpcServer::RpcServer(TaskBackend& backend, const std::string& listenAddress)
+: FrameServer(listenAddress), m_backend(backend) {}
+
+void RpcServer::handle(const protocol::Frame& request, protocol::Writer& response, const std::string&) {
+    protocol::Reader reader(request.payload);
+    switch(request.type) {
+        case protocol::MessageType::CreateTask: {
+            auto description = reader.readString();
+            auto duration = reader.readI32();
+            auto id = m_backend.executeCreateTask(description, duration);
+            response.writeView(id.empty() ? MockTaskView() : m_backend.viewTask(id));
+            break;
+        }
+        case protocol::MessageType::GetTask:
+            response.writeView(m_backend.viewTask(reader.readString()));
+            break;
+        case protocol::MessageType::ListTasks:
+            response.writeViews(m_backend.viewAllTasks());
+            break;
+        case protocol::MessageType::CancelTask:
+            response.writeU8(m_backend.cancelTask(reader.readString()));
+            break;
+        default:
+            throw protocol::ProtocolError("not a client operation");
+    }
+}
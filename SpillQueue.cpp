@@ -0,0 +1,358 @@
+/*
+    Waiting tasks moved out of memory, in queue order
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <stdexcept>
+
+#include "SpillQueue.hpp"
+
+namespace {
+    const size_t minCapacity = 1024;
+    const uint64_t segmentBytes = 64 << 20;
+    // Records buffered before a write
+    const size_t bufferBytes = 64 << 10;
+    // Bytes read at once when popping or listing, and hinted ahead after
+    const size_t chunkBytes = 256 << 10;
+    const size_t readaheadBytes = 4 << 20;
+
+    // Segments are numbered from 1, so no record is ever at these
+    const uint64_t emptyPosition = 0;
+    const uint64_t removedPosition = 1;
+    const int offsetBits = 40;
+
+    // A record is its description's size, its id's size and its duration,
+    // then the id and the description
+    const size_t headerBytes = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(int32_t);
+
+    uint64_t positionOf(uint64_t segment, uint64_t offset) {
+        return segment << offsetBits | offset;
+    }
+
+    uint64_t hashOf(const std::string& id) {
+        return std::hash<std::string>()(id);
+    }
+
+    bool readAt(int fd, uint8_t* data, size_t size, uint64_t offset) {
+        while(size > 0) {
+            auto read = ::pread(fd, data, size, offset);
+            if(read <= 0) {
+                return false;
+            }
+            data += read;
+            size -= read;
+            offset += read;
+        }
+        return true;
+    }
+
+    void writeAt(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+        while(size > 0) {
+            auto written = ::pwrite(fd, data, size, offset);
+            if(written < 0) {
+                throw std::runtime_error("Spilled task write failed");
+            }
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+}
+
+SpillQueue::SpillQueue(const std::string& path)
+: m_path(path), m_nextSegment(1), m_readOffset(0), m_slots(minCapacity, Slot{0, emptyPosition}), m_size(0),
+  m_removedSlots(0) {
+    const auto directory = std::filesystem::path(m_path).parent_path();
+    const auto prefix = std::filesystem::path(m_path).filename().string() + ".";
+    for(const auto& entry : std::filesystem::directory_iterator(directory.empty() ? "." : directory)) {
+        const auto name = entry.path().filename().string();
+        const auto suffix = name.substr(std::min(name.size(), prefix.size()));
+        if(name.compare(0, prefix.size(), prefix) == 0 && !suffix.empty()
+           && std::all_of(suffix.begin(), suffix.end(), [](char c){ return c >= '0' && c <= '9'; })) {
+            std::filesystem::remove(entry.path());
+        }
+    }
+}
+
+SpillQueue::~SpillQueue() {
+    for(const auto& segment : m_segments) {
+        ::close(segment.fd);
+        std::filesystem::remove(segmentPath(segment.number));
+    }
+}
+
+std::string SpillQueue::segmentPath(uint64_t number) const {
+    return m_path + "." + std::to_string(number);
+}
+
+void SpillQueue::openSegment() {
+    const auto path = segmentPath(m_nextSegment);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Can't open spill segment " + path);
+    }
+    m_segments.push_back({m_nextSegment++, fd, 0});
+}
+
+void SpillQueue::flush() {
+    if(m_buffer.empty()) {
+        return;
+    }
+    auto& segment = m_segments.back();
+    writeAt(segment.fd, m_buffer.data(), m_buffer.size(), segment.size - m_buffer.size());
+    m_buffer.clear();
+}
+
+void SpillQueue::push(const MockTaskView& task) {
+    if(task.id.size() > UINT16_MAX) {
+        throw std::invalid_argument("Task id too long to spill: " + task.id);
+    }
+    if(m_segments.empty() || m_segments.back().size >= segmentBytes) {
+        flush();
+        openSegment();
+    }
+    const auto& description = task.description.str();
+    const uint32_t descriptionSize = description.size();
+    const uint16_t idSize = task.id.size();
+    const int32_t duration = task.duration;
+    const auto start = m_buffer.size();
+    m_buffer.resize(start + headerBytes + idSize + descriptionSize);
+    auto* out = m_buffer.data() + start;
+    std::memcpy(out, &descriptionSize, sizeof(descriptionSize));
+    std::memcpy(out + sizeof(descriptionSize), &idSize, sizeof(idSize));
+    std::memcpy(out + sizeof(descriptionSize) + sizeof(idSize), &duration, sizeof(duration));
+    std::memcpy(out + headerBytes, task.id.data(), idSize);
+    std::memcpy(out + headerBytes + idSize, description.data(), descriptionSize);
+
+    auto& segment = m_segments.back();
+    index(hashOf(task.id), positionOf(segment.number, segment.size));
+    segment.size += m_buffer.size() - start;
+    if(m_buffer.size() >= bufferBytes) {
+        flush();
+    }
+}
+
+size_t SpillQueue::parse(const uint8_t* data, size_t size, MockTaskView& task) const {
+    if(size < headerBytes) {
+        return 0;
+    }
+    uint32_t descriptionSize;
+    uint16_t idSize;
+    int32_t duration;
+    std::memcpy(&descriptionSize, data, sizeof(descriptionSize));
+    std::memcpy(&idSize, data + sizeof(descriptionSize), sizeof(idSize));
+    std::memcpy(&duration, data + sizeof(descriptionSize) + sizeof(idSize), sizeof(duration));
+    const size_t recordSize = headerBytes + idSize + descriptionSize;
+    if(size < recordSize) {
+        return 0;
+    }
+    task.id.assign(reinterpret_cast<const char*>(data + headerBytes), idSize);
+    task.description = std::string(reinterpret_cast<const char*>(data + headerBytes + idSize), descriptionSize);
+    task.duration = duration;
+    task.status = MockTask::statusToString(MockTask::Status::Waiting);
+    return recordSize;
+}
+
+MockTaskView SpillQueue::read(uint64_t position) {
+    const auto number = position >> offsetBits;
+    const auto offset = position & ((uint64_t(1) << offsetBits) - 1);
+    const auto& segment = m_segments[number - m_segments.front().number];
+    if(&segment == &m_segments.back()) {
+        flush();
+    }
+    uint8_t header[headerBytes];
+    uint32_t descriptionSize;
+    uint16_t idSize;
+    std::vector<uint8_t> record;
+    if(readAt(segment.fd, header, headerBytes, offset)) {
+        std::memcpy(&descriptionSize, header, sizeof(descriptionSize));
+        std::memcpy(&idSize, header + sizeof(descriptionSize), sizeof(idSize));
+        record.resize(headerBytes + idSize + descriptionSize);
+    }
+    MockTaskView task;
+    if(record.empty() || !readAt(segment.fd, record.data(), record.size(), offset)
+       || parse(record.data(), record.size(), task) == 0) {
+        throw std::runtime_error("Can't read a spilled task from " + segmentPath(number));
+    }
+    return task;
+}
+
+size_t SpillQueue::probe(uint64_t hash, uint64_t position) const {
+    const auto mask = m_slots.size() - 1;
+    for(auto i = hash & mask;; i = (i + 1) & mask) {
+        const auto& slot = m_slots[i];
+        if(slot.position == emptyPosition || slot.position == position) {
+            return i;
+        }
+    }
+}
+
+std::optional<size_t> SpillQueue::findSlot(const std::string& id) {
+    const auto hash = hashOf(id);
+    const auto mask = m_slots.size() - 1;
+    for(auto i = hash & mask;; i = (i + 1) & mask) {
+        const auto& slot = m_slots[i];
+        if(slot.position == emptyPosition) {
+            return std::nullopt;
+        }
+        // Only another id with the same hash costs a read
+        if(slot.position != removedPosition && slot.hash == hash && read(slot.position).id == id) {
+            return i;
+        }
+    }
+}
+
+void SpillQueue::index(uint64_t hash, uint64_t position) {
+    // At most half full, counting removed slots, as in TaskIndex
+    if(2 * (m_size + m_removedSlots + 1) > m_slots.size()) {
+        rehash(4 * (m_size + 1) > m_slots.size() ? 2 * m_slots.size() : m_slots.size());
+    }
+    m_slots[probe(hash, position)] = {hash, position};
+    ++m_size;
+}
+
+void SpillQueue::unindex(size_t slot) {
+    m_slots[slot].position = removedPosition;
+    ++m_removedSlots;
+    --m_size;
+}
+
+void SpillQueue::rehash(size_t capacity) {
+    std::vector<Slot> slots(capacity, Slot{0, emptyPosition});
+    std::swap(slots, m_slots);
+    for(const auto& slot : slots) {
+        if(slot.position != emptyPosition && slot.position != removedPosition) {
+            m_slots[probe(slot.hash, slot.position)] = slot;
+        }
+    }
+    m_removedSlots = 0;
+}
+
+std::vector<MockTaskView> SpillQueue::pop(size_t maxTasks) {
+    std::vector<MockTaskView> tasks;
+    std::vector<uint8_t> chunk;
+    while(tasks.size() < maxTasks && m_size > 0) {
+        auto& segment = m_segments.front();
+        if(m_readOffset == segment.size) {
+            // Read past, and not the last segment since tasks are left
+            ::close(segment.fd);
+            std::filesystem::remove(segmentPath(segment.number));
+            m_segments.pop_front();
+            m_readOffset = 0;
+            continue;
+        }
+        if(&segment == &m_segments.back()) {
+            flush();
+        }
+        chunk.resize(std::min<uint64_t>(std::max(chunkBytes, chunk.size()), segment.size - m_readOffset));
+        if(!readAt(segment.fd, chunk.data(), chunk.size(), m_readOffset)) {
+            throw std::runtime_error("Can't read spilled tasks from " + segmentPath(segment.number));
+        }
+        size_t used = 0;
+        MockTaskView task;
+        while(tasks.size() < maxTasks) {
+            const auto recordSize = parse(chunk.data() + used, chunk.size() - used, task);
+            if(recordSize == 0) {
+                break;
+            }
+            // Unless it was removed meanwhile
+            const auto position = positionOf(segment.number, m_readOffset + used);
+            const auto slot = probe(hashOf(task.id), position);
+            if(m_slots[slot].position == position) {
+                unindex(slot);
+                tasks.push_back(std::move(task));
+            }
+            used += recordSize;
+        }
+        if(used == 0) {
+            // A record longer than a chunk: read it whole next time round
+            uint32_t descriptionSize;
+            uint16_t idSize;
+            std::memcpy(&descriptionSize, chunk.data(), sizeof(descriptionSize));
+            std::memcpy(&idSize, chunk.data() + sizeof(descriptionSize), sizeof(idSize));
+            chunk.resize(headerBytes + idSize + descriptionSize);
+            continue;
+        }
+        m_readOffset += used;
+    }
+    if(m_size == 0) {
+        reset();
+    } else if(!m_segments.empty()) {
+        ::posix_fadvise(m_segments.front().fd, m_readOffset, readaheadBytes, POSIX_FADV_WILLNEED);
+    }
+    return tasks;
+}
+
+std::optional<MockTaskView> SpillQueue::find(const std::string& id) {
+    auto slot = findSlot(id);
+    if(!slot) {
+        return std::nullopt;
+    }
+    return read(m_slots[*slot].position);
+}
+
+std::optional<MockTaskView> SpillQueue::remove(const std::string& id) {
+    auto slot = findSlot(id);
+    if(!slot) {
+        return std::nullopt;
+    }
+    auto task = read(m_slots[*slot].position);
+    unindex(*slot);
+    if(m_size == 0) {
+        reset();
+    }
+    return task;
+}
+
+std::vector<MockTaskView> SpillQueue::view() {
+    std::vector<MockTaskView> tasks;
+    tasks.reserve(m_size);
+    flush();
+    std::vector<uint8_t> bytes;
+    for(const auto& segment : m_segments) {
+        uint64_t offset = &segment == &m_segments.front() ? m_readOffset : 0;
+        while(offset < segment.size) {
+            // Each segment is read whole, a few hundred thousand tasks at most
+            bytes.resize(segment.size - offset);
+            if(!readAt(segment.fd, bytes.data(), bytes.size(), offset)) {
+                throw std::runtime_error("Can't read spilled tasks from " + segmentPath(segment.number));
+            }
+            size_t used = 0;
+            MockTaskView task;
+            while(const auto recordSize = parse(bytes.data() + used, bytes.size() - used, task)) {
+                const auto position = positionOf(segment.number, offset + used);
+                if(m_slots[probe(hashOf(task.id), position)].position == position) {
+                    tasks.push_back(std::move(task));
+                }
+                used += recordSize;
+            }
+            offset += used;
+            if(used == 0) {
+                throw std::runtime_error("Corrupt spill segment " + segmentPath(segment.number));
+            }
+        }
+    }
+    return tasks;
+}
+
+size_t SpillQueue::size() const {
+    return m_size;
+}
+
+void SpillQueue::reset() {
+    for(const auto& segment : m_segments) {
+        ::close(segment.fd);
+        std::filesystem::remove(segmentPath(segment.number));
+    }
+    m_segments.clear();
+    m_buffer.clear();
+    m_readOffset = 0;
+    m_slots.assign(minCapacity, Slot{0, emptyPosition});
+    m_removedSlots = 0;
+}
@@ -0,0 +1,490 @@
+/*
+    Compressed file of the finished tasks evicted from a registry
+*/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include "TaskArchive.hpp"
+#include "Utils.hpp"
+
+namespace {
+    const char archiveMagic[8] = {'T', 'A', 'S', 'K', 'A', 'R', 'C', '1'};
+    const size_t statusCount = MockTask::Status::Failed + 1;
+
+    // Precedes a block's id hashes, which precede its columns
+    struct BlockHeader {
+        uint32_t tasks;
+        uint32_t size;
+        // Of the hashes and columns
+        uint32_t checksum;
+        uint32_t reserved;
+        int64_t minFinishedAt;
+        int64_t maxFinishedAt;
+    };
+
+    // Order of the columns in a block, each its compressed size, its size,
+    // then its compressed bytes
+    enum Column {
+        FinishedAtColumn,
+        StatusColumn,
+        DurationColumn,
+        DescriptionColumn,
+        IdColumn,
+        columnCount
+    };
+
+    bool readAt(int fd, uint8_t* data, size_t size, uint64_t offset) {
+        while(size > 0) {
+            auto read = ::pread(fd, data, size, offset);
+            if(read <= 0) {
+                return false;
+            }
+            data += read;
+            size -= read;
+            offset += read;
+        }
+        return true;
+    }
+
+    void writeAt(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+        while(size > 0) {
+            auto written = ::pwrite(fd, data, size, offset);
+            if(written < 0) {
+                throw std::runtime_error("Task archive write failed");
+            }
+            data += written;
+            size -= written;
+            offset += written;
+        }
+    }
+
+    class ColumnWriter {
+    public:
+        template<typename T>
+        void put(T value) {
+            putArray(&value, 1);
+        }
+
+        template<typename T>
+        void putArray(const T* values, size_t count) {
+            const auto* data = reinterpret_cast<const uint8_t*>(values);
+            m_bytes.insert(m_bytes.end(), data, data + count * sizeof(T));
+        }
+
+        void putVarint(uint64_t value) {
+            while(value >= 0x80) {
+                m_bytes.push_back(static_cast<uint8_t>(value) | 0x80);
+                value >>= 7;
+            }
+            m_bytes.push_back(static_cast<uint8_t>(value));
+        }
+
+        void putString(const std::string& value) {
+            putVarint(value.size());
+            m_bytes.insert(m_bytes.end(), value.begin(), value.end());
+        }
+
+        // Appends the column to a block, compressed
+        void compressInto(std::vector<uint8_t>& block) const {
+            uLongf compressedSize = ::compressBound(m_bytes.size());
+            std::vector<uint8_t> compressed(compressedSize);
+            if(::compress(compressed.data(), &compressedSize, m_bytes.data(), m_bytes.size()) != Z_OK) {
+                throw std::runtime_error("Task archive compression failed");
+            }
+            const uint32_t sizes[2] = {static_cast<uint32_t>(compressedSize), static_cast<uint32_t>(m_bytes.size())};
+            const auto* header = reinterpret_cast<const uint8_t*>(sizes);
+            block.insert(block.end(), header, header + sizeof(sizes));
+            block.insert(block.end(), compressed.begin(), compressed.begin() + compressedSize);
+        }
+    private:
+        std::vector<uint8_t> m_bytes;
+    };
+
+    class ColumnReader {
+    public:
+        ColumnReader(std::vector<uint8_t> bytes) : m_bytes(std::move(bytes)), m_offset(0) {}
+
+        template<typename T>
+        T get() {
+            T value;
+            getArray(&value, 1);
+            return value;
+        }
+
+        template<typename T>
+        void getArray(T* values, size_t count) {
+            require(count * sizeof(T));
+            std::memcpy(values, m_bytes.data() + m_offset, count * sizeof(T));
+            m_offset += count * sizeof(T);
+        }
+
+        uint64_t getVarint() {
+            uint64_t value = 0;
+            for(int shift = 0; shift < 64; shift += 7) {
+                require(1);
+                const auto byte = m_bytes[m_offset++];
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if(byte < 0x80) {
+                    return value;
+                }
+            }
+            throw std::runtime_error("Corrupt task archive column");
+        }
+
+        std::string getString() {
+            const auto size = getVarint();
+            require(size);
+            std::string value(reinterpret_cast<const char*>(m_bytes.data()) + m_offset, size);
+            m_offset += size;
+            return value;
+        }
+    private:
+        void require(size_t size) const {
+            if(m_bytes.size() - m_offset < size) {
+                throw std::runtime_error("Corrupt task archive column");
+            }
+        }
+
+        std::vector<uint8_t> m_bytes;
+        size_t m_offset;
+    };
+
+    uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+}
+
+struct TaskArchive::Columns {
+    std::vector<int64_t> finishedAt;
+    std::vector<uint8_t> statuses;
+    std::vector<int32_t> durations;
+    // The distinct descriptions, and which one each task has
+    std::vector<std::string> dictionary;
+    std::vector<uint32_t> descriptions;
+    std::vector<std::string> ids;
+};
+
+void TaskStats::add(const TaskStats& other) {
+    tasks += other.tasks;
+    for(size_t i = 0; i < statusCount; ++i) {
+        statuses[i] += other.statuses[i];
+    }
+    durationSum += other.durationSum;
+    durationMin = std::min(durationMin, other.durationMin);
+    durationMax = std::max(durationMax, other.durationMax);
+}
+
+TaskArchive::TaskArchive(const std::string& path) : m_path(path), m_end(sizeof(archiveMagic)), m_tasks(0) {
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(m_fd < 0) {
+        throw std::runtime_error("Can't open task archive " + path);
+    }
+    struct stat status;
+    ::fstat(m_fd, &status);
+    const uint64_t fileSize = status.st_size;
+    char magic[sizeof(archiveMagic)];
+    if(fileSize < sizeof(magic)) {
+        writeAt(m_fd, reinterpret_cast<const uint8_t*>(archiveMagic), sizeof(archiveMagic), 0);
+    } else if(!readAt(m_fd, reinterpret_cast<uint8_t*>(magic), sizeof(magic), 0)
+              || std::memcmp(magic, archiveMagic, sizeof(magic)) != 0) {
+        ::close(m_fd);
+        throw std::runtime_error(path + " is not a task archive");
+    }
+
+    BlockHeader header;
+    while(fileSize > m_end && fileSize - m_end >= sizeof(header)
+          && readAt(m_fd, reinterpret_cast<uint8_t*>(&header), sizeof(header), m_end)) {
+        const uint64_t hashBytes = uint64_t(header.tasks) * sizeof(uint64_t);
+        const auto hashOffset = m_end + sizeof(header);
+        if(fileSize - hashOffset < hashBytes + header.size) {
+            break;
+        }
+
+        Block block{hashOffset + hashBytes, header.size, header.tasks, header.minFinishedAt, header.maxFinishedAt,
+                    std::vector<uint64_t>(header.tasks)};
+        const auto end = block.offset + block.size;
+        std::vector<uint8_t> body;
+        if(fileSize - end < sizeof(header)) {
+            // Only the last block can be torn, so only its checksum is worth
+            // reading the columns for
+            body.resize(hashBytes + block.size);
+            if(!readAt(m_fd, body.data(), body.size(), hashOffset) || ::crc32(0, body.data(), body.size()) != header.checksum) {
+                break;
+            }
+            std::memcpy(block.hashes.data(), body.data(), hashBytes);
+        } else if(!readAt(m_fd, reinterpret_cast<uint8_t*>(block.hashes.data()), hashBytes, hashOffset)) {
+            break;
+        }
+        m_blocks.push_back(std::move(block));
+        m_tasks += header.tasks;
+        m_end = end;
+    }
+    if(m_end < fileSize) {
+        std::cout << "Error: dropping " << fileSize - m_end << " torn bytes at the end of " << path << std::endl;
+        if(::ftruncate(m_fd, m_end) != 0) {
+            throw std::runtime_error("Can't truncate task archive " + path);
+        }
+    }
+}
+
+TaskArchive::~TaskArchive() {
+    ::close(m_fd);
+}
+
+void TaskArchive::append(const std::vector<MockTaskView>& tasks, const std::vector<int64_t>& finishedAt) {
+    if(tasks.empty()) {
+        return;
+    }
+    BlockHeader header{static_cast<uint32_t>(tasks.size()), 0, 0, 0,
+                       *std::min_element(finishedAt.begin(), finishedAt.end()),
+                       *std::max_element(finishedAt.begin(), finishedAt.end())};
+
+    std::vector<ColumnWriter> columns(columnCount);
+    int64_t previous = header.minFinishedAt;
+    for(auto time : finishedAt) {
+        columns[FinishedAtColumn].putVarint(zigzag(time - previous));
+        previous = time;
+    }
+    // Descriptions are interned, so equal ones share an address
+    std::unordered_map<const std::string*, uint32_t> dictionary;
+    std::vector<const std::string*> descriptions;
+    std::vector<uint32_t> codes;
+    codes.reserve(tasks.size());
+    for(const auto& task : tasks) {
+        columns[StatusColumn].put(static_cast<uint8_t>(MockTask::statusFromString(task.status)));
+        columns[DurationColumn].put(static_cast<int32_t>(task.duration));
+        auto [entry, added] = dictionary.emplace(&task.description.str(), dictionary.size());
+        if(added) {
+            descriptions.push_back(entry->first);
+        }
+        codes.push_back(entry->second);
+        columns[IdColumn].putString(task.id);
+    }
+    columns[DescriptionColumn].putVarint(descriptions.size());
+    for(const auto* description : descriptions) {
+        columns[DescriptionColumn].putString(*description);
+    }
+    columns[DescriptionColumn].putArray(codes.data(), codes.size());
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(tasks.size());
+    for(const auto& task : tasks) {
+        hashes.push_back(utils::stableHash(task.id));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    std::vector<uint8_t> body(reinterpret_cast<const uint8_t*>(hashes.data()),
+                              reinterpret_cast<const uint8_t*>(hashes.data() + hashes.size()));
+    for(const auto& column : columns) {
+        column.compressInto(body);
+    }
+    const auto hashBytes = hashes.size() * sizeof(uint64_t);
+    header.size = body.size() - hashBytes;
+    header.checksum = ::crc32(0, body.data(), body.size());
+
+    // Appends only come from one sweeper, so the file end needs no lock;
+    // lookups wait only for the block to be listed
+    writeAt(m_fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header), m_end);
+    writeAt(m_fd, body.data(), body.size(), m_end + sizeof(header));
+    // Left unlisted, the block is written over by the sweeper's retry, so
+    // pages a failed flush dropped are written again rather than trusted
+    if(::fdatasync(m_fd) != 0) {
+        throw std::runtime_error("Task archive flush failed");
+    }
+    Block block{m_end + sizeof(header) + hashBytes, header.size, header.tasks, header.minFinishedAt,
+                header.maxFinishedAt, std::move(hashes)};
+    const auto end = block.offset + block.size;
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_blocks.push_back(std::move(block));
+    m_tasks += tasks.size();
+    m_end = end;
+}
+
+TaskArchive::Columns TaskArchive::read(const Block& block, bool withIds) const {
+    std::vector<uint8_t> bytes(block.size);
+    if(!readAt(m_fd, bytes.data(), bytes.size(), block.offset)) {
+        throw std::runtime_error("Can't read a block of task archive " + m_path);
+    }
+
+    std::vector<ColumnReader> columns;
+    size_t offset = 0;
+    for(int column = 0; column < (withIds ? columnCount : IdColumn); ++column) {
+        uint32_t sizes[2];
+        if(bytes.size() - offset < sizeof(sizes)) {
+            throw std::runtime_error("Corrupt block in task archive " + m_path);
+        }
+        std::memcpy(sizes, bytes.data() + offset, sizeof(sizes));
+        offset += sizeof(sizes);
+        std::vector<uint8_t> raw(sizes[1]);
+        uLongf size = raw.size();
+        if(bytes.size() - offset < sizes[0]
+           || ::uncompress(raw.data(), &size, bytes.data() + offset, sizes[0]) != Z_OK || size != raw.size()) {
+            throw std::runtime_error("Corrupt block in task archive " + m_path);
+        }
+        offset += sizes[0];
+        columns.emplace_back(std::move(raw));
+    }
+
+    Columns decoded;
+    const auto tasks = block.tasks;
+    decoded.finishedAt.resize(tasks);
+    int64_t previous = block.minFinishedAt;
+    for(auto& time : decoded.finishedAt) {
+        time = previous + unzigzag(columns[FinishedAtColumn].getVarint());
+        previous = time;
+    }
+    decoded.statuses.resize(tasks);
+    columns[StatusColumn].getArray(decoded.statuses.data(), tasks);
+    decoded.durations.resize(tasks);
+    columns[DurationColumn].getArray(decoded.durations.data(), tasks);
+    decoded.dictionary.resize(columns[DescriptionColumn].getVarint());
+    for(auto& description : decoded.dictionary) {
+        description = columns[DescriptionColumn].getString();
+    }
+    decoded.descriptions.resize(tasks);
+    columns[DescriptionColumn].getArray(decoded.descriptions.data(), tasks);
+    for(auto code : decoded.descriptions) {
+        if(code >= decoded.dictionary.size()) {
+            throw std::runtime_error("Corrupt block in task archive " + m_path);
+        }
+    }
+    for(auto status : decoded.statuses) {
+        if(status >= statusCount) {
+            throw std::runtime_error("Corrupt block in task archive " + m_path);
+        }
+    }
+    if(withIds) {
+        decoded.ids.resize(tasks);
+        for(auto& id : decoded.ids) {
+            id = columns[IdColumn].getString();
+        }
+    }
+    return decoded;
+}
+
+std::optional<MockTaskView> TaskArchive::find(const std::string& id) const {
+    const auto hash = utils::stableHash(id);
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    for(auto block = m_blocks.rbegin(); block != m_blocks.rend(); ++block) {
+        if(!std::binary_search(block->hashes.begin(), block->hashes.end(), hash)) {
+            continue;
+        }
+        try {
+            auto columns = read(*block, true);
+            for(size_t i = 0; i < columns.ids.size(); ++i) {
+                if(columns.ids[i] == id) {
+                    return MockTaskView{id, columns.dictionary[columns.descriptions[i]], columns.durations[i],
+                                        MockTask::statusToString(static_cast<MockTask::Status>(columns.statuses[i]))};
+                }
+            }
+        } catch(const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+    return std::nullopt;
+}
+
+void TaskArchive::aggregateBlock(const Block& block, const ArchiveQuery& query, std::map<std::string, TaskStats>& groups) const {
+    if(block.maxFinishedAt < query.from || block.minFinishedAt >= query.to) {
+        return;
+    }
+    const auto columns = read(block, false);
+    const size_t tasks = block.tasks;
+    const size_t codes = columns.dictionary.size();
+
+    // The description filter, once per distinct description
+    std::vector<uint8_t> matches(codes);
+    for(size_t code = 0; code < codes; ++code) {
+        matches[code] = columns.dictionary[code].compare(0, query.prefix.size(), query.prefix) == 0;
+    }
+    std::vector<uint8_t> selected(tasks);
+    for(size_t i = 0; i < tasks; ++i) {
+        selected[i] = matches[columns.descriptions[i]];
+    }
+    if(block.minFinishedAt < query.from || block.maxFinishedAt >= query.to) {
+        const auto* finishedAt = columns.finishedAt.data();
+        for(size_t i = 0; i < tasks; ++i) {
+            selected[i] &= (finishedAt[i] >= query.from) & (finishedAt[i] < query.to);
+        }
+    }
+
+    // Accumulated by description code, then folded into groups
+    std::vector<TaskStats> byCode(codes);
+    for(size_t i = 0; i < tasks; ++i) {
+        if(!selected[i]) {
+            continue;
+        }
+        auto& stats = byCode[columns.descriptions[i]];
+        const auto duration = columns.durations[i];
+        ++stats.tasks;
+        ++stats.statuses[columns.statuses[i]];
+        stats.durationSum += duration;
+        stats.durationMin = std::min(stats.durationMin, duration);
+        stats.durationMax = std::max(stats.durationMax, duration);
+    }
+    for(size_t code = 0; code < codes; ++code) {
+        if(byCode[code].tasks > 0) {
+            const auto& description = columns.dictionary[code];
+            groups[query.groupLength == 0 ? std::string() : description.substr(0, query.groupLength)].add(byCode[code]);
+        }
+    }
+}
+
+std::map<std::string, TaskStats> TaskArchive::aggregate(const ArchiveQuery& query) const {
+    // Scanned without the lock, so appends aren't held up; blocks never change
+    // once listed
+    std::vector<Block> blocks;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        blocks.reserve(m_blocks.size());
+        for(const auto& block : m_blocks) {
+            blocks.push_back({block.offset, block.size, block.tasks, block.minFinishedAt, block.maxFinishedAt, {}});
+        }
+    }
+
+    const size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), blocks.size()));
+    std::vector<std::map<std::string, TaskStats>> partials(threadCount);
+    std::vector<std::thread> threads;
+    for(size_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([this, t, threadCount, &blocks, &query, &partials](){
+            for(size_t i = t; i < blocks.size(); i += threadCount) {
+                try {
+                    aggregateBlock(blocks[i], query, partials[t]);
+                } catch(const std::exception& e) {
+                    std::cout << "Error: " << e.what() << std::endl;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    auto groups = std::move(partials[0]);
+    for(size_t t = 1; t < threadCount; ++t) {
+        for(const auto& [key, stats] : partials[t]) {
+            groups[key].add(stats);
+        }
+    }
+    return groups;
+}
+
+size_t TaskArchive::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_tasks;
+}
@@ -0,0 +1,145 @@
+/*
+    A registry's tasks laid out by column, for scanning
+*/
+
+#include <algorithm>
+
+#include "TaskColumns.hpp"
+
+namespace {
+    const uint32_t rowsPerChunk = 1 << 14;
+    // Status byte of a row no task holds
+    const uint8_t freeRow = 0xff;
+}
+
+struct TaskColumns::Chunk {
+    Chunk() {
+        std::fill(std::begin(statuses), std::end(statuses), freeRow);
+        std::fill(std::begin(tasks), std::end(tasks), nullptr);
+    }
+
+    mutable std::shared_mutex mutex;
+    uint8_t statuses[rowsPerChunk];
+    const MockTask* tasks[rowsPerChunk];
+};
+
+TaskColumns::TaskColumns() : m_rows(0), m_live(0) {}
+
+TaskColumns::~TaskColumns() = default;
+
+uint32_t TaskColumns::add(const MockTask& task) {
+    uint32_t row;
+    Chunk* chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_freeRows.empty()) {
+            row = m_freeRows.back();
+            m_freeRows.pop_back();
+        } else {
+            row = m_rows++;
+            if(row / rowsPerChunk == m_chunks.size()) {
+                m_chunks.push_back(std::make_unique<Chunk>());
+            }
+        }
+        chunk = m_chunks[row / rowsPerChunk].get();
+        ++m_live;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(chunk->mutex);
+    const auto index = row % rowsPerChunk;
+    chunk->statuses[index] = task.getStatus();
+    chunk->tasks[index] = &task;
+    return row;
+}
+
+void TaskColumns::update(uint32_t row, const MockTask& task) {
+    Chunk* chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        chunk = m_chunks[row / rowsPerChunk].get();
+    }
+    std::unique_lock<std::shared_mutex> lock(chunk->mutex);
+    const auto index = row % rowsPerChunk;
+    if(chunk->tasks[index] == &task) {
+        chunk->statuses[index] = task.getStatus();
+    }
+}
+
+void TaskColumns::remove(uint32_t row, const MockTask& task) {
+    Chunk* chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        chunk = m_chunks[row / rowsPerChunk].get();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(chunk->mutex);
+        const auto index = row % rowsPerChunk;
+        if(chunk->tasks[index] != &task) {
+            return;
+        }
+        chunk->statuses[index] = freeRow;
+        chunk->tasks[index] = nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_freeRows.push_back(row);
+    --m_live;
+}
+
+TaskCounts TaskColumns::count() const {
+    std::vector<Chunk*> chunks;
+    uint32_t rows;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& chunk : m_chunks) {
+            chunks.push_back(chunk.get());
+        }
+        rows = m_rows;
+    }
+
+    TaskCounts counts = {};
+    for(size_t c = 0; c < chunks.size(); ++c) {
+        const auto end = std::min(rowsPerChunk, static_cast<uint32_t>(rows - c * rowsPerChunk));
+        std::shared_lock<std::shared_mutex> lock(chunks[c]->mutex);
+        const auto* statuses = chunks[c]->statuses;
+        // One pass per status, each a compare and add the compiler vectorizes
+        for(size_t status = 0; status < counts.size(); ++status) {
+            uint32_t matches = 0;
+            for(uint32_t i = 0; i < end; ++i) {
+                matches += statuses[i] == status;
+            }
+            counts[status] += matches;
+        }
+    }
+    return counts;
+}
+
+std::vector<MockTaskView> TaskColumns::view(std::optional<MockTask::Status> status) const {
+    std::vector<Chunk*> chunks;
+    uint32_t rows;
+    std::vector<MockTaskView> views;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& chunk : m_chunks) {
+            chunks.push_back(chunk.get());
+        }
+        rows = m_rows;
+        views.reserve(status ? 0 : m_live);
+    }
+
+    for(size_t c = 0; c < chunks.size(); ++c) {
+        const auto end = std::min(rowsPerChunk, static_cast<uint32_t>(rows - c * rowsPerChunk));
+        std::shared_lock<std::shared_mutex> lock(chunks[c]->mutex);
+        const auto* statuses = chunks[c]->statuses;
+        for(uint32_t i = 0; i < end; ++i) {
+            if(status ? statuses[i] == *status : statuses[i] != freeRow) {
+                views.push_back(chunks[c]->tasks[i]->getView());
+            }
+        }
+    }
+    return views;
+}
+
+size_t TaskColumns::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_live;
+}
@@ -0,0 +1,161 @@
+/*
+    Registered tasks by id, readable without a lock
+*/
+
+#include <functional>
+#include <new>
+#include <vector>
+
+#include "Epochs.hpp"
+#include "HugePages.hpp"
+#include "TaskIndex.hpp"
+
+namespace {
+    const size_t minCapacity = 64;
+
+    // Marks the slot of an erased entry, so probes for ids placed after it
+    // carry on
+    TaskIndex::Entry tombstoneEntry;
+    TaskIndex::Entry* const tombstone = &tombstoneEntry;
+
+    size_t hashOf(const std::string& id) {
+        return std::hash<std::string>()(id);
+    }
+}
+
+struct TaskIndex::Table {
+    // Large tables sit on huge pages, as every lookup lands somewhere random
+    // in them
+    explicit Table(size_t capacity)
+    : capacity(capacity),
+      slots(static_cast<std::atomic<Entry*>*>(HugePages::allocate(capacity * sizeof(std::atomic<Entry*>)))) {
+        for(size_t i = 0; i < capacity; ++i) {
+            new(&slots[i]) std::atomic<Entry*>(nullptr);
+        }
+    }
+
+    ~Table() {
+        HugePages::deallocate(slots, capacity * sizeof(std::atomic<Entry*>));
+    }
+
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    // A power of two
+    size_t capacity;
+    std::atomic<Entry*>* slots;
+};
+
+TaskIndex::TaskIndex() : m_table(new Table(minCapacity)), m_size(0), m_tombstones(0) {}
+
+TaskIndex::~TaskIndex() {
+    auto* table = m_table.load();
+    for(size_t i = 0; i < table->capacity; ++i) {
+        auto* entry = table->slots[i].load();
+        if(entry != nullptr && entry != tombstone) {
+            delete entry;
+        }
+    }
+    delete table;
+}
+
+size_t TaskIndex::probe(const Table& table, const std::string& id) const {
+    const auto mask = table.capacity - 1;
+    for(auto i = hashOf(id) & mask;; i = (i + 1) & mask) {
+        auto* entry = table.slots[i].load(std::memory_order_relaxed);
+        if(entry == nullptr || (entry != tombstone && entry->id == id)) {
+            return i;
+        }
+    }
+}
+
+const TaskIndex::Entry* TaskIndex::find(const std::string& id) const {
+    // The writer may change any slot meanwhile, so each is loaded once
+    const auto& table = *m_table.load(std::memory_order_acquire);
+    const auto mask = table.capacity - 1;
+    for(auto i = hashOf(id) & mask;; i = (i + 1) & mask) {
+        auto* entry = table.slots[i].load(std::memory_order_acquire);
+        if(entry == nullptr || (entry != tombstone && entry->id == id)) {
+            return entry;
+        }
+    }
+}
+
+void TaskIndex::insert(const std::string& id, TaskHandle handle, MockTask* task) {
+    // At most half full, counting tombstones, so probes stay short and end.
+    // Clearing the tombstones makes room unless live entries take a quarter.
+    const auto capacity = m_table.load()->capacity;
+    if(2 * (m_size + m_tombstones + 1) > capacity) {
+        rebuild(4 * (m_size + 1) > capacity ? 2 * capacity : capacity);
+    }
+    auto& table = *m_table.load();
+    auto* entry = new Entry{id, handle, task};
+    auto& slot = table.slots[probe(table, id)];
+    if(auto* replaced = slot.load()) {
+        slot.store(entry, std::memory_order_release);
+        Epochs::retire([replaced](){ delete replaced; });
+        return;
+    }
+    // Reuses the first tombstone on the way, if there is one
+    const auto mask = table.capacity - 1;
+    for(auto i = hashOf(id) & mask;; i = (i + 1) & mask) {
+        auto* current = table.slots[i].load();
+        if(current == nullptr || current == tombstone) {
+            if(current == tombstone) {
+                --m_tombstones;
+            }
+            table.slots[i].store(entry, std::memory_order_release);
+            break;
+        }
+    }
+    ++m_size;
+}
+
+void TaskIndex::erase(const std::string& id) {
+    auto& table = *m_table.load();
+    auto& slot = table.slots[probe(table, id)];
+    auto* erased = slot.load();
+    if(erased == nullptr) {
+        return;
+    }
+    slot.store(tombstone, std::memory_order_release);
+    Epochs::retire([erased](){ delete erased; });
+    --m_size;
+    ++m_tombstones;
+}
+
+void TaskIndex::reserve(size_t tasks) {
+    auto capacity = m_table.load()->capacity;
+    while(capacity < 2 * tasks) {
+        capacity *= 2;
+    }
+    if(capacity != m_table.load()->capacity) {
+        rebuild(capacity);
+    }
+}
+
+size_t TaskIndex::size() const {
+    return m_size;
+}
+
+void TaskIndex::rebuild(size_t capacity) {
+    auto* old = m_table.load();
+    auto* table = new Table(capacity);
+    const auto mask = capacity - 1;
+    for(size_t i = 0; i < old->capacity; ++i) {
+        auto* entry = old->slots[i].load();
+        if(entry == nullptr || entry == tombstone) {
+            continue;
+        }
+        auto j = hashOf(entry->id) & mask;
+        while(table->slots[j].load(std::memory_order_relaxed) != nullptr) {
+            j = (j + 1) & mask;
+        }
+        table->slots[j].store(entry, std::memory_order_relaxed);
+    }
+    m_table.store(table, std::memory_order_release);
+    m_tombstones = 0;
+    // Readers may still be probing the old table; the entries live on in the
+    // new one
+    Epochs::retire([old](){ delete old; });
+}
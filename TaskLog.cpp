@@ -0,0 +1,640 @@
+/*
+    Write-ahead log of the changes to a node's task registry
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Protocol.hpp"
+#include "TaskLog.hpp"
+
+namespace {
+    // A record on disk is its length, then the record
+    const size_t recordHeaderSize = 4;
+    // A snapshot starts with the last segment it covers, then holds chunks of
+    // tasks: their count, then their length
+    const size_t snapshotHeaderSize = 8;
+    const size_t chunkHeaderSize = 8;
+    const size_t tasksPerChunk = 1 << 16;
+    // A segment this large is finished and folded into the snapshot
+    const uint64_t maxSegmentBytes = 64ull << 20;
+    // Records decoded as one piece of work by a replay
+    const size_t recordsPerPiece = 1 << 16;
+    const auto compactionRetryDelay = std::chrono::seconds(5);
+
+    enum class RecordKind : uint8_t {
+        Create = 1,
+        Status,
+        Cancel,
+        Remove
+    };
+
+    // A decoded record. Snapshot entries decode as creations, and a task
+    // replayed so far is its creation with the later records applied.
+    struct Record {
+        RecordKind kind;
+        // Position in the whole history, to restore creation order
+        uint64_t order;
+        std::string id;
+        std::string description;
+        int32_t duration = 0;
+        MockTask::Status status = MockTask::Status::Waiting;
+        bool cancelled = false;
+    };
+
+    // A run of records in a file, decoded in one go
+    struct Piece {
+        size_t file;
+        size_t begin;
+        size_t end;
+        uint64_t firstOrder;
+    };
+
+    struct LogFile {
+        std::vector<uint8_t> bytes;
+        bool snapshot;
+    };
+
+    void writeAll(int fd, const uint8_t* data, size_t size) {
+        while(size > 0) {
+            auto written = ::write(fd, data, size);
+            if(written < 0) {
+                throw std::runtime_error("Task log write failed");
+            }
+            data += written;
+            size -= written;
+        }
+    }
+
+    void syncDirectory(const std::string& path) {
+        auto directory = std::filesystem::path(path).parent_path();
+        int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if(fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    std::vector<uint8_t> readFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        std::vector<uint8_t> bytes(file ? static_cast<size_t>(file.tellg()) : 0);
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        bytes.resize(file ? bytes.size() : static_cast<size_t>(file.gcount()));
+        return bytes;
+    }
+
+    uint32_t peekU32(const std::vector<uint8_t>& bytes, size_t offset) {
+        uint32_t value = 0;
+        for(int shift = 0; shift < 32; shift += 8) {
+            value |= static_cast<uint32_t>(bytes[offset++]) << shift;
+        }
+        return value;
+    }
+
+    // Cuts a snapshot into its chunks
+    void cutSnapshot(const LogFile& file, size_t index, std::vector<Piece>& pieces, uint64_t& nextOrder) {
+        for(size_t offset = snapshotHeaderSize; file.bytes.size() - offset >= chunkHeaderSize;) {
+            const auto count = peekU32(file.bytes, offset);
+            const auto size = peekU32(file.bytes, offset + 4);
+            offset += chunkHeaderSize;
+            if(file.bytes.size() - offset < size) {
+                throw std::runtime_error("Truncated task log snapshot");
+            }
+            pieces.push_back({index, offset, offset + size, nextOrder});
+            offset += size;
+            nextOrder += count;
+        }
+    }
+
+    // Cuts a segment into runs of records, and drops a torn record at its end
+    void cutSegment(const std::string& path, const LogFile& file, size_t index, std::vector<Piece>& pieces, uint64_t& nextOrder) {
+        size_t offset = 0;
+        size_t pieceStart = 0;
+        size_t records = 0;
+        while(file.bytes.size() - offset >= recordHeaderSize) {
+            const auto size = peekU32(file.bytes, offset);
+            if(file.bytes.size() - offset - recordHeaderSize < size) {
+                break;
+            }
+            offset += recordHeaderSize + size;
+            if(++records == recordsPerPiece) {
+                pieces.push_back({index, pieceStart, offset, nextOrder});
+                nextOrder += records;
+                pieceStart = offset;
+                records = 0;
+            }
+        }
+        if(records > 0) {
+            pieces.push_back({index, pieceStart, offset, nextOrder});
+            nextOrder += records;
+        }
+        if(offset != file.bytes.size()) {
+            // A crash can leave a torn record at the end, which was never committed
+            std::cout << "Dropping a torn record at the end of " << path << std::endl;
+            ::truncate(path.c_str(), offset);
+        }
+    }
+
+    std::vector<Record> decode(const LogFile& file, const Piece& piece) {
+        std::vector<Record> records;
+        protocol::Reader reader(file.bytes, piece.begin);
+        for(auto order = piece.firstOrder; reader.getOffset() < piece.end; ++order) {
+            Record record;
+            record.order = order;
+            if(file.snapshot) {
+                record.kind = RecordKind::Create;
+                record.id = reader.readString();
+                record.description = reader.readString();
+                record.duration = reader.readI32();
+                record.status = static_cast<MockTask::Status>(reader.readU8());
+                record.cancelled = reader.readU8() != 0;
+            } else {
+                // The length was checked when the segment was cut
+                reader.readU32();
+                record.kind = static_cast<RecordKind>(reader.readU8());
+                record.id = reader.readString();
+                if(record.kind == RecordKind::Create) {
+                    record.description = reader.readString();
+                    record.duration = reader.readI32();
+                    record.status = static_cast<MockTask::Status>(reader.readU8());
+                } else if(record.kind == RecordKind::Status) {
+                    record.status = static_cast<MockTask::Status>(reader.readU8());
+                }
+            }
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    size_t shardOf(const std::string& id, size_t shards) {
+        return std::hash<std::string>()(id) % shards;
+    }
+
+    void apply(std::unordered_map<std::string, Record>& tasks, Record&& record) {
+        if(record.kind == RecordKind::Create) {
+            // Also a task handed away earlier and back again
+            auto id = record.id;
+            tasks.insert_or_assign(std::move(id), std::move(record));
+            return;
+        }
+        auto it = tasks.find(record.id);
+        if(it == tasks.end()) {
+            return;
+        }
+        if(record.kind == RecordKind::Status) {
+            if(!MockTask::isFinal(it->second.status)) {
+                it->second.status = record.status;
+            }
+        } else if(record.kind == RecordKind::Cancel) {
+            it->second.cancelled = true;
+        } else if(record.kind == RecordKind::Remove) {
+            tasks.erase(it);
+        }
+    }
+
+    bool byOrder(const Record& a, const Record& b) {
+        return a.order < b.order;
+    }
+
+    // Runs work(i) for every i below count on up to threads threads
+    void parallelFor(size_t count, size_t threads, const std::function<void(size_t)>& work) {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+        for(size_t t = 0; t < std::min(threads, count); ++t) {
+            pool.emplace_back([&next, count, &work](){
+                for(size_t i = next++; i < count; i = next++) {
+                    work(i);
+                }
+            });
+        }
+        for(auto& thread : pool) {
+            thread.join();
+        }
+    }
+
+    // The tasks as the files leave them, read in order, sorted by creation.
+    //
+    // A snapshot holds every task once, already in creation order, so only
+    // the tasks that later segments mention are looked up by id. Pieces are
+    // decoded in parallel, then the segments' records are replayed on one
+    // thread per shard of task ids, so every task sees its records in order.
+    std::vector<Record> replay(const std::vector<LogFile>& files, const std::vector<Piece>& pieces, size_t threads) {
+        const auto shardCount = std::max<size_t>(1, threads);
+        size_t snapshotPieces = 0;
+        while(snapshotPieces < pieces.size() && files[pieces[snapshotPieces].file].snapshot) {
+            ++snapshotPieces;
+        }
+
+        std::vector<std::vector<Record>> snapshot(snapshotPieces);
+        // Records of each segment piece, by shard
+        std::vector<std::vector<std::vector<Record>>> logged(pieces.size() - snapshotPieces,
+                                                             std::vector<std::vector<Record>>(shardCount));
+        parallelFor(pieces.size(), threads, [&](size_t i){
+            auto records = decode(files[pieces[i].file], pieces[i]);
+            if(i < snapshotPieces) {
+                snapshot[i] = std::move(records);
+                return;
+            }
+            auto& shards = logged[i - snapshotPieces];
+            for(auto& record : records) {
+                shards[shardOf(record.id, shardCount)].push_back(std::move(record));
+            }
+        });
+
+        std::vector<std::unordered_set<std::string>> mentioned(shardCount);
+        parallelFor(shardCount, threads, [&](size_t shard){
+            for(const auto& piece : logged) {
+                for(const auto& record : piece[shard]) {
+                    mentioned[shard].insert(record.id);
+                }
+            }
+        });
+
+        // Snapshot tasks that the segments change, by piece and shard. What
+        // is taken out is left behind marked as removed.
+        std::vector<std::vector<std::vector<Record>>> taken(snapshotPieces, std::vector<std::vector<Record>>(shardCount));
+        parallelFor(snapshotPieces, threads, [&](size_t i){
+            for(auto& task : snapshot[i]) {
+                const auto shard = shardOf(task.id, shardCount);
+                if(mentioned[shard].count(task.id) > 0) {
+                    taken[i][shard].push_back(std::move(task));
+                    task.kind = RecordKind::Remove;
+                }
+            }
+        });
+
+        std::vector<std::vector<Record>> changed(shardCount);
+        parallelFor(shardCount, threads, [&](size_t shard){
+            std::unordered_map<std::string, Record> tasks;
+            for(auto& piece : taken) {
+                for(auto& task : piece[shard]) {
+                    apply(tasks, std::move(task));
+                }
+            }
+            for(auto& piece : logged) {
+                for(auto& record : piece[shard]) {
+                    apply(tasks, std::move(record));
+                }
+                std::vector<Record>().swap(piece[shard]);
+            }
+            auto& sorted = changed[shard];
+            sorted.reserve(tasks.size());
+            for(auto& [id, task] : tasks) {
+                sorted.push_back(std::move(task));
+            }
+            std::sort(sorted.begin(), sorted.end(), byOrder);
+        });
+
+        std::vector<Record> tasks;
+        for(auto& piece : snapshot) {
+            for(auto& task : piece) {
+                if(task.kind == RecordKind::Create) {
+                    tasks.push_back(std::move(task));
+                }
+            }
+            std::vector<Record>().swap(piece);
+        }
+        for(auto& shard : changed) {
+            auto middle = tasks.size();
+            tasks.insert(tasks.end(), std::make_move_iterator(shard.begin()), std::make_move_iterator(shard.end()));
+            std::vector<Record>().swap(shard);
+            std::inplace_merge(tasks.begin(), tasks.begin() + middle, tasks.end(), byOrder);
+        }
+        return tasks;
+    }
+
+    size_t replayThreads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+std::optional<Durability> durabilityFromString(const std::string& durability) {
+    if(durability == "none") {
+        return Durability::None;
+    }
+    if(durability == "batch") {
+        return Durability::Batch;
+    }
+    if(durability == "every-op") {
+        return Durability::EveryOp;
+    }
+    return std::nullopt;
+}
+
+TaskLog::TaskLog(const std::string& path, Durability durability, std::chrono::milliseconds syncInterval)
+: m_path(path), m_durability(durability), m_syncInterval(syncInterval), m_fd(-1), m_segment(0), m_segmentBytes(0),
+  m_snapshotSegment(0), m_written(0), m_synced(0), m_failed(false), m_stopping(false) {
+    load();
+    openSegment(m_segment + 1);
+    if(m_durability != Durability::None) {
+        m_flusher = std::thread(&TaskLog::runFlusher, this);
+    }
+    m_compactor = std::thread(&TaskLog::runCompactor, this);
+}
+
+TaskLog::~TaskLog() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_appended.notify_all();
+    m_sealed.notify_all();
+    if(m_flusher.joinable()) {
+        m_flusher.join();
+    }
+    if(m_compactor.joinable()) {
+        m_compactor.join();
+    }
+    if(m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+std::string TaskLog::segmentPath(uint64_t segment) const {
+    return m_path + "." + std::to_string(segment);
+}
+
+std::string TaskLog::snapshotPath() const {
+    return m_path + ".snapshot";
+}
+
+void TaskLog::load() {
+    std::vector<LogFile> files;
+    std::vector<Piece> pieces;
+    uint64_t nextOrder = 0;
+    if(std::filesystem::exists(snapshotPath())) {
+        files.push_back({readFile(snapshotPath()), true});
+        protocol::Reader header(files.back().bytes);
+        m_snapshotSegment = header.readU64();
+        cutSnapshot(files.back(), 0, pieces, nextOrder);
+    }
+
+    std::vector<uint64_t> segments;
+    const auto directory = std::filesystem::path(m_path).parent_path();
+    const auto prefix = std::filesystem::path(m_path).filename().string() + ".";
+    for(const auto& entry : std::filesystem::directory_iterator(directory.empty() ? "." : directory)) {
+        const auto name = entry.path().filename().string();
+        const auto suffix = name.substr(std::min(name.size(), prefix.size()));
+        if(name.compare(0, prefix.size(), prefix) == 0 && !suffix.empty()
+           && std::all_of(suffix.begin(), suffix.end(), [](char c){ return c >= '0' && c <= '9'; })) {
+            segments.push_back(std::stoull(suffix));
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    for(auto segment : segments) {
+        if(segment <= m_snapshotSegment) {
+            // Folded in by a compaction that stopped before deleting it
+            std::filesystem::remove(segmentPath(segment));
+            continue;
+        }
+        auto bytes = readFile(segmentPath(segment));
+        if(bytes.empty()) {
+            // Started by a run that logged nothing, so no need to compact it
+            std::filesystem::remove(segmentPath(segment));
+            continue;
+        }
+        files.push_back({std::move(bytes), false});
+        cutSegment(segmentPath(segment), files.back(), files.size() - 1, pieces, nextOrder);
+        m_segment = segment;
+    }
+    m_segment = std::max(m_segment, m_snapshotSegment);
+
+    for(auto& task : replay(files, pieces, replayThreads())) {
+        if(task.cancelled && !MockTask::isFinal(task.status)) {
+            task.status = MockTask::Status::Cancelled;
+        } else if(task.status == MockTask::Status::Running) {
+            // Its worker died with the previous process
+            task.status = MockTask::Status::Waiting;
+        }
+        m_recoveredTasks.push_back({std::move(task.id), std::move(task.description), task.duration,
+                                    MockTask::statusToString(task.status)});
+    }
+}
+
+std::vector<MockTaskView> TaskLog::takeRecoveredTasks() {
+    return std::move(m_recoveredTasks);
+}
+
+void TaskLog::openSegment(uint64_t segment) {
+    const auto path = segmentPath(segment);
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(m_fd < 0) {
+        throw std::runtime_error("Can't open task log " + path);
+    }
+    if(m_durability != Durability::None) {
+        syncDirectory(path);
+    }
+    m_segment = segment;
+    m_segmentBytes = 0;
+}
+
+uint64_t TaskLog::logCreate(const MockTaskView& task) {
+    protocol::Writer record;
+    record.writeU8(static_cast<uint8_t>(RecordKind::Create));
+    record.writeString(task.id);
+    record.writeString(task.description.str());
+    record.writeI32(task.duration);
+    record.writeU8(static_cast<uint8_t>(MockTask::statusFromString(task.status)));
+    return append(record.buffer());
+}
+
+uint64_t TaskLog::logStatus(const std::string& id, MockTask::Status status) {
+    protocol::Writer record;
+    record.writeU8(static_cast<uint8_t>(RecordKind::Status));
+    record.writeString(id);
+    record.writeU8(static_cast<uint8_t>(status));
+    return append(record.buffer());
+}
+
+uint64_t TaskLog::logCancel(const std::string& id) {
+    protocol::Writer record;
+    record.writeU8(static_cast<uint8_t>(RecordKind::Cancel));
+    record.writeString(id);
+    return append(record.buffer());
+}
+
+uint64_t TaskLog::logRemove(const std::string& id) {
+    protocol::Writer record;
+    record.writeU8(static_cast<uint8_t>(RecordKind::Remove));
+    record.writeString(id);
+    return append(record.buffer());
+}
+
+uint64_t TaskLog::append(const std::vector<uint8_t>& record) {
+    protocol::Writer framed;
+    framed.writeBytes(record);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_failed) {
+        throw std::runtime_error("Task log failed to flush and takes no more changes");
+    }
+    writeAll(m_fd, framed.buffer().data(), framed.buffer().size());
+    ++m_written;
+    m_segmentBytes += framed.buffer().size();
+    if(m_segmentBytes >= maxSegmentBytes) {
+        // The segment must be whole on disk before the snapshot replaces it
+        if(m_durability != Durability::None) {
+            if(::fdatasync(m_fd) != 0) {
+                failFlush();
+                throw std::runtime_error("Can't flush task log segment " + segmentPath(m_segment));
+            }
+            m_synced = m_written;
+            m_flushed.notify_all();
+        }
+        ::close(m_fd);
+        openSegment(m_segment + 1);
+        m_sealed.notify_one();
+    }
+    if(m_durability == Durability::EveryOp) {
+        m_appended.notify_one();
+    }
+    return m_written;
+}
+
+void TaskLog::commit(uint64_t position) {
+    if(m_durability != Durability::EveryOp) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushed.wait(lock, [this, position](){ return m_synced >= position || m_failed; });
+    if(m_synced < position) {
+        throw std::runtime_error("Task log failed to flush");
+    }
+}
+
+void TaskLog::failFlush() {
+    m_failed = true;
+    m_flushed.notify_all();
+}
+
+void TaskLog::runFlusher() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        if(m_durability == Durability::Batch) {
+            m_appended.wait_for(lock, m_syncInterval, [this](){ return m_stopping; });
+        } else {
+            m_appended.wait(lock, [this](){ return m_stopping || m_written > m_synced; });
+            if(m_syncInterval.count() > 0) {
+                // Lets more operations join this flush
+                m_appended.wait_for(lock, m_syncInterval, [this](){ return m_stopping; });
+            }
+        }
+
+        // Everything appended so far shares this flush. If the segment is
+        // finished meanwhile, finishing it flushed these records already.
+        const auto target = m_written;
+        const auto fd = m_fd;
+        if(target > m_synced) {
+            lock.unlock();
+            const bool flushed = ::fdatasync(fd) == 0;
+            lock.lock();
+            if(!flushed) {
+                std::cout << "Error: couldn't flush the task log, refusing further changes" << std::endl;
+                failFlush();
+                return;
+            }
+            m_synced = std::max(m_synced, target);
+            m_flushed.notify_all();
+        }
+        if(m_stopping) {
+            return;
+        }
+    }
+}
+
+void TaskLog::runCompactor() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        m_sealed.wait(lock, [this](){ return m_stopping || m_segment - 1 > m_snapshotSegment; });
+        if(m_stopping) {
+            return;
+        }
+        const auto firstSegment = m_snapshotSegment + 1;
+        const auto lastSegment = m_segment - 1;
+        lock.unlock();
+        try {
+            compact(firstSegment, lastSegment);
+        } catch(const std::exception& e) {
+            std::cout << "Error: couldn't compact the task log: " << e.what() << std::endl;
+            lock.lock();
+            m_sealed.wait_for(lock, compactionRetryDelay, [this](){ return m_stopping; });
+            continue;
+        }
+        lock.lock();
+        m_snapshotSegment = lastSegment;
+    }
+}
+
+void TaskLog::compact(uint64_t firstSegment, uint64_t lastSegment) {
+    std::vector<LogFile> files;
+    std::vector<Piece> pieces;
+    uint64_t nextOrder = 0;
+    if(std::filesystem::exists(snapshotPath())) {
+        files.push_back({readFile(snapshotPath()), true});
+        cutSnapshot(files.back(), 0, pieces, nextOrder);
+    }
+    for(auto segment = firstSegment; segment <= lastSegment; ++segment) {
+        files.push_back({readFile(segmentPath(segment)), false});
+        cutSegment(segmentPath(segment), files.back(), files.size() - 1, pieces, nextOrder);
+    }
+    // Leaves most of the machine to the node's own work
+    const auto tasks = replay(files, pieces, std::max<size_t>(1, replayThreads() / 2));
+    files.clear();
+
+    const auto temporary = snapshotPath() + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        throw std::runtime_error("Can't open " + temporary);
+    }
+    try {
+        protocol::Writer header;
+        header.writeU64(lastSegment);
+        writeAll(fd, header.buffer().data(), header.buffer().size());
+        for(size_t begin = 0; begin < tasks.size(); begin += tasksPerChunk) {
+            const auto end = std::min(tasks.size(), begin + tasksPerChunk);
+            protocol::Writer entries;
+            for(auto i = begin; i < end; ++i) {
+                entries.writeString(tasks[i].id);
+                entries.writeString(tasks[i].description);
+                entries.writeI32(tasks[i].duration);
+                entries.writeU8(static_cast<uint8_t>(tasks[i].status));
+                entries.writeU8(tasks[i].cancelled);
+            }
+            protocol::Writer chunk;
+            chunk.writeU32(static_cast<uint32_t>(end - begin));
+            chunk.writeBytes(entries.buffer());
+            writeAll(fd, chunk.buffer().data(), chunk.buffer().size());
+        }
+        if(m_durability != Durability::None && ::fdatasync(fd) != 0) {
+            throw std::runtime_error("Can't flush " + temporary);
+        }
+    } catch(...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    // The segments are all that hold these changes until the snapshot is in
+    // place
+    if(std::rename(temporary.c_str(), snapshotPath().c_str()) != 0) {
+        throw std::runtime_error("Can't rename " + temporary + " to " + snapshotPath());
+    }
+    if(m_durability != Durability::None) {
+        syncDirectory(snapshotPath());
+    }
+
+    for(auto segment = firstSegment; segment <= lastSegment; ++segment) {
+        std::filesystem::remove(segmentPath(segment));
+    }
+}
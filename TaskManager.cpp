@@ -0,0 +1,759 @@
+/*
+    Task registry and local worker pool
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+
+#include "Epochs.hpp"
+#include "TaskManager.hpp"
+
+namespace {
+    // Weight of the newest throughput sample in a lease holder's moving average
+    const double throughputSmoothing = 0.3;
+    // Most finished tasks evicted while holding the registry lock
+    const size_t sweepSliceSize = 1024;
+    const auto maxSweepInterval = std::chrono::milliseconds(1000);
+    // Rough memory a registered task takes besides its description: its
+    // pooled block, id, slot, index entry, row and queue entry
+    const size_t residentTaskBytes = 320;
+    // Spilled tasks are paged back in this many at a time, once fewer wait
+    // in memory
+    const size_t pageInBatch = 1024;
+    // Longest the pager sleeps between checks, in case a wakeup is missed
+    const auto pageInInterval = std::chrono::milliseconds(100);
+
+    size_t residentBytes(const MockTask& task) {
+        return residentTaskBytes + task.getDescription().size();
+    }
+}
+
+std::vector<MockTaskView> TaskBackend::viewTasks(MockTask::Status status) const {
+    auto views = viewAllTasks();
+    const auto name = MockTask::statusToString(status);
+    views.erase(std::remove_if(views.begin(), views.end(), [&name](const MockTaskView& view){ return view.status != name; }),
+                views.end());
+    return views;
+}
+
+TaskCounts TaskBackend::countTasks() const {
+    TaskCounts counts = {};
+    for(const auto& view : viewAllTasks()) {
+        ++counts[MockTask::statusFromString(view.status)];
+    }
+    return counts;
+}
+
+TaskManager::TaskManager(size_t nTasks, std::chrono::milliseconds leaseDuration)
+: m_store(std::make_unique<TaskStore>()), m_executing(true), m_leaseDuration(leaseDuration), m_retention(0),
+  m_memoryBudget(0), m_residentBytes(0) {
+    for(size_t i = 0; i < nTasks; ++i) {
+        m_workers.emplace_back([this](){
+            for(;;) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this](){ return m_executing && !m_waitingTasks.empty();});
+                // Shared only while it runs, in case it is evicted meanwhile
+                auto task = share(m_waitingTasks.front());
+                m_waitingTasks.pop_front();
+                if(m_spill && m_waitingTasks.size() < pageInBatch) {
+                    m_pagerCondition.notify_one();
+                }
+                if(!task || task->isCancelled()){
+                    continue;
+                }
+                auto listener = m_statusListener;
+                m_computing.insert(task->getId());
+                lock.unlock();
+
+                m_store->logStatus(task->getId(), MockTask::Status::Running);
+                if(listener) {
+                    listener(task->getId(), MockTask::Status::Running);
+                }
+                if(task->start()) {
+                    updateRow(*task);
+                }
+                task->compute();
+                const auto status = task->getStatus();
+                finish(task->getId(), status);
+                if(listener) {
+                    listener(task->getId(), status);
+                }
+                lock.lock();
+                m_computing.erase(task->getId());
+            }
+        });
+    }
+
+    m_leaseReaper = std::thread([this](){
+        for(;;) {
+            std::this_thread::sleep_for(m_leaseDuration / 4);
+            reapExpiredLeases();
+        }
+    });
+}
+
+std::string TaskManager::executeCreateTask(const std::string& description, int duration){
+    auto newTask = MockTask::create(description, duration);
+    auto id = newTask->getId();
+    auto position = m_store->logCreate(newTask->getView());
+    enqueue(newTask);
+    m_store->commit(position);
+    return id;
+}
+
+void TaskManager::submitTask(const MockTaskView& task) {
+    auto position = m_store->logCreate(task);
+    addTask(task);
+    m_store->commit(position);
+}
+
+void TaskManager::addTask(const MockTaskView& task) {
+    auto newTask = MockTask::create(task.id, task.description, task.duration);
+    auto status = MockTask::statusFromString(task.status);
+    if(status == MockTask::Status::Waiting) {
+        enqueue(newTask);
+        return;
+    }
+
+    if(m_store->holdsFinishedTasks() && MockTask::isFinal(status)) {
+        return;
+    }
+    newTask->setRemoteStatus(status);
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    insertTask(newTask);
+    if(MockTask::isFinal(status)) {
+        retain(task.id);
+    }
+}
+
+void TaskManager::finish(const std::string& id, MockTask::Status status) {
+    if(!m_store->holdsFinishedTasks()) {
+        m_store->logStatus(id, status);
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if(auto* entry = m_tasks.find(id)) {
+            updateRow(*entry->task);
+        }
+        retain(id);
+        return;
+    }
+    // Both at once, so that listings find the task in exactly one place
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    m_store->logStatus(id, status);
+    if(auto* entry = m_tasks.find(id)) {
+        eraseTask(*entry);
+    }
+}
+
+TaskHandle TaskManager::insertTask(std::shared_ptr<MockTask> task) {
+    const auto id = task->getId();
+    if(auto* replaced = m_tasks.find(id)) {
+        eraseTask(*replaced);
+    }
+    if(m_spill && m_spill->size() > 0) {
+        m_spill->remove(id);
+    }
+    m_residentBytes += residentBytes(*task);
+    task->setRow(m_columns.add(*task));
+    auto* registered = task.get();
+    const auto handle = m_slots.insert(std::move(task));
+    m_tasks.insert(id, handle, registered);
+    return handle;
+}
+
+void TaskManager::eraseTask(const TaskIndex::Entry& entry) {
+    m_residentBytes -= residentBytes(*entry.task);
+    m_columns.remove(entry.task->getRow(), *entry.task);
+    auto task = m_slots.erase(entry.handle);
+    // Retires the entry, which stays readable until this returns
+    m_tasks.erase(entry.id);
+    // Readers that found it without the lock may still be viewing it
+    Epochs::retire([task]() mutable { task.reset(); });
+}
+
+bool TaskManager::spill(const MockTask& task) {
+    if(!m_spill || (m_spill->size() == 0 && m_residentBytes + residentBytes(task) <= m_memoryBudget)) {
+        return false;
+    }
+    // Replacing any task under its id, as insertTask does
+    const auto id = task.getId();
+    if(auto* replaced = m_tasks.find(id)) {
+        eraseTask(*replaced);
+    }
+    m_spill->remove(id);
+    m_spill->push(task.getView());
+    return true;
+}
+
+std::shared_ptr<MockTask> TaskManager::share(TaskHandle handle) const {
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    return m_slots.share(handle);
+}
+
+void TaskManager::updateRow(const MockTask& task) {
+    // A task no longer registered has lost its row, which update() notices
+    m_columns.update(task.getRow(), task);
+}
+
+void TaskManager::retain(const std::string& id) {
+    if(m_retention.count() > 0) {
+        const auto finishedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        m_finishedTasks.push_back({std::chrono::steady_clock::now() + m_retention, finishedAt, id});
+    }
+}
+
+MockTaskView TaskManager::releaseTask(const std::string& id) {
+    MockTaskView view;
+    uint64_t position;
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if(auto* entry = m_tasks.find(id)) {
+            auto* task = entry->task;
+            view = task->getView();
+            auto status = MockTask::statusFromString(view.status);
+            if(status == MockTask::Status::Waiting) {
+                // The queue entry stays behind and is skipped once it's withdrawn
+                if(!task->withdraw()) {
+                    return MockTaskView();
+                }
+            } else if(status == MockTask::Status::Running) {
+                return MockTaskView();
+            }
+            eraseTask(*entry);
+        } else if(auto spilled = m_spill ? m_spill->remove(id) : std::nullopt) {
+            view = *spilled;
+        } else {
+            auto stored = m_store->findTask(id);
+            if(!stored) {
+                return MockTaskView();
+            }
+            view = *stored;
+        }
+        position = m_store->logRemove(id);
+    }
+    m_store->commit(position);
+    return view;
+}
+
+void TaskManager::enqueue(std::shared_ptr<MockTask> task) {
+    TaskHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if(spill(*task)) {
+            // Without m_mutex, so the pager may miss this; it checks again
+            // shortly anyway
+            m_pagerCondition.notify_one();
+            return;
+        }
+        handle = insertTask(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_executing) {
+            return;
+        }
+        m_waitingTasks.push_back(handle);
+    }
+    m_condition.notify_one();
+}
+
+MockTaskView TaskManager::viewTask(const std::string& id) const {
+    {
+        Epochs::Guard guard;
+        if(auto* entry = m_tasks.find(id)) {
+            return entry->task->getView();
+        }
+    }
+    std::optional<MockTaskView> stored;
+    if(m_store->holdsFinishedTasks() || m_spill) {
+        // Again with the lock, in case it moved to the store or was paged in
+        // in between
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if(auto* entry = m_tasks.find(id)) {
+            return entry->task->getView();
+        }
+        if(m_spill) {
+            stored = m_spill->find(id);
+        }
+        if(!stored && m_store->holdsFinishedTasks()) {
+            stored = m_store->findTask(id);
+        }
+    }
+    // Decompressing archived tasks takes a while, so not with the lock held
+    if(!stored && m_archive) {
+        stored = m_archive->find(id);
+    }
+    return stored ? *stored : MockTaskView();
+}
+
+std::vector<MockTaskView> TaskManager::viewAllTasks() const {
+    if(!m_store->holdsFinishedTasks() && !m_spill) {
+        return m_columns.view(std::nullopt);
+    }
+    // All at once, so that a task moving to the store or paged in is listed
+    // once
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    auto views = m_columns.view(std::nullopt);
+    if(m_store->holdsFinishedTasks()) {
+        auto finished = m_store->viewFinishedTasks();
+        views.insert(views.end(), std::make_move_iterator(finished.begin()), std::make_move_iterator(finished.end()));
+    }
+    if(m_spill) {
+        auto spilled = m_spill->view();
+        views.insert(views.end(), std::make_move_iterator(spilled.begin()), std::make_move_iterator(spilled.end()));
+    }
+    return views;
+}
+
+std::vector<MockTaskView> TaskManager::viewTasks(MockTask::Status status) const {
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    auto views = m_columns.view(status);
+    if(m_store->holdsFinishedTasks() && MockTask::isFinal(status)) {
+        const auto name = MockTask::statusToString(status);
+        for(auto& view : m_store->viewFinishedTasks()) {
+            if(view.status == name) {
+                views.push_back(std::move(view));
+            }
+        }
+    }
+    if(m_spill && status == MockTask::Status::Waiting) {
+        auto spilled = m_spill->view();
+        views.insert(views.end(), std::make_move_iterator(spilled.begin()), std::make_move_iterator(spilled.end()));
+    }
+    return views;
+}
+
+TaskCounts TaskManager::countTasks() const {
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    auto counts = m_columns.count();
+    if(m_store->holdsFinishedTasks()) {
+        for(const auto& view : m_store->viewFinishedTasks()) {
+            ++counts[MockTask::statusFromString(view.status)];
+        }
+    }
+    if(m_spill) {
+        counts[MockTask::Status::Waiting] += m_spill->size();
+    }
+    return counts;
+}
+
+bool TaskManager::cancelTask(const std::string& id){
+    std::shared_ptr<MockTask> task;
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if(auto* entry = m_tasks.find(id)){
+            task = m_slots.share(entry->handle);
+        } else if(auto spilled = m_spill ? m_spill->remove(id) : std::nullopt) {
+            // Registered again, to be cancelled like any task that hasn't
+            // started
+            task = MockTask::create(spilled->id, spilled->description, spilled->duration);
+            insertTask(task);
+        } else if(m_store->findTask(id)) {
+            return true;
+        }
+    }
+    if(!task) {
+        // Finished already, if it exists at all
+        return m_archive && m_archive->find(id).has_value();
+    }
+
+    task->abort();
+    m_store->commit(m_store->logCancel(id));
+    if(task->isCancelled()) {
+        // It never started, so it is done already
+        finish(id, MockTask::Status::Cancelled);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto lease = m_leases.find(id);
+    if(lease != m_leases.end()) {
+        m_leaseHolders[lease->second.workerId].pendingCancels.push_back(id);
+    }
+    return true;
+}
+
+std::vector<MockTaskView> TaskManager::leaseTasks(const std::string& workerId, size_t maxTasks) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& holder = m_leaseHolders[workerId];
+    if(holder.lastHeartbeat == std::chrono::steady_clock::time_point()) {
+        holder.lastHeartbeat = std::chrono::steady_clock::now();
+    }
+
+    // A worker we know nothing about yet gets one task at a time until it
+    // has reported some completions.
+    const double leaseSeconds = std::chrono::duration<double>(m_leaseDuration).count();
+    const auto affordable = static_cast<size_t>(std::ceil(holder.throughput * leaseSeconds / 2));
+    const auto batchSize = std::min(maxTasks, std::max<size_t>(1, affordable));
+
+    std::vector<MockTaskView> granted;
+    const auto expiry = std::chrono::steady_clock::now() + m_leaseDuration;
+    std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+    while(granted.size() < batchSize && !m_waitingTasks.empty()) {
+        auto handle = m_waitingTasks.front();
+        m_waitingTasks.pop_front();
+        auto* task = m_slots.get(handle);
+        if(task == nullptr || task->isAborted()) {
+            continue;
+        }
+        auto view = task->getView();
+        m_leases[view.id] = {workerId, handle, expiry};
+        granted.push_back(std::move(view));
+    }
+    if(m_spill && m_waitingTasks.size() < pageInBatch) {
+        m_pagerCondition.notify_one();
+    }
+    return granted;
+}
+
+std::vector<std::string> TaskManager::heartbeat(const std::string& workerId, const std::vector<TaskReport>& reports) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& holder = m_leaseHolders[workerId];
+    std::vector<std::string> cancels;
+    cancels.swap(holder.pendingCancels);
+
+    size_t completed = 0;
+    const auto now = std::chrono::steady_clock::now();
+    for(const auto& report : reports) {
+        auto lease = m_leases.find(report.id);
+        if(lease == m_leases.end() || lease->second.workerId != workerId) {
+            cancels.push_back(report.id);
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+            auto* task = m_slots.get(lease->second.task);
+            if(task == nullptr) {
+                // Handed to another node since
+                cancels.push_back(report.id);
+                m_leases.erase(lease);
+                continue;
+            }
+            task->setRemoteStatus(report.status);
+            updateRow(*task);
+        }
+        if(MockTask::isFinal(report.status)) {
+            finish(report.id, report.status);
+            m_leases.erase(lease);
+            ++completed;
+        } else {
+            m_store->logStatus(report.id, report.status);
+            lease->second.expiry = now + m_leaseDuration;
+        }
+    }
+
+    if(holder.lastHeartbeat != std::chrono::steady_clock::time_point()) {
+        const double elapsed = std::chrono::duration<double>(now - holder.lastHeartbeat).count();
+        if(elapsed > 0) {
+            const double sample = completed / elapsed;
+            holder.throughput = holder.throughput == 0 ? sample
+                : (1 - throughputSmoothing) * holder.throughput + throughputSmoothing * sample;
+        }
+    }
+    holder.lastHeartbeat = now;
+    return cancels;
+}
+
+std::chrono::milliseconds TaskManager::getLeaseDuration() const {
+    return m_leaseDuration;
+}
+
+void TaskManager::revokeLeases(const std::string& workerId) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto& [id, lease] : m_leases) {
+            if(lease.workerId == workerId) {
+                lease.expiry = std::chrono::steady_clock::time_point();
+            }
+        }
+        m_leaseHolders.erase(workerId);
+    }
+    reapExpiredLeases();
+}
+
+void TaskManager::setTaskStatus(const std::string& id, MockTask::Status status) {
+    std::lock_guard<std::mutex> lock(m_tasksMutex);
+    if(auto* entry = m_tasks.find(id)) {
+        auto* task = entry->task;
+        task->setRemoteStatus(status);
+        m_store->logStatus(id, status);
+        if(m_store->holdsFinishedTasks() && MockTask::isFinal(status)) {
+            eraseTask(*entry);
+            return;
+        }
+        updateRow(*task);
+        if(MockTask::isFinal(status)) {
+            retain(id);
+        }
+    }
+}
+
+void TaskManager::setExecuting(bool executing) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_executing = executing;
+        m_waitingTasks.clear();
+        if(executing) {
+            std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+            m_slots.forEach([this](TaskHandle handle, MockTask& task){
+                auto status = task.getStatus();
+                if(status == MockTask::Status::Running && m_computing.count(task.getId()) == 0) {
+                    // Whoever ran it is gone; run it again from the start
+                    task.setRemoteStatus(MockTask::Status::Waiting);
+                    updateRow(task);
+                    m_store->logStatus(task.getId(), MockTask::Status::Waiting);
+                    status = MockTask::Status::Waiting;
+                }
+                if(status == MockTask::Status::Waiting && !task.isAborted()) {
+                    m_waitingTasks.push_back(handle);
+                }
+            });
+        }
+    }
+    m_condition.notify_all();
+}
+
+void TaskManager::setStatusListener(StatusListener listener) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_statusListener = std::move(listener);
+}
+
+size_t TaskManager::setStore(std::unique_ptr<TaskStore> store) {
+    m_store = std::move(store);
+    const auto tasks = m_store->takeRecoveredTasks();
+    // Restored in bulk, taking each lock once
+    std::vector<TaskHandle> waiting;
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_tasks.reserve(m_tasks.size() + tasks.size());
+        for(const auto& task : tasks) {
+            auto status = MockTask::statusFromString(task.status);
+            if(m_store->holdsFinishedTasks() && MockTask::isFinal(status)) {
+                continue;
+            }
+            auto restored = MockTask::create(task.id, task.description, task.duration);
+            if(status != MockTask::Status::Waiting) {
+                restored->setRemoteStatus(status);
+            } else if(spill(*restored)) {
+                continue;
+            }
+            auto handle = insertTask(std::move(restored));
+            if(status == MockTask::Status::Waiting) {
+                waiting.push_back(handle);
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_executing) {
+            m_waitingTasks.insert(m_waitingTasks.end(), waiting.begin(), waiting.end());
+        }
+    }
+    m_condition.notify_all();
+    return tasks.size();
+}
+
+void TaskManager::setRetention(std::chrono::milliseconds ttl, std::unique_ptr<TaskArchive> archive) {
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_retention = ttl;
+        m_archive = std::move(archive);
+        // Those already finished, restored from the store, start their
+        // retention now
+        m_slots.forEach([this](TaskHandle, const MockTask& task){
+            if(MockTask::isFinal(task.getStatus())) {
+                retain(task.getId());
+            }
+        });
+    }
+    m_sweeper = std::thread([this](){ sweepFinishedTasks(); });
+}
+
+void TaskManager::setMemoryBudget(size_t bytes, std::unique_ptr<SpillQueue> spill) {
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_memoryBudget = bytes;
+        m_spill = std::move(spill);
+    }
+    m_pager = std::thread([this](){ pageIn(); });
+}
+
+TaskLoad TaskManager::getLoad() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto waiting = m_waitingTasks.size();
+    if(m_spill) {
+        std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+        waiting += m_spill->size();
+    }
+    return {waiting, m_workers.size() - m_computing.size()};
+}
+
+std::vector<MockTaskView> TaskManager::takeWaitingTasks(size_t maxTasks, const std::unordered_set<std::string>& keep) {
+    std::vector<MockTaskView> taken;
+    uint64_t position = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+        for(auto it = m_waitingTasks.end(); it != m_waitingTasks.begin() && taken.size() < maxTasks;) {
+            --it;
+            auto* task = m_slots.get(*it);
+            if(task == nullptr) {
+                it = m_waitingTasks.erase(it);
+                continue;
+            }
+            if(keep.count(task->getId()) > 0) {
+                continue;
+            }
+            auto view = task->getView();
+            if(task->withdraw()) {
+                eraseTask(*m_tasks.find(view.id));
+                position = m_store->logRemove(view.id);
+                taken.push_back(view);
+            }
+            it = m_waitingTasks.erase(it);
+        }
+    }
+    m_store->commit(position);
+    return taken;
+}
+
+void TaskManager::reapExpiredLeases() {
+    size_t requeued = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        for(auto it = m_leases.begin(); it != m_leases.end();) {
+            if(it->second.expiry > now) {
+                ++it;
+                continue;
+            }
+
+            auto task = share(it->second.task);
+            if(!task) {
+                // Handed to another node since
+                it = m_leases.erase(it);
+                continue;
+            }
+            std::cout << "Lease on task " << task->getId() << " held by " << it->second.workerId << " expired" << std::endl;
+            const auto handle = it->second.task;
+            it = m_leases.erase(it);
+            if(task->isAborted()) {
+                // Cancelled while its worker was running it, and the worker
+                // never confirmed: it won't be run again.
+                if(!task->isCancelled()) {
+                    task->setRemoteStatus(MockTask::Status::Failed);
+                    finish(task->getId(), MockTask::Status::Failed);
+                }
+            } else {
+                task->setRemoteStatus(MockTask::Status::Waiting);
+                updateRow(*task);
+                m_store->logStatus(task->getId(), MockTask::Status::Waiting);
+                m_waitingTasks.push_front(handle);
+                ++requeued;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < requeued; ++i) {
+        m_condition.notify_one();
+    }
+}
+
+void TaskManager::sweepFinishedTasks() {
+    const auto interval = std::clamp(m_retention / 4, std::chrono::milliseconds(10), maxSweepInterval);
+    for(;;) {
+        // Copied out in one slice, archived without the lock, then evicted in
+        // another, so that lookups find them somewhere all along
+        std::vector<TaskHandle> expired;
+        std::vector<MockTaskView> views;
+        std::vector<int64_t> finishedAt;
+        size_t swept = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_tasksMutex);
+            const auto now = std::chrono::steady_clock::now();
+            for(; swept < m_finishedTasks.size() && swept < sweepSliceSize; ++swept) {
+                const auto& finished = m_finishedTasks[swept];
+                if(finished.expiry > now) {
+                    break;
+                }
+                // Gone already if it was handed to another node
+                if(auto* entry = m_tasks.find(finished.id)) {
+                    expired.push_back(entry->handle);
+                    views.push_back(entry->task->getView());
+                    finishedAt.push_back(finished.finishedAt);
+                }
+            }
+        }
+
+        if(m_archive) {
+            try {
+                m_archive->append(views, finishedAt);
+            } catch(const std::exception& e) {
+                std::cout << "Error: " << e.what() << ", keeping finished tasks in memory" << std::endl;
+                std::this_thread::sleep_for(maxSweepInterval);
+                continue;
+            }
+        }
+
+        std::vector<std::string> evicted;
+        {
+            std::lock_guard<std::mutex> lock(m_tasksMutex);
+            // Only this thread takes from the front, so the slice is still there
+            m_finishedTasks.erase(m_finishedTasks.begin(), m_finishedTasks.begin() + swept);
+            for(size_t i = 0; i < expired.size(); ++i) {
+                auto* entry = m_tasks.find(views[i].id);
+                // Unless the id was since given to a task submitted again
+                if(entry != nullptr && entry->handle == expired[i]) {
+                    eraseTask(*entry);
+                    evicted.push_back(views[i].id);
+                }
+            }
+        }
+        for(const auto& id : evicted) {
+            m_store->logRemove(id);
+        }
+        if(swept < sweepSliceSize) {
+            std::this_thread::sleep_for(interval);
+        }
+    }
+}
+
+void TaskManager::pageIn() {
+    for(;;) {
+        size_t paged = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto wanted = [this](){
+                if(!m_executing || m_waitingTasks.size() >= pageInBatch) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+                return m_spill->size() > 0;
+            };
+            if(!m_pagerCondition.wait_for(lock, pageInInterval, wanted)) {
+                continue;
+            }
+            // With both locks, so that setExecuting can't queue the tasks a
+            // second time. The spill queue read ahead, so this mostly copies
+            // from the page cache.
+            std::lock_guard<std::mutex> tasksLock(m_tasksMutex);
+            try {
+                for(const auto& view : m_spill->pop(pageInBatch)) {
+                    m_waitingTasks.push_back(insertTask(MockTask::create(view.id, view.description, view.duration)));
+                    ++paged;
+                }
+            } catch(const std::exception& e) {
+                std::cout << "Error: " << e.what() << ", leaving spilled tasks on disk" << std::endl;
+            }
+        }
+        if(paged == 0) {
+            std::this_thread::sleep_for(pageInInterval);
+        }
+        for(size_t i = 0; i < paged; ++i) {
+            m_condition.notify_one();
+        }
+    }
+}
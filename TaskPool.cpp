@@ -0,0 +1,137 @@
+/*
+    Pooled allocation of small objects of one size
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#include "HugePages.hpp"
+#include "TaskPool.hpp"
+
+namespace {
+    // Pools are per object size, so there are only ever a handful
+    const size_t maxPools = 16;
+    // One huge page, so a slab costs a single TLB entry
+    const size_t slabBytes = HugePages::pageSize;
+    // Blocks a thread takes from or gives back to the shared list at once
+    const size_t cacheBatch = 64;
+
+    std::atomic<size_t> poolCount(0);
+    SlabPool* pools[maxPools];
+}
+
+// Every pool's cache for one thread, handed back to the pools when the
+// thread exits
+struct SlabPool::ThreadCaches {
+    ThreadCache caches[maxPools];
+
+    ~ThreadCaches() {
+        for(size_t i = 0; i < poolCount; ++i) {
+            pools[i]->drain(caches[i], 0);
+        }
+    }
+};
+
+SlabPool::SlabPool(size_t blockSize)
+: m_blockSize(std::max(blockSize, sizeof(FreeBlock))), m_free(nullptr), m_slab(nullptr), m_slabUsed(slabBytes),
+  m_reservedBytes(0) {
+    // Keeps every block as aligned as operator new would
+    const size_t alignment = alignof(std::max_align_t);
+    m_blockSize = (m_blockSize + alignment - 1) / alignment * alignment;
+    m_index = poolCount++;
+    if(m_index >= maxPools) {
+        throw std::logic_error("Too many slab pools");
+    }
+    pools[m_index] = this;
+}
+
+SlabPool::ThreadCache* SlabPool::threadCache() {
+    static thread_local bool tornDown = false;
+    struct Owner {
+        ThreadCaches caches;
+        ~Owner() { tornDown = true; }
+    };
+    static thread_local Owner owner;
+    return tornDown ? nullptr : &owner.caches.caches[m_index];
+}
+
+void* SlabPool::allocate() {
+    auto* cache = threadCache();
+    ThreadCache shared;
+    if(cache == nullptr) {
+        cache = &shared;
+    }
+    if(cache->head == nullptr) {
+        refill(*cache);
+    }
+    auto* block = cache->head;
+    cache->head = block->next;
+    --cache->count;
+    if(cache == &shared) {
+        drain(shared, 0);
+    }
+    return block;
+}
+
+void SlabPool::deallocate(void* block) {
+    auto* cache = threadCache();
+    ThreadCache shared;
+    if(cache == nullptr) {
+        cache = &shared;
+    }
+    auto* freed = static_cast<FreeBlock*>(block);
+    freed->next = cache->head;
+    cache->head = freed;
+    ++cache->count;
+    if(cache->count > 2 * cacheBatch || cache == &shared) {
+        drain(*cache, cache == &shared ? 0 : cacheBatch);
+    }
+}
+
+size_t SlabPool::getBlockSize() const {
+    return m_blockSize;
+}
+
+size_t SlabPool::getReservedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reservedBytes;
+}
+
+void SlabPool::refill(ThreadCache& cache) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(cache.count < cacheBatch && m_free != nullptr) {
+        auto* block = m_free;
+        m_free = block->next;
+        block->next = cache.head;
+        cache.head = block;
+        ++cache.count;
+    }
+    while(cache.count < cacheBatch) {
+        if(slabBytes - m_slabUsed < m_blockSize) {
+            // The rest of the old slab is too small for a block and is lost
+            m_slab = static_cast<uint8_t*>(HugePages::allocate(slabBytes));
+            m_slabUsed = 0;
+            m_reservedBytes += slabBytes;
+        }
+        auto* block = reinterpret_cast<FreeBlock*>(m_slab + m_slabUsed);
+        m_slabUsed += m_blockSize;
+        block->next = cache.head;
+        cache.head = block;
+        ++cache.count;
+    }
+}
+
+void SlabPool::drain(ThreadCache& cache, size_t keep) {
+    if(cache.count <= keep) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while(cache.count > keep) {
+        auto* block = cache.head;
+        cache.head = block->next;
+        --cache.count;
+        block->next = m_free;
+        m_free = block;
+    }
+}
@@ -0,0 +1,458 @@
+/*
+    Parsing of REST request bodies
+*/
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+#include "nlohmann/json.hpp"
+
+#include "TaskRequest.hpp"
+
+namespace {
+    // Deepest nesting accepted in skipped members
+    const int maxDepth = 64;
+
+    const uint64_t lowBytes = 0x0101010101010101;
+    const uint64_t highBits = 0x8080808080808080;
+
+    // Whether any byte of word is below limit, without false negatives;
+    // the lowest flagged byte is always a real one
+    uint64_t bytesBelow(uint64_t word, uint8_t limit) {
+        return (word - lowBytes * limit) & ~word & highBits;
+    }
+
+    class Parser {
+    public:
+        explicit Parser(std::string_view text) : m_text(text), m_position(0), m_error(nullptr) {}
+
+        const char* error() const {
+            return m_error;
+        }
+
+        bool fail(const char* error) {
+            if(m_error == nullptr) {
+                m_error = error;
+            }
+            return false;
+        }
+
+        void skipWhitespace() {
+            while(m_position < m_text.size()) {
+                const char c = m_text[m_position];
+                if(c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                    return;
+                }
+                ++m_position;
+            }
+        }
+
+        bool consume(char expected) {
+            skipWhitespace();
+            if(m_position < m_text.size() && m_text[m_position] == expected) {
+                ++m_position;
+                return true;
+            }
+            return false;
+        }
+
+        bool atEnd() {
+            skipWhitespace();
+            return m_position == m_text.size();
+        }
+
+        char peek() {
+            skipWhitespace();
+            return m_position < m_text.size() ? m_text[m_position] : '\0';
+        }
+
+        // Reads a string, leaving its escapes in place
+        bool string(std::string_view& value, bool& escaped) {
+            if(!consume('"')) {
+                return fail("Expected a string");
+            }
+            const auto start = m_position;
+            escaped = false;
+            for(;;) {
+                m_position = findSpecial(m_position);
+                if(m_position >= m_text.size()) {
+                    return fail("Unterminated string");
+                }
+                const char c = m_text[m_position];
+                if(c == '"') {
+                    value = m_text.substr(start, m_position - start);
+                    ++m_position;
+                    return true;
+                }
+                if(static_cast<unsigned char>(c) >= 0x80) {
+                    if(!utf8()) {
+                        return false;
+                    }
+                    continue;
+                }
+                if(c != '\\') {
+                    return fail("Control character in a string");
+                }
+                escaped = true;
+                if(!escape()) {
+                    return false;
+                }
+            }
+        }
+
+        // Reads an integer that fits an int
+        bool integer(int& value) {
+            skipWhitespace();
+            const bool negative = m_position < m_text.size() && m_text[m_position] == '-';
+            auto position = m_position + negative;
+            const auto digits = position;
+            int64_t magnitude = 0;
+            while(position < m_text.size() && m_text[position] >= '0' && m_text[position] <= '9') {
+                magnitude = magnitude * 10 + (m_text[position] - '0');
+                if(magnitude > int64_t(std::numeric_limits<int>::max()) + negative) {
+                    return fail("Duration out of range");
+                }
+                ++position;
+            }
+            if(position == digits || (m_text[digits] == '0' && position - digits > 1)) {
+                return fail("Expected an integer duration");
+            }
+            if(position < m_text.size() && (m_text[position] == '.' || m_text[position] == 'e' || m_text[position] == 'E')) {
+                return fail("Expected an integer duration");
+            }
+            m_position = position;
+            value = static_cast<int>(negative ? -magnitude : magnitude);
+            return true;
+        }
+
+        // Checks and skips any value
+        bool skipValue(int depth) {
+            if(depth > maxDepth) {
+                return fail("Nested too deeply");
+            }
+            const char c = peek();
+            if(c == '"') {
+                std::string_view value;
+                bool escaped;
+                return string(value, escaped);
+            }
+            if(c == '{' || c == '[') {
+                ++m_position;
+                const char close = c == '{' ? '}' : ']';
+                if(consume(close)) {
+                    return true;
+                }
+                do {
+                    if(c == '{') {
+                        std::string_view key;
+                        bool escaped;
+                        if(!string(key, escaped) || !consume(':')) {
+                            return fail("Expected a member");
+                        }
+                    }
+                    if(!skipValue(depth + 1)) {
+                        return false;
+                    }
+                } while(consume(','));
+                return consume(close) || fail("Expected a comma or the end of a container");
+            }
+            if(c == '-' || (c >= '0' && c <= '9')) {
+                return number();
+            }
+            for(const char* word : {"true", "false", "null"}) {
+                const auto length = std::strlen(word);
+                if(m_text.compare(m_position, length, word) == 0) {
+                    m_position += length;
+                    return true;
+                }
+            }
+            return fail("Expected a value");
+        }
+    private:
+        // The next quote, backslash, control character or non-ASCII byte at or
+        // after from, looking at eight bytes at a time
+        size_t findSpecial(size_t from) const {
+            while(from + sizeof(uint64_t) <= m_text.size()) {
+                uint64_t word;
+                std::memcpy(&word, m_text.data() + from, sizeof(word));
+                const auto special = bytesBelow(word ^ (lowBytes * '"'), 1) | bytesBelow(word ^ (lowBytes * '\\'), 1)
+                    | bytesBelow(word, 0x20) | (word & highBits);
+                if(special != 0) {
+                    break;
+                }
+                from += sizeof(word);
+            }
+            while(from < m_text.size()) {
+                const auto c = static_cast<unsigned char>(m_text[from]);
+                if(c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+                    break;
+                }
+                ++from;
+            }
+            return from;
+        }
+
+        // Checks the UTF-8 sequence at the current byte and moves past it
+        bool utf8() {
+            const auto lead = static_cast<unsigned char>(m_text[m_position]);
+            const size_t length = lead >= 0xc2 && lead <= 0xdf ? 2 : lead >= 0xe0 && lead <= 0xef ? 3
+                : lead >= 0xf0 && lead <= 0xf4 ? 4 : 0;
+            if(length == 0 || m_position + length > m_text.size()) {
+                return fail("Invalid UTF-8 in a string");
+            }
+            uint32_t code = lead & (0x7f >> length);
+            for(size_t i = 1; i < length; ++i) {
+                const auto next = static_cast<unsigned char>(m_text[m_position + i]);
+                if((next & 0xc0) != 0x80) {
+                    return fail("Invalid UTF-8 in a string");
+                }
+                code = code << 6 | (next & 0x3f);
+            }
+            // Overlong forms, surrogates and beyond Unicode
+            if((length == 3 && (code < 0x800 || (code >= 0xd800 && code < 0xe000)))
+               || (length == 4 && (code < 0x10000 || code > 0x10ffff))) {
+                return fail("Invalid UTF-8 in a string");
+            }
+            m_position += length;
+            return true;
+        }
+
+        // The code unit of the \\u escape at position, if it is one
+        std::optional<uint32_t> unicodeEscape(size_t position) const {
+            if(position + 6 > m_text.size() || m_text[position] != '\\' || m_text[position + 1] != 'u') {
+                return std::nullopt;
+            }
+            uint32_t code = 0;
+            for(size_t i = position + 2; i < position + 6; ++i) {
+                const auto c = static_cast<unsigned char>(m_text[i]);
+                if(!std::isxdigit(c)) {
+                    return std::nullopt;
+                }
+                code = code << 4 | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+            }
+            return code;
+        }
+
+        // Checks the escape at the current backslash and moves past it
+        bool escape() {
+            if(m_position + 1 >= m_text.size()) {
+                return fail("Unterminated string");
+            }
+            const char c = m_text[m_position + 1];
+            if(c == 'u') {
+                auto code = unicodeEscape(m_position);
+                if(!code || (*code >= 0xdc00 && *code < 0xe000)) {
+                    return fail("Bad escape in a string");
+                }
+                m_position += 6;
+                if(*code >= 0xd800 && *code < 0xdc00) {
+                    // Only half a character without the other half
+                    auto low = unicodeEscape(m_position);
+                    if(!low || *low < 0xdc00 || *low >= 0xe000) {
+                        return fail("Bad escape in a string");
+                    }
+                    m_position += 6;
+                }
+                return true;
+            }
+            if(std::strchr("\"\\/bfnrt", c) == nullptr || c == '\0') {
+                return fail("Bad escape in a string");
+            }
+            m_position += 2;
+            return true;
+        }
+
+        bool number() {
+            auto position = m_position + (m_text[m_position] == '-');
+            auto digits = [this, &position]() {
+                const auto start = position;
+                while(position < m_text.size() && m_text[position] >= '0' && m_text[position] <= '9') {
+                    ++position;
+                }
+                return position > start;
+            };
+            const auto integerStart = position;
+            if(!digits() || (m_text[integerStart] == '0' && position - integerStart > 1)) {
+                return fail("Expected a value");
+            }
+            const auto integerEnd = position;
+            if(position < m_text.size() && m_text[position] == '.') {
+                ++position;
+                if(!digits()) {
+                    return fail("Expected a value");
+                }
+            }
+            if(position < m_text.size() && (m_text[position] == 'e' || m_text[position] == 'E')) {
+                ++position;
+                if(position < m_text.size() && (m_text[position] == '+' || m_text[position] == '-')) {
+                    ++position;
+                }
+                if(!digits()) {
+                    return fail("Expected a value");
+                }
+            }
+            // Anything but an integer has to fit a double, as with a JSON document
+            if(position != integerEnd) {
+                const std::string text(m_text.substr(m_position, position - m_position));
+                if(std::isinf(std::strtod(text.c_str(), nullptr))) {
+                    return fail("Number out of range");
+                }
+            }
+            m_position = position;
+            return true;
+        }
+
+        std::string_view m_text;
+        size_t m_position;
+        const char* m_error;
+    };
+
+    unsigned hexValue(char c) {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    }
+
+    void appendUtf8(std::string& out, uint32_t code) {
+        if(code < 0x80) {
+            out += static_cast<char>(code);
+        } else if(code < 0x800) {
+            out += static_cast<char>(0xc0 | code >> 6);
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else if(code < 0x10000) {
+            out += static_cast<char>(0xe0 | code >> 12);
+            out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | code >> 18);
+            out += static_cast<char>(0x80 | (code >> 12 & 0x3f));
+            out += static_cast<char>(0x80 | (code >> 6 & 0x3f));
+            out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    // text with its escapes resolved; parsing checked them already
+    std::string unescape(std::string_view text) {
+        std::string out;
+        out.reserve(text.size());
+        for(size_t i = 0; i < text.size(); ++i) {
+            const char c = text[i];
+            if(c != '\\') {
+                out += c;
+                continue;
+            }
+            const char kind = text[++i];
+            if(kind != 'u') {
+                const char* from = "\"\\/bfnrt";
+                const char* to = "\"\\/\b\f\n\r\t";
+                out += to[std::strchr(from, kind) - from];
+                continue;
+            }
+            uint32_t code = 0;
+            for(int digit = 0; digit < 4; ++digit) {
+                code = code << 4 | hexValue(text[++i]);
+            }
+            // Parsing made sure the second half of a surrogate pair follows
+            if(code >= 0xd800 && code < 0xdc00) {
+                uint32_t low = 0;
+                for(size_t digit = 0; digit < 4; ++digit) {
+                    low = low << 4 | hexValue(text[i + 3 + digit]);
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            appendUtf8(out, code);
+        }
+        return out;
+    }
+}
+
+std::string CreateTaskRequest::descriptionString() const {
+    return escaped ? unescape(description) : std::string(description);
+}
+
+std::variant<CreateTaskRequest, const char*> parseCreateTask(std::string_view body) {
+    Parser parser(body);
+    std::optional<std::string_view> description;
+    bool escaped = false;
+    std::optional<int> duration;
+    if(!parser.consume('{')) {
+        return "Expected a JSON object";
+    }
+    if(!parser.consume('}')) {
+        do {
+            std::string_view key;
+            bool keyEscaped;
+            if(!parser.string(key, keyEscaped) || !parser.consume(':')) {
+                return parser.error() != nullptr ? parser.error() : "Expected a member";
+            }
+            // Keys are compared as a document would hold them; escaped ones
+            // are rare enough to copy
+            std::string unescapedKey;
+            if(keyEscaped) {
+                unescapedKey = unescape(key);
+                key = unescapedKey;
+            }
+            bool parsed;
+            if(key == "description") {
+                std::string_view value;
+                parsed = parser.peek() == '"' ? parser.string(value, escaped) : parser.fail("Expected a description string");
+                description = value;
+            } else if(key == "duration") {
+                int value = 0;
+                parsed = parser.integer(value);
+                duration = value;
+            } else {
+                parsed = parser.skipValue(1);
+            }
+            if(!parsed) {
+                return parser.error();
+            }
+        } while(parser.consume(','));
+        if(!parser.consume('}')) {
+            return "Expected a comma or the end of the object";
+        }
+    }
+    if(!parser.atEnd()) {
+        return "Unexpected content after the object";
+    }
+    if(!description || !duration) {
+        return "Expected a description and a duration";
+    }
+    return CreateTaskRequest{*description, escaped, *duration};
+}
+
+std::variant<DecodedCreateTask, const char*> decodeCreateTask(std::string_view body, MediaType type) {
+    nlohmann::json document;
+    try {
+        document = type == MediaType::Cbor ? nlohmann::json::from_cbor(body.begin(), body.end())
+            : nlohmann::json::from_msgpack(body.begin(), body.end());
+    } catch(const nlohmann::json::exception&) {
+        return "Malformed body";
+    }
+    if(!document.is_object()) {
+        return "Expected a map";
+    }
+    auto description = document.find("description");
+    auto duration = document.find("duration");
+    if(description == document.end() || duration == document.end()) {
+        return "Expected a description and a duration";
+    }
+    if(!description->is_string()) {
+        return "Expected a description string";
+    }
+    if(!duration->is_number_integer()) {
+        return "Expected an integer duration";
+    }
+    const bool inRange = duration->is_number_unsigned()
+        ? duration->get<uint64_t>() <= static_cast<uint64_t>(std::numeric_limits<int>::max())
+        : duration->get<int64_t>() >= std::numeric_limits<int>::min()
+          && duration->get<int64_t>() <= std::numeric_limits<int>::max();
+    if(!inRange) {
+        return "Duration out of range";
+    }
+    return DecodedCreateTask{description->get<std::string>(), duration->get<int>()};
+}
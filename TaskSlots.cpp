@@ -0,0 +1,55 @@
+/*
+    Tasks addressed by generational index
+*/
+
+#include "TaskSlots.hpp"
+
+TaskSlots::TaskSlots() : m_size(0) {}
+
+TaskHandle TaskSlots::insert(std::shared_ptr<MockTask> task) {
+    uint32_t index;
+    if(!m_freeSlots.empty()) {
+        index = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        index = static_cast<uint32_t>(m_slots.size());
+        m_slots.emplace_back();
+    }
+    auto& slot = m_slots[index];
+    slot.task = std::move(task);
+    ++m_size;
+    return {index, slot.generation};
+}
+
+MockTask* TaskSlots::get(TaskHandle handle) const {
+    if(handle.index >= m_slots.size() || m_slots[handle.index].generation != handle.generation) {
+        return nullptr;
+    }
+    return m_slots[handle.index].task.get();
+}
+
+std::shared_ptr<MockTask> TaskSlots::share(TaskHandle handle) const {
+    if(get(handle) == nullptr) {
+        return nullptr;
+    }
+    return m_slots[handle.index].task;
+}
+
+std::shared_ptr<MockTask> TaskSlots::erase(TaskHandle handle) {
+    if(get(handle) == nullptr) {
+        return nullptr;
+    }
+    auto& slot = m_slots[handle.index];
+    auto task = std::move(slot.task);
+    // Skips 0 when it wraps, which default handles use
+    if(++slot.generation == 0) {
+        slot.generation = 1;
+    }
+    m_freeSlots.push_back(handle.index);
+    --m_size;
+    return task;
+}
+
+size_t TaskSlots::size() const {
+    return m_size;
+}
@@ -0,0 +1,39 @@
+/*
+    Where a node keeps its tasks beyond the process's memory
+*/
+
+#include "TaskStore.hpp"
+
+std::vector<MockTaskView> TaskStore::takeRecoveredTasks() {
+    return {};
+}
+
+uint64_t TaskStore::logCreate(const MockTaskView&) {
+    return 0;
+}
+
+uint64_t TaskStore::logStatus(const std::string&, MockTask::Status) {
+    return 0;
+}
+
+uint64_t TaskStore::logCancel(const std::string&) {
+    return 0;
+}
+
+uint64_t TaskStore::logRemove(const std::string&) {
+    return 0;
+}
+
+void TaskStore::commit(uint64_t) {}
+
+bool TaskStore::holdsFinishedTasks() const {
+    return false;
+}
+
+std::optional<MockTaskView> TaskStore::findTask(const std::string&) const {
+    return std::nullopt;
+}
+
+std::vector<MockTaskView> TaskStore::viewFinishedTasks() const {
+    return {};
+}
@@ -0,0 +1,380 @@
+/*
+    Task registry kept in memory-mapped files of fixed-size records
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "TaskTable.hpp"
+#include "Utils.hpp"
+
+namespace {
+    const char tableMagic[8] = {'T', 'A', 'S', 'K', 'T', 'B', 'L', '1'};
+    const char indexMagic[8] = {'T', 'A', 'S', 'K', 'I', 'D', 'X', '1'};
+    const uint64_t initialRecords = 1024;
+    const size_t initialDescriptionBytes = 64 << 10;
+    const uint64_t initialSlots = 4096;
+    // An index slot holds a record's position plus one, or one of these
+    const uint64_t emptySlot = 0;
+    const uint64_t deletedSlot = UINT64_MAX;
+    // Status byte of a removed task's record
+    const uint8_t removedStatus = 0xff;
+
+    bool isFinished(uint8_t status) {
+        return status == removedStatus || MockTask::isFinal(static_cast<MockTask::Status>(status));
+    }
+}
+
+struct TaskTable::Header {
+    char magic[8];
+    uint64_t records;
+    // Every record before this one is finished or removed
+    uint64_t firstUnfinished;
+    uint64_t descriptionBytes;
+    uint64_t reserved[4];
+};
+
+struct TaskTable::Record {
+    uint8_t idLength;
+    char id[MockTask::maxIdLength];
+    uint64_t descriptionOffset;
+    uint32_t descriptionLength;
+    int32_t duration;
+    uint8_t status;
+    uint8_t cancelled;
+    uint8_t reserved[6];
+};
+
+struct TaskTable::IndexHeader {
+    char magic[8];
+    uint64_t slots;
+    // Slots holding a record or deleted, which both lengthen probes
+    uint64_t used;
+    // Records before this one are in the index; later ones are added when
+    // the table is opened
+    uint64_t indexedRecords;
+};
+
+MappedFile::MappedFile(const std::string& path, size_t minimumSize) : m_fd(-1), m_data(nullptr), m_size(0) {
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(m_fd < 0) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    struct stat status;
+    if(::fstat(m_fd, &status) != 0) {
+        ::close(m_fd);
+        throw std::runtime_error("Can't read the size of " + path);
+    }
+    m_size = std::max(static_cast<size_t>(status.st_size), minimumSize);
+    if(static_cast<size_t>(status.st_size) < m_size && ::ftruncate(m_fd, m_size) != 0) {
+        ::close(m_fd);
+        throw std::runtime_error("Can't extend " + path);
+    }
+    void* data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if(data == MAP_FAILED) {
+        ::close(m_fd);
+        throw std::runtime_error("Can't map " + path);
+    }
+    m_data = static_cast<uint8_t*>(data);
+}
+
+MappedFile::~MappedFile() {
+    ::munmap(m_data, m_size);
+    ::close(m_fd);
+}
+
+void MappedFile::resize(size_t size) {
+    if(::ftruncate(m_fd, size) != 0) {
+        throw std::runtime_error("Can't resize a mapped file");
+    }
+    void* data = ::mremap(m_data, m_size, size, MREMAP_MAYMOVE);
+    if(data == MAP_FAILED) {
+        throw std::runtime_error("Can't remap a mapped file");
+    }
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+}
+
+uint8_t* MappedFile::data() const {
+    return m_data;
+}
+
+size_t MappedFile::size() const {
+    return m_size;
+}
+
+TaskTable::TaskTable(const std::string& path)
+: m_path(path), m_records(path, sizeof(Header) + initialRecords * sizeof(Record)),
+  m_descriptions(path + ".descriptions", initialDescriptionBytes) {
+    static_assert(sizeof(Record) == 64, "Task table records are 64 bytes on disk");
+    auto& head = header();
+    if(std::memcmp(head.magic, tableMagic, sizeof(tableMagic)) != 0) {
+        if(head.records != 0) {
+            throw std::runtime_error(path + " is not a task table");
+        }
+        std::memcpy(head.magic, tableMagic, sizeof(tableMagic));
+    }
+
+    m_index = std::make_unique<MappedFile>(path + ".index", sizeof(IndexHeader) + initialSlots * sizeof(uint64_t));
+    if(std::memcmp(indexHeader().magic, indexMagic, sizeof(indexMagic)) != 0
+       || indexHeader().indexedRecords > head.records) {
+        reindex();
+        return;
+    }
+    // Appended by a process that died before indexing them. Re-read through
+    // indexHeader() each time: index() may reindex, remapping the index and
+    // covering every record at once.
+    while(indexHeader().indexedRecords < header().records) {
+        index(indexHeader().indexedRecords);
+    }
+}
+
+TaskTable::Header& TaskTable::header() const {
+    return *reinterpret_cast<Header*>(m_records.data());
+}
+
+TaskTable::Record& TaskTable::record(uint64_t index) const {
+    return reinterpret_cast<Record*>(m_records.data() + sizeof(Header))[index];
+}
+
+TaskTable::IndexHeader& TaskTable::indexHeader() const {
+    return *reinterpret_cast<IndexHeader*>(m_index->data());
+}
+
+uint64_t* TaskTable::slots() const {
+    return reinterpret_cast<uint64_t*>(m_index->data() + sizeof(IndexHeader));
+}
+
+std::optional<uint64_t> TaskTable::findSlot(const std::string& id) const {
+    const auto mask = indexHeader().slots - 1;
+    const auto* table = slots();
+    for(auto slot = utils::stableHash(id) & mask;; slot = (slot + 1) & mask) {
+        const auto entry = table[slot];
+        if(entry == emptySlot) {
+            return std::nullopt;
+        }
+        if(entry != deletedSlot) {
+            const auto& candidate = record(entry - 1);
+            if(candidate.idLength == id.size() && std::memcmp(candidate.id, id.data(), id.size()) == 0) {
+                return slot;
+            }
+        }
+    }
+}
+
+std::optional<uint64_t> TaskTable::find(const std::string& id) const {
+    auto slot = findSlot(id);
+    if(!slot) {
+        return std::nullopt;
+    }
+    return slots()[*slot] - 1;
+}
+
+void TaskTable::insert(uint64_t recordIndex) {
+    const auto& task = record(recordIndex);
+    auto& head = indexHeader();
+    const auto mask = head.slots - 1;
+    auto* table = slots();
+    auto slot = utils::stableHash(std::string(task.id, task.idLength)) & mask;
+    while(table[slot] != emptySlot && table[slot] != deletedSlot) {
+        slot = (slot + 1) & mask;
+    }
+    if(table[slot] == emptySlot) {
+        ++head.used;
+    }
+    table[slot] = recordIndex + 1;
+}
+
+void TaskTable::index(uint64_t recordIndex) {
+    if((indexHeader().used + 1) * 2 > indexHeader().slots) {
+        reindex();
+        return;
+    }
+    if(record(recordIndex).status != removedStatus) {
+        insert(recordIndex);
+    }
+    indexHeader().indexedRecords = recordIndex + 1;
+}
+
+void TaskTable::reindex() {
+    const auto records = header().records;
+    uint64_t live = 0;
+    for(uint64_t i = 0; i < records; ++i) {
+        live += record(i).status != removedStatus;
+    }
+    auto slotCount = initialSlots;
+    while(slotCount < (live + 1) * 4) {
+        slotCount *= 2;
+    }
+
+    // Built aside and renamed over the old index, which stays valid until then
+    const auto temporary = m_path + ".index.tmp";
+    ::unlink(temporary.c_str());
+    m_index = std::make_unique<MappedFile>(temporary, sizeof(IndexHeader) + slotCount * sizeof(uint64_t));
+    auto& head = indexHeader();
+    std::memcpy(head.magic, indexMagic, sizeof(indexMagic));
+    head.slots = slotCount;
+    for(uint64_t i = 0; i < records; ++i) {
+        if(record(i).status != removedStatus) {
+            insert(i);
+        }
+    }
+    head.indexedRecords = records;
+    if(std::rename(temporary.c_str(), (m_path + ".index").c_str()) != 0) {
+        throw std::runtime_error("Can't rename " + temporary + " to " + m_path + ".index");
+    }
+}
+
+uint64_t TaskTable::appendDescription(const std::string& description) {
+    const auto offset = header().descriptionBytes;
+    if(offset + description.size() > m_descriptions.size()) {
+        auto size = m_descriptions.size();
+        while(size < offset + description.size()) {
+            size *= 2;
+        }
+        m_descriptions.resize(size);
+    }
+    std::memcpy(m_descriptions.data() + offset, description.data(), description.size());
+    header().descriptionBytes = offset + description.size();
+    return offset;
+}
+
+MockTaskView TaskTable::view(const Record& task) const {
+    MockTaskView view;
+    view.id.assign(task.id, task.idLength);
+    view.description = std::string(reinterpret_cast<const char*>(m_descriptions.data()) + task.descriptionOffset,
+                                   task.descriptionLength);
+    view.duration = task.duration;
+    view.status = MockTask::statusToString(static_cast<MockTask::Status>(task.status));
+    return view;
+}
+
+void TaskTable::skipFinished() {
+    auto& head = header();
+    while(head.firstUnfinished < head.records && isFinished(record(head.firstUnfinished).status)) {
+        ++head.firstUnfinished;
+    }
+}
+
+std::vector<MockTaskView> TaskTable::takeRecoveredTasks() {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<MockTaskView> tasks;
+    for(auto i = header().firstUnfinished; i < header().records; ++i) {
+        auto& task = record(i);
+        if(isFinished(task.status)) {
+            continue;
+        }
+        if(task.cancelled) {
+            task.status = MockTask::Status::Cancelled;
+            continue;
+        }
+        if(task.status == MockTask::Status::Running) {
+            // Its worker died with the previous process
+            task.status = MockTask::Status::Waiting;
+        }
+        tasks.push_back(view(task));
+    }
+    skipFinished();
+    return tasks;
+}
+
+uint64_t TaskTable::logCreate(const MockTaskView& task) {
+    if(task.id.size() > MockTask::maxIdLength) {
+        throw std::invalid_argument("Task id too long for the task table: " + task.id);
+    }
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    const auto descriptionOffset = appendDescription(task.description.str());
+    auto existing = find(task.id);
+    auto position = existing ? *existing : header().records;
+    if(!existing) {
+        const auto capacity = (m_records.size() - sizeof(Header)) / sizeof(Record);
+        if(position == capacity) {
+            m_records.resize(sizeof(Header) + 2 * capacity * sizeof(Record));
+        }
+    }
+
+    auto& stored = record(position);
+    std::memset(&stored, 0, sizeof(Record));
+    stored.idLength = static_cast<uint8_t>(task.id.size());
+    std::memcpy(stored.id, task.id.data(), task.id.size());
+    stored.descriptionOffset = descriptionOffset;
+    stored.descriptionLength = static_cast<uint32_t>(task.description.size());
+    stored.duration = task.duration;
+    stored.status = static_cast<uint8_t>(MockTask::statusFromString(task.status));
+
+    if(existing) {
+        // Handed away earlier and back again
+        header().firstUnfinished = std::min(header().firstUnfinished, position);
+    } else {
+        header().records = position + 1;
+        index(position);
+    }
+    skipFinished();
+    return 0;
+}
+
+uint64_t TaskTable::logStatus(const std::string& id, MockTask::Status status) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto position = find(id);
+    if(!position || isFinished(record(*position).status)) {
+        return 0;
+    }
+    record(*position).status = status;
+    skipFinished();
+    return 0;
+}
+
+uint64_t TaskTable::logCancel(const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto position = find(id);
+    if(position) {
+        record(*position).cancelled = 1;
+    }
+    return 0;
+}
+
+uint64_t TaskTable::logRemove(const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto slot = findSlot(id);
+    if(!slot) {
+        return 0;
+    }
+    auto& entry = slots()[*slot];
+    record(entry - 1).status = removedStatus;
+    entry = deletedSlot;
+    skipFinished();
+    return 0;
+}
+
+bool TaskTable::holdsFinishedTasks() const {
+    return true;
+}
+
+std::optional<MockTaskView> TaskTable::findTask(const std::string& id) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto position = find(id);
+    if(!position) {
+        return std::nullopt;
+    }
+    return view(record(*position));
+}
+
+std::vector<MockTaskView> TaskTable::viewFinishedTasks() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<MockTaskView> tasks;
+    for(uint64_t i = 0; i < header().records; ++i) {
+        const auto& task = record(i);
+        if(task.status != removedStatus && MockTask::isFinal(static_cast<MockTask::Status>(task.status))) {
+            tasks.push_back(view(task));
+        }
+    }
+    return tasks;
+}
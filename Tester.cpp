@@ -5,14 +5,24 @@ Tester for the HTTP web server
 #include <curl/curl.h>
 
 #include <chrono>
+#include <functional>
 #include <thread>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 
 using json = nlohmann::json;
 
+// A response with its status code and media type, for the checks that need
+// more than the JSON body
+struct HttpResponse {
+    long code = 0;
+    std::string contentType;
+    std::string body;
+};
+
 size_t WriteCallback(char *contents, size_t size, size_t nmemb, void *userp)
 {
     (static_cast<std::string*>(userp))->append(contents, size * nmemb);
@@ -93,6 +103,41 @@ public:
         return json::parse(m_response);
     }
 
+    // Sends any request to path, such as "/counts", with the given headers
+    HttpResponse makeRequest(const std::string& method, const std::string& path, const std::string& body = "",
+                             const std::vector<std::string>& headers = {}) {
+        HttpResponse result;
+        CURL* handle = curl_easy_init();
+        struct curl_slist* slist = NULL;
+        for(const auto& header : headers) {
+            slist = curl_slist_append(slist, header.c_str());
+        }
+        std::string url = "http://localhost:3000" + path;
+        curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, method.c_str());
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, slist);
+        if(method == "POST") {
+            // Binary bodies may hold NUL bytes
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDS, body.data());
+            curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(body.size()));
+        }
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &result.body);
+        curl_easy_perform(handle);
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &result.code);
+        char* contentType = NULL;
+        curl_easy_getinfo(handle, CURLINFO_CONTENT_TYPE, &contentType);
+        if(contentType != NULL) {
+            result.contentType = contentType;
+        }
+        const bool text = result.contentType.empty() || result.contentType == "application/json";
+        std::cout << "Response is " << result.code << " "
+                  << (text ? result.body : std::to_string(result.body.size()) + " bytes of " + result.contentType) << std::endl;
+        curl_easy_cleanup(handle);
+        curl_slist_free_all(slist);
+        return result;
+    }
+
     ~Client(){
         curl_global_cleanup();
     }
@@ -169,6 +214,94 @@ log("[TEST] Should receive the information for both tasks:");
 log(evaluate(cl.makeGetAllTasksRequest(), [](const json& resp){ return resp.size()== 2; } ));
 log("");
 
+log("Filtering tasks by status...");
+log("[TEST] Should only list the finished task:");
+log(evaluate(json::parse(cl.makeRequest("GET", "/taches?status=Finished").body),
+            [&id](const json& resp){ return resp.is_array() && resp.size() == 1 && resp[0]["id"] == id; }));
+log("");
+
+log("Filtering tasks by an unknown status...");
+auto filtered = cl.makeRequest("GET", "/taches?status=Sleeping");
+log("[TEST] Should receive 400 with an unknown status error:");
+log(filtered.code == 400 && json::parse(filtered.body, nullptr, false).value("error", "") == "Unknown status"
+    ? "PASS" : "FAIL");
+log("");
+
+log("Counting tasks by status...");
+log("[TEST] Should count every status, one finished and one cancelled task:");
+log(evaluate(json::parse(cl.makeRequest("GET", "/counts").body), [](const json& resp){
+        size_t total = 0;
+        for(const auto* status : {"Waiting", "Running", "Finished", "Cancelled", "Failed"}) {
+            if(!resp.contains(status) || !resp[status].is_number_unsigned()) {
+                return false;
+            }
+            total += resp[status].get<size_t>();
+        }
+        return total == 2 && resp["Finished"] == 1 && resp["Cancelled"] == 1;
+    }));
+log("");
+
+log("Creating tasks from bad bodies...");
+const std::vector<std::pair<std::string, std::string>> badBodies = {
+    {"malformed", "{\"description\": \"unterminated"},
+    {"non-object", "[\"description\", 1000]"},
+    {"string duration", "{\"description\": \"bad\", \"duration\": \"1000\"}"},
+    {"numeric description", "{\"description\": 42, \"duration\": 1000}"},
+    {"missing duration", "{\"description\": \"bad\"}"}
+};
+for(const auto& [name, body] : badBodies) {
+    auto created = cl.makeRequest("POST", "/taches", body, {"Content-Type: application/json"});
+    log("[TEST] A " + name + " body should receive 400 with an error:");
+    const auto error = json::parse(created.body, nullptr, false);
+    log(created.code == 400 && error.is_object() && error.contains("error") ? "PASS" : "FAIL");
+}
+log("");
+
+log("Creating a task with escaped member names...");
+auto escapedKeys = cl.makeRequest("POST", "/taches", "{\"descr\\u0069ption\": \"escaped\", \"dur\\u0061tion\": 1}",
+                                  {"Content-Type: application/json"});
+log("[TEST] Escaped member names should be read like plain ones:");
+log(escapedKeys.code == 200 && json::parse(escapedKeys.body, nullptr, false).value("description", "") == "escaped"
+    ? "PASS" : "FAIL");
+log("");
+
+log("Asking for a media type the server doesn't serve...");
+log("[TEST] Accept: text/plain should receive 406:");
+log(cl.makeRequest("GET", "/taches", "", {"Accept: text/plain"}).code == 406 ? "PASS" : "FAIL");
+log("");
+
+// Each binary format in turn, decoded back with nlohmann
+const std::vector<std::pair<std::string, std::function<json(const std::string&)>>> binaryTypes = {
+    {"application/msgpack", [](const std::string& body){ return json::from_msgpack(body, true, false); }},
+    {"application/cbor", [](const std::string& body){ return json::from_cbor(body, true, false); }}
+};
+for(const auto& [type, decode] : binaryTypes) {
+    log("Listing and getting tasks as " + type + "...");
+    auto listing = cl.makeRequest("GET", "/taches", "", {"Accept: " + type});
+    log("[TEST] The listing should be " + type + " and hold the finished task:");
+    const auto tasks = decode(listing.body);
+    bool found = false;
+    for(const auto& task : tasks) {
+        found = found || (task.is_object() && task.value("id", "") == id);
+    }
+    log(listing.contentType == type && tasks.is_array() && found ? "PASS" : "FAIL");
+
+    auto single = cl.makeRequest("GET", "/taches/" + id, "", {"Accept: " + type});
+    log("[TEST] The task should be " + type + " and match its JSON:");
+    log(single.contentType == type && decode(single.body) == cl.makeGetTaskRequest(id) ? "PASS" : "FAIL");
+    log("");
+}
+
+log("Creating a task from a MessagePack body...");
+const auto packed = json::to_msgpack(json{{"description", "packed"}, {"duration", 1}});
+auto packedTask = cl.makeRequest("POST", "/taches", std::string(packed.begin(), packed.end()),
+                                 {"Content-Type: application/msgpack", "Accept: application/msgpack"});
+log("[TEST] Should create the task and answer in MessagePack:");
+const auto created = json::from_msgpack(packedTask.body, true, false);
+log(packedTask.code == 200 && packedTask.contentType == "application/msgpack" && created.is_object()
+    && created.value("description", "") == "packed" ? "PASS" : "FAIL");
+log("");
+
 // // Test task multithreading
 
 // log("Creating 3 tasks to occupy both worker threads and have a waiting third task...");
@@ -14,4 +14,26 @@ std::string generateUUID() {
     boost::uuids::uuid id = boost::uuids::random_generator()();
     return boost::uuids::to_string(id);
 }
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    for(;;) {
+        auto end = text.find(separator, start);
+        parts.push_back(text.substr(start, end - start));
+        if(end == std::string::npos) {
+            return parts;
+        }
+        start = end + 1;
+    }
+}
+
+uint64_t stableHash(const std::string& text) {
+    uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
 }
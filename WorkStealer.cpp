@@ -0,0 +1,128 @@
+/*
+    Work stealing between worker nodes that tasks are pushed to
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include "WorkStealer.hpp"
+
+namespace {
+    const auto heartbeatInterval = std::chrono::milliseconds(200);
+    // A peer with a shorter queue isn't worth a round trip
+    const size_t minVictimBacklog = 4;
+    // Tasks asked for per idle thread, so the thief has the next one queued
+    // by the time it finishes the first
+    const size_t tasksPerIdleWorker = 2;
+}
+
+WorkStealer::WorkStealer(TaskManager& taskManager, unsigned short port, const std::vector<std::string>& peers)
+: m_taskManager(taskManager), m_port(port) {
+    for(const auto& address : peers) {
+        Peer peer;
+        peer.node = std::make_shared<RemoteNode>(address);
+        m_peers.push_back(peer);
+    }
+}
+
+void WorkStealer::run() {
+    for(;;) {
+        std::this_thread::sleep_for(heartbeatInterval);
+        exchangeHeartbeats();
+        stealIfIdle();
+    }
+}
+
+void WorkStealer::exchangeHeartbeats() {
+    for(auto& peer : m_peers) {
+        try {
+            peer.load = peer.node->heartbeatPeer();
+            peer.reachable = true;
+        } catch(const std::exception&) {
+            peer.reachable = false;
+        }
+    }
+}
+
+void WorkStealer::stealIfIdle() {
+    const auto load = m_taskManager.getLoad();
+    if(load.waiting > 0 || load.idleWorkers == 0) {
+        return;
+    }
+
+    auto victim = std::max_element(m_peers.begin(), m_peers.end(), [](const Peer& a, const Peer& b) {
+        return !a.reachable || (b.reachable && a.load.waiting < b.load.waiting);
+    });
+    if(victim == m_peers.end() || !victim->reachable || victim->load.waiting < minVictimBacklog) {
+        return;
+    }
+
+    std::vector<MockTaskView> stolen;
+    try {
+        stolen = victim->node->stealTasks(m_port, tasksPerIdleWorker * load.idleWorkers);
+    } catch(const std::exception& e) {
+        std::cout << "Error: couldn't steal from " << victim->node->getAddress() << ": " << e.what() << std::endl;
+        return;
+    }
+    if(stolen.empty()) {
+        return;
+    }
+
+    {
+        // Marked before they are queued, so they can't be given away again
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& task : stolen) {
+            m_stolen.insert(task.id);
+        }
+    }
+    for(const auto& task : stolen) {
+        m_taskManager.submitTask(task);
+    }
+    // Don't steal again from the same stale load figure
+    victim->load.waiting -= std::min(victim->load.waiting, stolen.size());
+    std::cout << "Stole " << stolen.size() << " tasks from " << victim->node->getAddress() << std::endl;
+}
+
+TaskLoad WorkStealer::getLoad() const {
+    return m_taskManager.getLoad();
+}
+
+std::vector<MockTaskView> WorkStealer::giveTasks(const std::string& thiefAddress, size_t maxTasks) {
+    // The thief saw an older figure; only a backlog still worth splitting is split
+    const auto load = m_taskManager.getLoad();
+    if(load.waiting < minVictimBacklog) {
+        return {};
+    }
+    const auto count = std::min(maxTasks, load.waiting / 2);
+
+    std::unordered_set<std::string> stolen;
+    std::shared_ptr<RemoteNode> thief;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stolen = m_stolen;
+        auto& node = m_thieves[thiefAddress];
+        if(node == nullptr) {
+            node = std::make_shared<RemoteNode>(thiefAddress);
+        }
+        thief = node;
+    }
+
+    auto given = m_taskManager.takeWaitingTasks(count, stolen);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& task : given) {
+        m_givenTo[task.id] = thief;
+    }
+    return given;
+}
+
+std::shared_ptr<RemoteNode> WorkStealer::findThief(const std::string& id) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_givenTo.find(id);
+    return it == m_givenTo.end() ? nullptr : it->second;
+}
+
+void WorkStealer::taskReturned(const std::string& id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_givenTo.erase(id);
+}
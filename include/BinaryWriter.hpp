@@ -0,0 +1,44 @@
+/*
+    MessagePack and CBOR responses written straight to bytes
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ResponseWriter.hpp"
+
+// Writes responses as MessagePack or CBOR, the same maps, arrays, strings and
+// integers as the JSON ones. Neither format escapes strings or spells out
+// numbers, so they are smaller and cheaper to read back than JSON; each
+// value is written with the shortest header that holds it.
+class BinaryWriter : public ResponseWriter {
+public:
+    // format is MediaType::MessagePack or MediaType::Cbor
+    explicit BinaryWriter(MediaType format);
+
+    MediaType mediaType() const override;
+    void task(const MockTaskView& task) override;
+    void tasks(const std::vector<MockTaskView>& tasks) override;
+    void counts(const TaskCounts& counts) override;
+    void message(std::string_view key, std::string_view value) override;
+private:
+    enum class Container {
+        Map,
+        Array,
+        String
+    };
+
+    // The header of a map of length pairs, an array of length values or a
+    // string of length bytes
+    void header(Container container, size_t length);
+    void string(std::string_view value);
+    void integer(int64_t value);
+    // A type byte followed by value in bytes bytes, big-endian
+    void typed(uint8_t type, uint64_t value, int bytes);
+    // The CBOR head of an item of major type major with argument value
+    void cborHead(uint8_t major, uint64_t value);
+
+    MediaType m_format;
+};
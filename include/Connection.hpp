@@ -0,0 +1,84 @@
+/*
+    Client connection speaking the binary protocol to another node
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include "Protocol.hpp"
+
+using Acceptor = boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol>;
+
+// Addresses are "host:port" for TCP, or "unix:/path/to/socket" for a Unix
+// domain socket on this machine.
+// Opens a connection, with Nagle's algorithm off for TCP
+protocol::Socket connectTo(boost::asio::io_context& io, const std::string& address);
+// Listens on an address, or on a bare port number on every interface. A stale
+// socket file left by an earlier process is removed first.
+Acceptor listenOn(boost::asio::io_context& io, const std::string& address);
+
+// One persistent connection, opened on first use and reopened after a failure.
+// Requests from any number of threads share it: each gets an id, and a reader
+// thread hands every response to the request with the same id, so callers
+// don't wait for each other's round trips.
+class Connection {
+public:
+    Connection(const std::string& address);
+    ~Connection();
+
+    // Sends a request without waiting for the response. The future throws on
+    // network or protocol errors.
+    std::future<protocol::Frame> send(protocol::MessageType type, const protocol::Writer& request);
+    // Sends a request and waits for its response, retrying once on a fresh
+    // connection only if the request never left. Throws on network or
+    // protocol errors.
+    protocol::Frame call(protocol::MessageType type, const protocol::Writer& request);
+    const std::string& getAddress() const;
+private:
+    struct Pending {
+        protocol::MessageType type;
+        std::promise<protocol::Frame> response;
+    };
+
+    // A reader thread, with the flag it sets as it exits
+    struct Reader {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    // Opens the connection if it isn't open; returns whether it was already.
+    // Moves retired readers that have exited into finished, to be joined once
+    // m_mutex is released.
+    std::shared_ptr<protocol::Socket> open(bool& reused, std::vector<std::thread>& finished);
+    void readResponses(std::shared_ptr<protocol::Socket> socket, std::shared_ptr<std::atomic<bool>> done);
+    // Fails every request waiting on socket and drops it
+    void fail(const std::shared_ptr<protocol::Socket>& socket, std::exception_ptr error);
+    // Sets unsent if writing the request to a reused socket failed, so the
+    // peer never saw it
+    std::future<protocol::Frame> send(protocol::MessageType type, const protocol::Writer& request, bool& unsent);
+
+    std::string m_address;
+    boost::asio::io_context m_io;
+    // Guards everything below but writes to the socket
+    std::mutex m_mutex;
+    std::shared_ptr<protocol::Socket> m_socket;
+    Reader m_reader;
+    // Readers of earlier sockets, which exit once their socket is shut down
+    std::vector<Reader> m_retiredReaders;
+    uint32_t m_nextRequestId;
+    std::unordered_map<uint32_t, Pending> m_pending;
+    // Keeps frames from different requests from interleaving
+    std::mutex m_writeMutex;
+};
@@ -0,0 +1,68 @@
+/*
+    Coordinator that spreads tasks over remote worker nodes
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "HashRing.hpp"
+#include "RemoteNode.hpp"
+#include "TaskManager.hpp"
+
+// Partitions the task id space over worker nodes with a consistent hash ring.
+// The coordinator picks each new task's id, so it keeps no record of where
+// tasks went: any coordinator with the same members finds a task's node from
+// its id alone, and several coordinators can front the same workers.
+//
+// Placement uses consistent hashing with bounded loads: an id whose node
+// already holds more unfinished tasks than loadFactor times the average is
+// redrawn, which steers tasks away from hot nodes without breaking id-based
+// lookups. Loads are counted up with each placement and reset from the
+// nodes' own counts every second, so finished tasks stop counting and a node
+// that joins late is only favoured until it catches up.
+class Coordinator : public TaskBackend {
+public:
+    Coordinator(const std::vector<std::string>& workerAddresses, size_t virtualNodes = 128, double loadFactor = 1.25);
+
+    std::string executeCreateTask(const std::string& description, int duration) override;
+    MockTaskView viewTask(const std::string& id) const override;
+    std::vector<MockTaskView> viewAllTasks() const override;
+    bool cancelTask(const std::string& id) override;
+    TaskCounts countTasks() const override;
+
+    // Membership changes. Only tasks on the arcs that change hands move to
+    // their new node; running tasks move once they are done and are looked up
+    // on the node still holding them until then.
+    void addNode(const std::string& address);
+    void removeNode(const std::string& address);
+    std::vector<std::string> getNodes() const;
+private:
+    // Node to ask about a task, following moves that haven't happened yet
+    std::shared_ptr<RemoteNode> findHolder(const std::string& id) const;
+    // Moves tasks on source that the ring assigns elsewhere
+    void handOff(const std::shared_ptr<RemoteNode>& source);
+    bool moveTask(const std::string& id, RemoteNode& from);
+    void retryPendingMoves();
+    // Replaces the placement counts with the nodes' waiting and running tasks
+    void refreshLoads();
+
+    HashRing m_ring;
+    double m_loadFactor;
+    std::unordered_map<std::string, std::shared_ptr<RemoteNode>> m_nodes;
+    // Unfinished tasks on each node, for the load bound
+    std::unordered_map<std::string, size_t> m_loads;
+    size_t m_totalLoad;
+    // Tasks still held by a node other than their owner on the ring
+    mutable std::unordered_map<std::string, std::shared_ptr<RemoteNode>> m_pendingMoves;
+    mutable std::mutex m_mutex;
+    // Serializes membership changes, which run long hand-offs outside m_mutex
+    mutable std::mutex m_membershipMutex;
+    // Retries moves of tasks that were running when their hand-off started
+    std::thread m_mover;
+};
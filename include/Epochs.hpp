@@ -0,0 +1,43 @@
+/*
+    Epoch-based reclamation of shared objects
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+// Lets readers use objects that writers may remove concurrently, without
+// taking a lock. A reader holds a Guard while it uses them; a writer that
+// unlinks one retires it instead of freeing it, and it is freed once every
+// guard that could have seen it is released. Guards only publish the epoch
+// they started in, so readers never wait, on writers or on each other.
+//
+// The epoch advances once every thread holding a guard has seen the current
+// one, so a retired object is freed two epochs after it was retired.
+class Epochs {
+public:
+    // Guards may nest
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    // Calls free once no guard held now is still held. retire() frees
+    // what it can every so often.
+    static void retire(std::function<void()> free);
+    // Advances the epoch if every reader allows it, and frees what no reader
+    // can still see
+    static void reclaim();
+    // Retired objects not freed yet
+    static size_t pending();
+private:
+    struct Record;
+    // Every thread's record, newest first
+    static std::atomic<Record*>& records();
+    // This thread's
+    static Record& record();
+};
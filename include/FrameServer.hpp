@@ -0,0 +1,33 @@
+/*
+    Accept loop shared by the servers speaking the binary protocol
+*/
+
+#pragma once
+
+#include <string>
+
+#include <boost/asio/io_context.hpp>
+
+#include "Connection.hpp"
+#include "Protocol.hpp"
+
+// Accepts connections on a TCP or Unix domain address and serves each one on
+// its own thread. Requests on a connection are handled in order, each
+// response carrying its request's id; clients pipeline requests rather than
+// wait for each response.
+class FrameServer {
+public:
+    // listenAddress is a port, "host:port" or "unix:/path"
+    FrameServer(const std::string& listenAddress);
+    virtual ~FrameServer() = default;
+    // Accepts connections forever
+    void run();
+protected:
+    // remoteHost is the peer's IP address, or "localhost" over a Unix socket
+    virtual void handle(const protocol::Frame& request, protocol::Writer& response, const std::string& remoteHost) = 0;
+private:
+    void serve(protocol::Socket socket);
+
+    boost::asio::io_context m_io;
+    Acceptor m_acceptor;
+};
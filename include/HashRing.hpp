@@ -0,0 +1,38 @@
+/*
+    Consistent hash ring mapping task ids to the nodes that own them
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Each node is placed at many pseudo-random points ("virtual nodes") on a
+// 64-bit ring and owns the keys between its points and the previous ones.
+// Adding or removing a node only moves the keys on that node's arcs, about
+// 1/N of them, and the virtual nodes keep the arcs evenly sized.
+class HashRing {
+public:
+    HashRing(size_t virtualNodes = 128);
+
+    void addNode(const std::string& node);
+    void removeNode(const std::string& node);
+    bool hasNode(const std::string& node) const;
+    const std::vector<std::string>& getNodes() const;
+    bool empty() const;
+
+    // Node owning key. The ring must not be empty.
+    const std::string& ownerOf(const std::string& key) const;
+
+    // Stable across processes and platforms, unlike std::hash
+    static uint64_t hash(const std::string& key);
+private:
+    void rebuild();
+
+    size_t m_virtualNodes;
+    std::vector<std::string> m_nodes;
+    // (ring position, index into m_nodes), sorted by position
+    std::vector<std::pair<uint64_t, size_t>> m_points;
+};
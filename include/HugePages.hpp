@@ -0,0 +1,43 @@
+/*
+    Large allocations backed by huge pages
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// Memory for the big, long-lived arrays behind the registry: task slabs and
+// index tables. Scanning millions of tasks touches thousands of 4KB pages,
+// more than the TLB holds, so most accesses to a fresh page miss it. Backed
+// by 2MB pages the same memory needs a few hundred entries.
+//
+// Explicit mode asks for pages from the kernel's reserved huge page pool
+// (vm.nr_hugepages) and falls back to transparent ones once it runs dry.
+// Transparent mode maps 2MB-aligned memory and advises the kernel to back it
+// with huge pages, which it does when THP is set to "always" or "madvise".
+// Off keeps ordinary pages, e.g. to compare. Requests smaller than a huge
+// page come from the heap whatever the mode.
+class HugePages {
+public:
+    enum class Mode {
+        Off,
+        Transparent,
+        Explicit
+    };
+
+    static const size_t pageSize = 2 << 20;
+
+    // Applies to later allocations only, so set it before creating tasks
+    static void setMode(Mode mode);
+    static Mode getMode();
+
+    // Never fails short of running out of memory, in which case it throws
+    // std::bad_alloc
+    static void* allocate(size_t bytes);
+    // bytes must be what was asked of allocate
+    static void deallocate(void* memory, size_t bytes);
+};
+
+std::optional<HugePages::Mode> hugePagesFromString(const std::string& mode);
@@ -0,0 +1,74 @@
+/*
+    String stored inside its owner when it is short enough
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Holds up to Capacity bytes in place and longer strings on the heap. Unlike
+// std::string, whose in-place buffer takes 15 bytes, Capacity can be sized so
+// that the strings an object usually holds, such as UUIDs, never allocate, and
+// the whole string takes Capacity + 4 bytes.
+template<size_t Capacity>
+class InlineString {
+    static_assert(Capacity >= sizeof(char*), "An inline string must have room for a heap pointer");
+public:
+    InlineString() : m_size(0) {}
+    InlineString(const std::string& value) {
+        assign(value.data(), value.size());
+    }
+    InlineString(const InlineString& other) {
+        assign(other.data(), other.m_size);
+    }
+    InlineString& operator=(const InlineString& other) {
+        if(this != &other) {
+            release();
+            assign(other.data(), other.m_size);
+        }
+        return *this;
+    }
+    ~InlineString() {
+        release();
+    }
+
+    const char* data() const {
+        return m_size <= Capacity ? m_bytes : heap();
+    }
+    size_t size() const {
+        return m_size;
+    }
+    std::string str() const {
+        return std::string(data(), m_size);
+    }
+private:
+    // The heap pointer is kept unaligned in the buffer, so that the string
+    // only needs the alignment of its size
+    char* heap() const {
+        char* pointer;
+        std::memcpy(&pointer, m_bytes, sizeof(pointer));
+        return pointer;
+    }
+
+    void assign(const char* data, size_t size) {
+        m_size = static_cast<uint32_t>(size);
+        if(size <= Capacity) {
+            std::memcpy(m_bytes, data, size);
+            return;
+        }
+        char* pointer = new char[size];
+        std::memcpy(pointer, data, size);
+        std::memcpy(m_bytes, &pointer, sizeof(pointer));
+    }
+
+    void release() {
+        if(m_size > Capacity) {
+            delete[] heap();
+        }
+    }
+
+    uint32_t m_size;
+    char m_bytes[Capacity];
+};
@@ -0,0 +1,47 @@
+/*
+    String stored once however many objects hold it
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Handle to a string kept in a process-wide pool, where equal strings share
+// one copy. Tasks submitted by the million usually carry a few thousand
+// distinct descriptions, so holding one costs a pointer rather than the
+// string, and copying one, e.g. into a view, costs an atomic increment rather
+// than an allocation. Strings are counted and leave the pool with their last
+// handle, so distinct strings don't pile up. Creating a handle from a string
+// looks it up under one of several locks, picked by hash.
+class InternedString {
+public:
+    InternedString() : m_entry(nullptr) {}
+    InternedString(const std::string& value);
+    InternedString(const char* value);
+    InternedString(const InternedString& other);
+    InternedString(InternedString&& other) noexcept;
+    InternedString& operator=(InternedString other) noexcept;
+    ~InternedString();
+
+    const std::string& str() const;
+    size_t size() const;
+    bool empty() const;
+    // Equal strings are the same entry, so this compares pointers
+    bool operator==(const InternedString& other) const {
+        return m_entry == other.m_entry;
+    }
+    bool operator!=(const InternedString& other) const {
+        return m_entry != other.m_entry;
+    }
+
+    // Distinct strings in the pool
+    static size_t poolSize();
+private:
+    struct Entry;
+    struct Shard;
+    static Shard& shard(size_t hash);
+
+    // nullptr for the empty string
+    Entry* m_entry;
+};
@@ -0,0 +1,25 @@
+/*
+    JSON responses written straight to text
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "ResponseWriter.hpp"
+
+// Writes responses as JSON text, without building the tree of values
+// crow::json::wvalue makes first, a map per task. Integers are formatted with
+// std::to_chars, and strings with nothing to escape, ids and statuses always
+// and descriptions nearly always, are copied whole.
+class JsonWriter : public ResponseWriter {
+public:
+    MediaType mediaType() const override;
+    void task(const MockTaskView& task) override;
+    void tasks(const std::vector<MockTaskView>& tasks) override;
+    void counts(const TaskCounts& counts) override;
+    void message(std::string_view key, std::string_view value) override;
+private:
+    void string(std::string_view value);
+    void integer(int64_t value);
+};
@@ -0,0 +1,34 @@
+/*
+    Worker node side of the lease protocol: pulls tasks from a coordinator
+    and runs them on the local task manager
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "RemoteNode.hpp"
+#include "TaskManager.hpp"
+
+class LeaseWorker {
+public:
+    // capacity is how many leased tasks may be running or queued here at once
+    LeaseWorker(TaskManager& taskManager, const std::string& coordinatorAddress, size_t capacity);
+    // Leases, runs and reports tasks forever
+    void run();
+    const std::string& getWorkerId() const;
+private:
+    void sendHeartbeat();
+    size_t countActiveTasks() const;
+
+    TaskManager& m_taskManager;
+    RemoteNode m_coordinator;
+    std::string m_workerId;
+    size_t m_capacity;
+    // Leased tasks whose final status the coordinator hasn't acknowledged yet
+    std::vector<std::string> m_held;
+    std::chrono::milliseconds m_heartbeatInterval;
+    std::chrono::steady_clock::time_point m_nextHeartbeat;
+};
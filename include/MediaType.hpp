@@ -0,0 +1,31 @@
+/*
+    Media types of REST request and response bodies
+*/
+
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+// JSON, or the same documents in MessagePack or CBOR for clients that would
+// rather not parse text
+enum class MediaType {
+    Json,
+    MessagePack,
+    Cbor
+};
+
+// application/json, application/msgpack or application/cbor
+const char* mediaTypeToString(MediaType type);
+// Also takes application/x-msgpack and application/vnd.msgpack, ignores
+// case and parameters such as charset, and returns nothing for other types
+std::optional<MediaType> mediaTypeFromString(std::string_view type);
+
+// The type of a request body from its Content-Type header. Bodies of any type
+// but MessagePack and CBOR are read as JSON, as they were before there was a
+// choice, so that clients sending none or a generic one keep working.
+MediaType requestMediaType(std::string_view contentType);
+// The type to answer in given an Accept header: the supported one with the
+// highest quality, the first listed on a tie. Wildcards and no header at all
+// mean JSON. Returns nothing if none is acceptable.
+std::optional<MediaType> acceptedMediaType(std::string_view accept);
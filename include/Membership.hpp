@@ -0,0 +1,149 @@
+/*
+    Cluster membership and failure detection by SWIM-style gossip over UDP
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "Protocol.hpp"
+
+enum class MemberRole : uint8_t {
+    Coordinator,
+    // Serves the binary protocol for a coordinator to push tasks to
+    Worker,
+    // Pulls tasks from a coordinator; its id is its lease worker id
+    LeaseWorker
+};
+
+struct MemberInfo {
+    // Worker address "host:port" for Worker and Coordinator, the lease
+    // worker id for LeaseWorker
+    std::string id;
+    MemberRole role;
+    // Where the member gossips, "host:port"
+    std::string gossipAddress;
+};
+
+// Tracks which nodes are alive without any node polling all the others.
+//
+// Every protocol period each member pings one other member, going round a
+// shuffled list. A member that doesn't answer is pinged again through a few
+// others, so one lossy link doesn't condemn it, and is then suspected. A
+// suspected member that doesn't refute the suspicion within a timeout growing
+// with log(cluster size) is declared dead. Membership changes travel on the
+// pings and acks themselves, each retransmitted a number of times growing with
+// log(cluster size), so every member sends a constant number of messages per
+// period whatever the cluster size.
+//
+// A failed member is first suspected by someone within a few periods on
+// average, and declared dead by everyone a suspicion timeout later.
+class Membership {
+public:
+    // Told when a member joins or comes back (alive) and when it is declared
+    // dead. Runs on a thread of its own, in the order the changes happened.
+    using Listener = std::function<void(const MemberInfo& member, bool alive)>;
+
+    // Gossips on port, which others reach at self.gossipAddress. seeds are
+    // gossip addresses of members to join through; a member started without
+    // seeds waits for others to join it.
+    Membership(const MemberInfo& self, unsigned short port, const std::vector<std::string>& seeds, Listener listener);
+    void start();
+
+    std::vector<MemberInfo> getAliveMembers() const;
+private:
+    enum class State : uint8_t {
+        Alive,
+        Suspect,
+        Dead
+    };
+
+    enum class MessageKind : uint8_t {
+        Ping = 1,
+        Ack,
+        PingRequest,
+        // A ping asking for every member in the ack, sent to seeds on start
+        Join
+    };
+
+    struct Member {
+        MemberInfo info;
+        State state;
+        // Raised by the member itself to refute a suspicion; a restarted
+        // member starts from the clock, above what it had before
+        uint64_t incarnation;
+        std::chrono::steady_clock::time_point suspectedAt;
+        std::optional<boost::asio::ip::udp::endpoint> endpoint;
+    };
+
+    struct Event {
+        MemberInfo member;
+        bool alive;
+    };
+
+    // A ping sent for another member, whose ack goes back to the requester
+    struct Relay {
+        boost::asio::ip::udp::endpoint requester;
+        uint32_t requesterSeq;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    // Everything below runs with m_mutex held unless noted
+    void writeMember(protocol::Writer& writer, const Member& member) const;
+    void writeUpdates(protocol::Writer& writer, bool everyone);
+    void merge(const MemberInfo& info, State state, uint64_t incarnation);
+    void changeState(Member& member, State state, uint64_t incarnation);
+    void broadcast(const std::string& id);
+    std::optional<boost::asio::ip::udp::endpoint> endpointOf(Member& member);
+    void send(const boost::asio::ip::udp::endpoint& to, MessageKind kind, uint32_t seq, const std::string& target = "");
+    size_t retransmissions() const;
+    std::chrono::milliseconds suspicionTimeout() const;
+    void expireSuspects();
+    std::optional<std::string> nextProbeTarget();
+    std::vector<std::string> pickHelpers(const std::string& target);
+
+    // Thread bodies, which take m_mutex themselves
+    void runProber();
+    void runReceiver();
+    void runNotifier();
+    void probe(const std::string& id, std::chrono::steady_clock::time_point periodEnd);
+    void handle(const std::vector<uint8_t>& datagram, const boost::asio::ip::udp::endpoint& from);
+
+    MemberInfo m_self;
+    uint64_t m_incarnation;
+    std::vector<std::string> m_seeds;
+    Listener m_listener;
+
+    boost::asio::io_context m_io;
+    boost::asio::ip::udp::socket m_socket;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_acked;
+    std::unordered_map<std::string, Member> m_members;
+    // Ids whose latest state still has to be piggybacked, and how many more
+    // times
+    std::unordered_map<std::string, size_t> m_broadcasts;
+    std::vector<std::string> m_probeOrder;
+    size_t m_probeIndex;
+    uint32_t m_nextSeq;
+    std::unordered_set<uint32_t> m_acks;
+    std::unordered_map<uint32_t, Relay> m_relays;
+
+    std::deque<Event> m_events;
+    std::condition_variable m_eventsChanged;
+    std::vector<std::thread> m_threads;
+};
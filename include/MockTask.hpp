@@ -2,17 +2,29 @@
     A mock task to help distributed task manager implementation
 */
 
-#include <condition_variable>
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <mutex>
+
+#include "InlineString.hpp"
+#include "InternedString.hpp"
 
 struct MockTaskView {
     std::string id;
-    std::string description;
+    InternedString description;
     int duration;
     std::string status;
 };
 
+// Nodes hold millions of tasks, so a task is kept small: its id is stored in
+// place up to the length of a UUID, its description is interned, its status and abort flag
+// share one atomic byte that every transition changes by compare-and-swap,
+// and create() takes it from a pool rather than the heap. A task owns no
+// lock; only compute() sleeping, and abort() waking it, use one shared with
+// other tasks.
 class MockTask {
 public:
     enum Status {
@@ -23,20 +35,58 @@ public:
         Failed
     };
 
-    MockTask(const std::string& description, int sleepTime);
+    MockTask(InternedString description, int sleepTime);
+    // For tasks created on another node, which keep the id they were given there
+    MockTask(const std::string& id, InternedString description, int sleepTime);
+    // Like the constructors, with the task and its reference counts in one
+    // pooled block
+    static std::shared_ptr<MockTask> create(InternedString description, int sleepTime);
+    static std::shared_ptr<MockTask> create(const std::string& id, InternedString description, int sleepTime);
+    // Moves a waiting task to running, so that whoever runs it can record
+    // that before compute() returns. Returns false if the task was cancelled.
+    // compute() calls it too.
+    bool start();
     void compute();
     void abort();
+    // Cancels the task only if it hasn't started, so it can be handed to
+    // another node. Returns false if it is already running or done.
+    bool withdraw();
+    // Records the status reported by the remote worker running this task. A
+    // task in a final status never goes back to waiting or running.
+    void setRemoteStatus(Status status);
     std::string getId() const;
+    const InternedString& getDescription() const;
+    Status getStatus() const;
     MockTaskView getView() const;
     bool isCancelled() const;
+    // Whether abort() was called, even if the task was already running then
+    bool isAborted() const;
+    // Where the registry keeps the task's row in its columns, set before the
+    // task is shared with other threads
+    void setRow(uint32_t row);
+    uint32_t getRow() const;
+
+    // Longest id a node takes from a peer. Ids made here are 36-byte UUIDs;
+    // the task table stores ids in place up to this length.
+    static const size_t maxIdLength = 39;
+
+    static std::string statusToString(Status status);
+    static Status statusFromString(const std::string& status);
+    // Finished, cancelled and failed tasks never change status again
+    static bool isFinal(Status status);
 private:
-    std::string m_id;
-    std::string m_description;
+    // Where compute() sleeps until the task is done or aborted
+    struct Parking;
+    Parking& parking() const;
+
+    // The status in the low bits, and the abort flag
+    static const uint8_t statusMask = 0x07;
+    static const uint8_t abortFlag = 0x08;
+
+    InlineString<36> m_id;
+    InternedString m_description;
     int m_sleepTimeMs;
-    Status m_status;
-    bool m_abort;
-    std::mutex m_mutex;
-    std::condition_variable m_condition;
+    uint32_t m_row;
+    std::atomic<uint8_t> m_state;
 };
 
-
@@ -0,0 +1,26 @@
+/*
+    Serves a task manager to remote nodes over the binary protocol: the task
+    operations for a coordinator pushing work, and leases for workers pulling it
+*/
+
+#pragma once
+
+#include <string>
+
+#include "FrameServer.hpp"
+#include "Protocol.hpp"
+#include "TaskManager.hpp"
+#include "WorkStealer.hpp"
+
+class NodeServer : public FrameServer {
+public:
+    // listenAddress is a port, "host:port" or "unix:/path". With a work
+    // stealer, peers can steal waiting tasks from this node, and lookups of
+    // tasks they took are forwarded to them.
+    NodeServer(TaskManager& taskManager, const std::string& listenAddress, WorkStealer* stealer = nullptr);
+protected:
+    void handle(const protocol::Frame& request, protocol::Writer& response, const std::string& remoteHost) override;
+private:
+    TaskManager& m_taskManager;
+    WorkStealer* m_stealer;
+};
@@ -0,0 +1,99 @@
+/*
+    Compact binary protocol spoken between the coordinator and worker nodes
+
+    Every message is a frame: a little-endian u32 length covering the rest of
+    the frame, a u8 message type, a u32 request id, then the payload. Requests
+    and responses use the same message type, and a response carries the id of
+    its request, so one connection can have many requests in flight. Integers
+    are little-endian, strings are a u32 length followed by raw bytes and task
+    statuses travel as a single byte.
+
+    Frames travel over TCP or Unix domain sockets alike.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/asio/generic/stream_protocol.hpp>
+
+#include "MockTask.hpp"
+
+namespace protocol {
+
+// A TCP or Unix domain stream socket
+using Socket = boost::asio::generic::stream_protocol::socket;
+
+enum class MessageType : uint8_t {
+    CreateTask = 1,
+    GetTask,
+    ListTasks,
+    CancelTask,
+    LeaseTasks,
+    Heartbeat,
+    SubmitTask,
+    ReleaseTask,
+    RequestVote,
+    AppendEntries,
+    Propose,
+    PeerHeartbeat,
+    StealTasks,
+    CountTasks
+};
+
+class ProtocolError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class Writer {
+public:
+    void writeU8(uint8_t value);
+    void writeU32(uint32_t value);
+    void writeI32(int32_t value);
+    void writeU64(uint64_t value);
+    void writeString(const std::string& value);
+    void writeBytes(const std::vector<uint8_t>& value);
+    void writeView(const MockTaskView& view);
+    void writeViews(const std::vector<MockTaskView>& views);
+
+    size_t size() const;
+    const std::vector<uint8_t>& buffer() const;
+private:
+    std::vector<uint8_t> m_buffer;
+};
+
+class Reader {
+public:
+    // Reads buffer from offset on
+    Reader(const std::vector<uint8_t>& buffer, size_t offset = 0);
+    size_t getOffset() const;
+    uint8_t readU8();
+    uint32_t readU32();
+    int32_t readI32();
+    uint64_t readU64();
+    std::string readString();
+    std::vector<uint8_t> readBytes();
+    // Element count of a list, checked against what is left in the message
+    uint32_t readCount();
+    MockTaskView readView();
+    std::vector<MockTaskView> readViews();
+private:
+    void require(size_t count) const;
+
+    const std::vector<uint8_t>& m_buffer;
+    size_t m_offset;
+};
+
+struct Frame {
+    MessageType type;
+    uint32_t requestId;
+    std::vector<uint8_t> payload;
+};
+
+void writeFrame(Socket& socket, MessageType type, uint32_t requestId, const Writer& payload);
+Frame readFrame(Socket& socket);
+}
@@ -0,0 +1,179 @@
+/*
+    Raft consensus replicating an opaque command log between a few nodes
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include "Connection.hpp"
+#include "Protocol.hpp"
+
+struct RaftEntry {
+    uint64_t term;
+    // Empty for the no-op a new leader appends to commit earlier terms
+    std::vector<uint8_t> command;
+};
+
+// Durable Raft state: current term and vote in a small state file, entries in
+// an append-only log file. Appends are buffered; sync() makes them durable,
+// so several appends can share one fsync.
+class RaftStorage {
+public:
+    RaftStorage(const std::string& directory, size_t selfIndex, bool syncWrites);
+    ~RaftStorage();
+
+    uint64_t getTerm() const;
+    // -1 when this node hasn't voted in the current term
+    int64_t getVotedFor() const;
+    const std::vector<RaftEntry>& getLoadedEntries() const;
+
+    void saveState(uint64_t term, int64_t votedFor);
+    void append(const RaftEntry& entry);
+    // Drops the entry at index (1-based) and everything after it
+    void truncate(uint64_t index);
+    // Throws if the flush fails
+    void sync();
+private:
+    void load();
+
+    std::string m_logPath;
+    std::string m_statePath;
+    bool m_syncWrites;
+    int m_fd;
+    uint64_t m_term;
+    int64_t m_votedFor;
+    std::vector<RaftEntry> m_loadedEntries;
+    // File size after each entry, to truncate at entry boundaries
+    std::vector<uint64_t> m_entryEnds;
+};
+
+// One member of a Raft group. Members are identified by their position in the
+// address list, which must be the same on every member.
+//
+// The leader streams AppendEntries to each follower without waiting for the
+// previous response, up to a bounded number in flight, and batches every entry
+// appended since the last send into the next request. Its own log is flushed
+// by a background group commit, in parallel with replication, so a burst of
+// proposals costs one fsync per batch rather than one per entry.
+class Raft {
+public:
+    // Runs committed commands in log order, on a single thread
+    using ApplyCallback = std::function<void(const std::vector<uint8_t>& command)>;
+    // Told true once this node leads and has applied everything committed
+    // before its term, and false when it stops leading. Runs on the apply thread.
+    using LeadershipCallback = std::function<void(bool leading)>;
+
+    Raft(size_t selfIndex, const std::vector<std::string>& members, const std::string& dataDirectory,
+         bool syncWrites, ApplyCallback apply, LeadershipCallback onLeadership);
+    // Starts serving peers and the election timer
+    void start();
+
+    // Appends a command to the log, forwarding it to the leader when this node
+    // isn't leading, and waits until it has been applied here. False if there
+    // is no leader or the command didn't commit in time.
+    bool replicate(const std::vector<uint8_t>& command, std::chrono::milliseconds timeout);
+    // Appends a command if this node leads, without waiting for it to commit
+    bool proposeIfLeader(const std::vector<uint8_t>& command);
+    bool isLeader() const;
+private:
+    enum class Role {
+        Follower,
+        Candidate,
+        Leader
+    };
+
+    struct Proposal {
+        uint64_t index;
+        uint64_t term;
+    };
+
+    struct Peer {
+        std::string address;
+        uint64_t nextIndex = 1;
+        uint64_t matchIndex = 0;
+        size_t inflight = 0;
+        // Commit index carried by the last request, so followers waiting to
+        // apply hear about a new one without waiting for the heartbeat
+        uint64_t commitSent = 0;
+        // Bumped on every reconnect, so responses read from an old
+        // connection are ignored
+        uint64_t generation = 0;
+        std::shared_ptr<protocol::Socket> replication;
+        std::chrono::steady_clock::time_point lastSend;
+        // Votes and forwarded proposals, which are rare and wait for replies
+        std::unique_ptr<Connection> calls;
+    };
+
+    // Everything below runs with m_mutex held unless noted
+    uint64_t lastIndex() const;
+    uint64_t termAt(uint64_t index) const;
+    size_t majority() const;
+    void resetElectionDeadline();
+    void persistState();
+    void appendEntry(RaftEntry entry);
+    void truncateFrom(uint64_t index);
+    void startElection();
+    void becomeLeader();
+    void stepDown(uint64_t term);
+    void advanceCommitIndex();
+    void resetPeer(Peer& peer);
+    std::optional<Proposal> propose(const std::vector<uint8_t>& command);
+    bool waitApplied(std::unique_lock<std::mutex>& lock, uint64_t index, std::chrono::milliseconds timeout);
+
+    // Thread bodies, which take m_mutex themselves
+    void runTimer();
+    void runApplier();
+    void runSyncer();
+    void runServer();
+    void replicateTo(size_t member);
+    void receiveFrom(size_t member, std::shared_ptr<protocol::Socket> socket, uint64_t generation);
+    void requestVote(size_t member, uint64_t term, uint64_t lastLogIndex, uint64_t lastLogTerm);
+    void serve(protocol::Socket socket);
+    void handleRequestVote(protocol::Reader& request, protocol::Writer& response);
+    void handleAppendEntries(protocol::Reader& request, protocol::Writer& response);
+    void handlePropose(protocol::Reader& request, protocol::Writer& response);
+
+    size_t m_self;
+    std::vector<std::string> m_members;
+    ApplyCallback m_apply;
+    LeadershipCallback m_onLeadership;
+    RaftStorage m_storage;
+
+    mutable std::mutex m_mutex;
+    // Signalled on every change to the log, commit index, roles and peers
+    std::condition_variable m_changed;
+    Role m_role;
+    uint64_t m_currentTerm;
+    int64_t m_votedFor;
+    std::optional<size_t> m_leader;
+    size_t m_votes;
+    std::vector<RaftEntry> m_log;
+    uint64_t m_durableIndex;
+    // Bumped on every truncation, so a sync that raced one isn't trusted
+    uint64_t m_truncations;
+    // Set once flushing the log fails. Linux may drop the unwritten pages
+    // then, so nothing after m_durableIndex is acknowledged or appended.
+    bool m_storageFailed;
+    uint64_t m_commitIndex;
+    uint64_t m_lastApplied;
+    // Index of this leader's no-op; leadership is announced once it applies
+    uint64_t m_leaderReadyIndex;
+    bool m_announcedLeading;
+    std::chrono::steady_clock::time_point m_electionDeadline;
+    std::vector<std::unique_ptr<Peer>> m_peers;
+
+    boost::asio::io_context m_io;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,55 @@
+/*
+    Client side of a connection to a worker node
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Connection.hpp"
+#include "Protocol.hpp"
+#include "TaskManager.hpp"
+
+struct LeaseGrant {
+    std::vector<MockTaskView> tasks;
+    std::chrono::milliseconds leaseDuration;
+};
+
+// Runs TaskBackend operations on a remote node. Calls are serialized over one
+// persistent connection, which is reopened after a failure. An unreachable node
+// behaves like an empty one: creation returns no id and lookups find nothing.
+class RemoteNode : public TaskBackend {
+public:
+    // address is "host:port"
+    RemoteNode(const std::string& address);
+
+    std::string executeCreateTask(const std::string& description, int duration) override;
+    MockTaskView viewTask(const std::string& id) const override;
+    std::vector<MockTaskView> viewAllTasks() const override;
+    bool cancelTask(const std::string& id) override;
+    TaskCounts countTasks() const override;
+
+    // Task placement by a coordinator that chooses ids itself. Both report
+    // failure instead of throwing: false, or an empty view.
+    bool submitTask(const MockTaskView& task);
+    MockTaskView releaseTask(const std::string& id);
+
+    // Lease protocol, for workers pulling tasks from this node. Unlike the
+    // TaskBackend operations these throw when the node can't be reached.
+    LeaseGrant leaseTasks(const std::string& workerId, size_t maxTasks);
+    std::vector<std::string> heartbeat(const std::string& workerId, const std::vector<TaskReport>& reports);
+
+    // Work stealing between worker nodes; these throw too. thiefPort is where
+    // the stealing node serves the binary protocol, so the victim can forward
+    // lookups of the stolen tasks to it.
+    TaskLoad heartbeatPeer();
+    std::vector<MockTaskView> stealTasks(unsigned short thiefPort, size_t maxTasks);
+
+    const std::string& getAddress() const;
+private:
+    protocol::Frame call(protocol::MessageType type, const protocol::Writer& request) const;
+
+    mutable Connection m_connection;
+};
@@ -0,0 +1,36 @@
+/*
+    Task registry replicated between coordinators through a Raft log
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Raft.hpp"
+#include "TaskManager.hpp"
+
+// Keeps the same task registry on every member of a Raft group. Creations,
+// cancellations and status changes go through the log, so any member can
+// serve reads and an acknowledged task survives the loss of a minority.
+// Only the leader runs tasks; a new leader reruns what was left waiting or
+// running under the previous one.
+class ReplicatedTaskManager : public TaskBackend {
+public:
+    ReplicatedTaskManager(size_t nTasks, size_t selfIndex, const std::vector<std::string>& members,
+                          const std::string& dataDirectory, bool syncWrites);
+
+    // Returns an empty id when the group can't commit the task, e.g. without
+    // a majority
+    std::string executeCreateTask(const std::string& description, int duration) override;
+    MockTaskView viewTask(const std::string& id) const override;
+    std::vector<MockTaskView> viewAllTasks() const override;
+    bool cancelTask(const std::string& id) override;
+    std::vector<MockTaskView> viewTasks(MockTask::Status status) const override;
+    TaskCounts countTasks() const override;
+private:
+    void apply(const std::vector<uint8_t>& command);
+
+    TaskManager m_taskManager;
+    Raft m_raft;
+};
@@ -0,0 +1,43 @@
+/*
+    REST responses written straight to their media type
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MediaType.hpp"
+#include "MockTask.hpp"
+#include "TaskColumns.hpp"
+
+// Renders the responses of the task routes into a buffer, in JSON with
+// JsonWriter or in MessagePack or CBOR with BinaryWriter, without building a
+// document first. The buffer keeps its capacity from one response to the
+// next, so a writer kept per thread stops allocating once it has written the
+// longest.
+class ResponseWriter {
+public:
+    virtual ~ResponseWriter() = default;
+
+    // Starts a new document, keeping the buffer
+    void clear() {
+        m_buffer.clear();
+    }
+    const std::string& str() const {
+        return m_buffer;
+    }
+    virtual MediaType mediaType() const = 0;
+
+    // {"id": ..., "status": ..., "description": ..., "duration": ...}
+    virtual void task(const MockTaskView& task) = 0;
+    // An array of tasks
+    virtual void tasks(const std::vector<MockTaskView>& tasks) = 0;
+    // {"Waiting": N, ...} for every status
+    virtual void counts(const TaskCounts& counts) = 0;
+    // {"key": "value"}, e.g. {"error": "Task not found"}
+    virtual void message(std::string_view key, std::string_view value) = 0;
+protected:
+    std::string m_buffer;
+};
@@ -0,0 +1,24 @@
+/*
+    Binary protocol endpoint for clients, alongside the REST API
+*/
+
+#pragma once
+
+#include <string>
+
+#include "FrameServer.hpp"
+#include "TaskManager.hpp"
+
+// Serves the REST API's task operations (CreateTask, GetTask, ListTasks and
+// CancelTask) over the binary protocol, for clients sending many requests.
+// Unlike REST calls these skip HTTP parsing, JSON and the command queue, and
+// a client may pipeline requests on one connection.
+class RpcServer : public FrameServer {
+public:
+    // listenAddress is a port, "host:port" or "unix:/path"
+    RpcServer(TaskBackend& backend, const std::string& listenAddress);
+protected:
+    void handle(const protocol::Frame& request, protocol::Writer& response, const std::string& remoteHost) override;
+private:
+    TaskBackend& m_backend;
+};
@@ -0,0 +1,92 @@
+/*
+    Waiting tasks moved out of memory, in queue order
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MockTask.hpp"
+
+// The back of a registry's waiting queue, kept on disk while the registry is
+// over its memory budget. Tasks are appended to segment files, path.1, path.2
+// and so on, and read back from the front in the order they came. Only an
+// open-addressing table of id hashes and file positions stays in memory,
+// about 32 bytes a task against the few hundred a registered task takes, so
+// tasks can still be found and removed by id, e.g. to cancel them. Removed
+// tasks leave their record behind, and a segment is deleted once read past.
+//
+// Reading from the front hints the kernel to read the next stretch of the
+// file ahead, so paging tasks back in is mostly a copy from the page cache.
+//
+// The segments are scratch space, not a store: the registry's TaskStore
+// already has every spilled task, so whatever a previous process left is
+// deleted on opening. Not thread-safe; the registry calls it with its lock
+// held.
+class SpillQueue {
+public:
+    // Opens an empty queue at path, deleting the segments of a previous one
+    explicit SpillQueue(const std::string& path);
+    ~SpillQueue();
+    SpillQueue(const SpillQueue&) = delete;
+    SpillQueue& operator=(const SpillQueue&) = delete;
+
+    // Appends a task at the back
+    void push(const MockTaskView& task);
+    // Removes and returns up to maxTasks tasks from the front
+    std::vector<MockTaskView> pop(size_t maxTasks);
+    std::optional<MockTaskView> find(const std::string& id);
+    // Returns what was removed, or nothing if the task isn't spilled
+    std::optional<MockTaskView> remove(const std::string& id);
+    // Every spilled task, front first
+    std::vector<MockTaskView> view();
+    size_t size() const;
+private:
+    struct Segment {
+        uint64_t number;
+        int fd;
+        // Bytes written, buffered ones included
+        uint64_t size;
+    };
+    struct Slot {
+        uint64_t hash;
+        // Segment number and offset of the record; see the constants in
+        // SpillQueue.cpp for the empty and removed slots
+        uint64_t position;
+    };
+
+    std::string segmentPath(uint64_t number) const;
+    void openSegment();
+    // Writes out the buffered records of the last segment
+    void flush();
+    // Reads the record data starts with into task, returning its size, or 0
+    // if it doesn't fit in size bytes
+    size_t parse(const uint8_t* data, size_t size, MockTaskView& task) const;
+    // The record at a position, which must hold one
+    MockTaskView read(uint64_t position);
+    // The slot holding position, or the empty slot ending hash's probes
+    size_t probe(uint64_t hash, uint64_t position) const;
+    // The slot of a task with this id, if it's spilled
+    std::optional<size_t> findSlot(const std::string& id);
+    void index(uint64_t hash, uint64_t position);
+    void unindex(size_t slot);
+    void rehash(size_t capacity);
+    // Starts over once nothing is left, deleting the segments
+    void reset();
+
+    std::string m_path;
+    std::deque<Segment> m_segments;
+    uint64_t m_nextSegment;
+    // Offset of the next record to pop in the first segment
+    uint64_t m_readOffset;
+    // Records appended to the last segment but not yet written
+    std::vector<uint8_t> m_buffer;
+    std::vector<Slot> m_slots;
+    size_t m_size;
+    size_t m_removedSlots;
+};
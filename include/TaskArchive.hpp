@@ -0,0 +1,97 @@
+/*
+    Compressed file of the finished tasks evicted from a registry
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "MockTask.hpp"
+
+// Which archived tasks an aggregate covers, and how it groups them
+struct ArchiveQuery {
+    // Only tasks whose description starts with this
+    std::string prefix;
+    // Only tasks finished in [from, to), in milliseconds since the epoch
+    int64_t from = std::numeric_limits<int64_t>::min();
+    int64_t to = std::numeric_limits<int64_t>::max();
+    // Groups tasks by this many leading characters of their description,
+    // or all together if zero
+    size_t groupLength = 0;
+};
+
+// Aggregates over a group of archived tasks
+struct TaskStats {
+    uint64_t tasks = 0;
+    // Indexed by MockTask::Status
+    uint64_t statuses[MockTask::Status::Failed + 1] = {};
+    int64_t durationSum = 0;
+    int32_t durationMin = std::numeric_limits<int32_t>::max();
+    int32_t durationMax = std::numeric_limits<int32_t>::min();
+
+    void add(const TaskStats& other);
+};
+
+// Keeps finished tasks on disk once the registry has let go of them, still
+// found by id, and answers aggregate queries over them.
+//
+// Tasks are appended in blocks. A block stores each field of its tasks as a
+// separately compressed column: finish times as deltas, statuses and
+// durations as plain arrays, descriptions as a dictionary of the distinct
+// ones plus a code per task, and ids. Aggregates decompress only the columns
+// they read, skip blocks whose finish times are out of range, evaluate the
+// description filter once per distinct description, and scan the rest in
+// tight loops over arrays, on several threads.
+//
+// Each block is preceded by the sorted hashes of the ids it holds. Only those
+// hashes stay in memory, 8 bytes a task, and a lookup decompresses just the
+// blocks whose hashes match. Opening the archive reads the block headers, not
+// the tasks, and drops a block torn by a crash. Everything is in the
+// machine's byte order.
+class TaskArchive {
+public:
+    // Opens or creates the archive at path
+    TaskArchive(const std::string& path);
+    ~TaskArchive();
+    TaskArchive(const TaskArchive&) = delete;
+    TaskArchive& operator=(const TaskArchive&) = delete;
+
+    // Appends tasks as one block, on disk when this returns; throws, leaving
+    // the archive as it was, if it can't be written or flushed. finishedAt
+    // holds when each task finished, in milliseconds since the epoch.
+    void append(const std::vector<MockTaskView>& tasks, const std::vector<int64_t>& finishedAt);
+    // The newest archived copy of the task
+    std::optional<MockTaskView> find(const std::string& id) const;
+    // Aggregates the tasks the query selects, by group
+    std::map<std::string, TaskStats> aggregate(const ArchiveQuery& query) const;
+    size_t size() const;
+private:
+    struct Block {
+        // Where the columns start in the file, and their size
+        uint64_t offset;
+        uint32_t size;
+        uint32_t tasks;
+        int64_t minFinishedAt;
+        int64_t maxFinishedAt;
+        std::vector<uint64_t> hashes;
+    };
+    struct Columns;
+
+    // Decompresses a block's columns, its ids only if asked to
+    Columns read(const Block& block, bool withIds) const;
+    void aggregateBlock(const Block& block, const ArchiveQuery& query, std::map<std::string, TaskStats>& groups) const;
+
+    std::string m_path;
+    int m_fd;
+    // Guards everything below
+    mutable std::shared_mutex m_mutex;
+    uint64_t m_end;
+    size_t m_tasks;
+    std::vector<Block> m_blocks;
+};
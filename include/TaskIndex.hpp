@@ -0,0 +1,58 @@
+/*
+    Registered tasks by id, readable without a lock
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "MockTask.hpp"
+#include "TaskSlots.hpp"
+
+// Finds a registry's tasks by id. One writer at a time changes it, under the
+// registry's lock, while any number of readers look tasks up with no lock at
+// all, holding an Epochs::Guard instead: entries are immutable, replaced and
+// removed by swapping pointers in an open-addressed table, and whatever a
+// writer unlinks, including the whole table when it grows, is retired to
+// Epochs rather than freed.
+class TaskIndex {
+public:
+    struct Entry {
+        std::string id;
+        TaskHandle handle;
+        // Valid for as long as the entry is, since tasks erased from the
+        // registry are retired along with their entries
+        MockTask* task;
+    };
+
+    TaskIndex();
+    ~TaskIndex();
+    TaskIndex(const TaskIndex&) = delete;
+    TaskIndex& operator=(const TaskIndex&) = delete;
+
+    // nullptr if there is no such task. Readers must hold an Epochs::Guard
+    // for as long as they use the entry.
+    const Entry* find(const std::string& id) const;
+
+    // For the writer. Replaces any entry under the id.
+    void insert(const std::string& id, TaskHandle handle, MockTask* task);
+    // Does nothing if there is no such task
+    void erase(const std::string& id);
+    void reserve(size_t tasks);
+    size_t size() const;
+private:
+    struct Table;
+
+    // For the writer: where id is, or the empty slot ending its probe
+    // sequence
+    size_t probe(const Table& table, const std::string& id) const;
+    // Moves the entries to a table of capacity slots and retires the old one
+    void rebuild(size_t capacity);
+
+    std::atomic<Table*> m_table;
+    size_t m_size;
+    // Slots left by erased entries, which probes skip over
+    size_t m_tombstones;
+};
@@ -0,0 +1,104 @@
+/*
+    Write-ahead log of the changes to a node's task registry
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MockTask.hpp"
+#include "TaskStore.hpp"
+
+// When an appended change counts as saved
+enum class Durability {
+    // Written to the operating system, so it survives the process crashing
+    // but not the machine
+    None,
+    // Flushed to disk every sync interval, so a power loss takes at most the
+    // last interval's changes
+    Batch,
+    // Flushed to disk before the operation that made it returns
+    EveryOp
+};
+
+std::optional<Durability> durabilityFromString(const std::string& durability);
+
+// Appends every task creation, cancellation, status change and removal to a
+// file, and rebuilds the registry from it on restart.
+//
+// A background thread flushes the file. Every change appended while a flush
+// is running shares the next one, so concurrent operations waiting for
+// durability pay for one fsync between them rather than one each.
+//
+// The log is split into segments, path.1, path.2 and so on. Once the segment
+// being appended to grows past a size limit, and whenever the node restarts,
+// a new one is started. Another background thread folds the finished segments
+// into a snapshot of the registry, path.snapshot, and deletes them. It works
+// from the files alone, so appends never wait for it. A restart reads the
+// snapshot and whatever segments came after it, decoding and applying them on
+// several threads.
+class TaskLog : public TaskStore {
+public:
+    // Opens or creates the log at path. With every-op durability the flusher
+    // waits syncInterval for more changes before each flush, trading latency
+    // for fewer flushes; with batch durability it flushes every syncInterval.
+    TaskLog(const std::string& path, Durability durability, std::chrono::milliseconds syncInterval);
+
+    ~TaskLog() override;
+
+    std::vector<MockTaskView> takeRecoveredTasks() override;
+    uint64_t logCreate(const MockTaskView& task) override;
+    uint64_t logStatus(const std::string& id, MockTask::Status status) override;
+    uint64_t logCancel(const std::string& id) override;
+    uint64_t logRemove(const std::string& id) override;
+    void commit(uint64_t position) override;
+private:
+    void load();
+    std::string segmentPath(uint64_t segment) const;
+    std::string snapshotPath() const;
+    // Starts segment, with m_mutex held
+    void openSegment(uint64_t segment);
+    uint64_t append(const std::vector<uint8_t>& record);
+    // Marks the log failed after a flush error and wakes those in commit(),
+    // with m_mutex held
+    void failFlush();
+    void runFlusher();
+    void runCompactor();
+    // Folds segments firstSegment to lastSegment into the snapshot, which
+    // covers everything before firstSegment
+    void compact(uint64_t firstSegment, uint64_t lastSegment);
+
+    std::string m_path;
+    Durability m_durability;
+    std::chrono::milliseconds m_syncInterval;
+    std::vector<MockTaskView> m_recoveredTasks;
+
+    // Guards everything below
+    std::mutex m_mutex;
+    // Wakes the flusher, and those waiting in commit()
+    std::condition_variable m_appended;
+    std::condition_variable m_flushed;
+    // Wakes the compactor
+    std::condition_variable m_sealed;
+    int m_fd;
+    // The segment appended to, its size, and the last one in the snapshot
+    uint64_t m_segment;
+    uint64_t m_segmentBytes;
+    uint64_t m_snapshotSegment;
+    // Records appended, and how many of them are known to be on disk
+    uint64_t m_written;
+    uint64_t m_synced;
+    // Set once a flush fails. Linux may drop the unwritten pages then, so a
+    // later flush succeeding proves nothing: the log takes no more changes.
+    bool m_failed;
+    bool m_stopping;
+    std::thread m_flusher;
+    std::thread m_compactor;
+};
@@ -0,0 +1,213 @@
+/*
+    Task registry and local worker pool
+*/
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "MockTask.hpp"
+#include "SpillQueue.hpp"
+#include "TaskArchive.hpp"
+#include "TaskColumns.hpp"
+#include "TaskIndex.hpp"
+#include "TaskSlots.hpp"
+#include "TaskStore.hpp"
+
+// Operations the REST commands run against, whether the tasks live in this
+// process or on remote worker nodes.
+class TaskBackend {
+public:
+    virtual ~TaskBackend() = default;
+    virtual std::string executeCreateTask(const std::string& description, int duration) = 0;
+    virtual MockTaskView viewTask(const std::string& id) const = 0;
+    virtual std::vector<MockTaskView> viewAllTasks() const = 0;
+    virtual bool cancelTask(const std::string& id) = 0;
+    // These pick out of viewAllTasks() unless the backend can do better
+    virtual std::vector<MockTaskView> viewTasks(MockTask::Status status) const;
+    virtual TaskCounts countTasks() const;
+};
+
+// Status of a leased task as seen by the worker running it
+struct TaskReport {
+    std::string id;
+    MockTask::Status status;
+};
+
+// How busy a node's worker pool is
+struct TaskLoad {
+    size_t waiting;
+    size_t idleWorkers;
+};
+
+class TaskManager : public TaskBackend {
+public:
+    // Told when a task run by this node's workers starts and when it ends
+    using StatusListener = std::function<void(const std::string& id, MockTask::Status status)>;
+
+    TaskManager(size_t nTasks, std::chrono::milliseconds leaseDuration = std::chrono::milliseconds(5000));
+
+    std::string executeCreateTask(const std::string& description, int duration) override;
+    MockTaskView viewTask(const std::string& id) const override;
+    std::vector<MockTaskView> viewAllTasks() const override;
+    bool cancelTask(const std::string& id) override;
+    // Scan the status column instead of every task
+    std::vector<MockTaskView> viewTasks(MockTask::Status status) const override;
+    TaskCounts countTasks() const override;
+
+    // Registers a task created on another node under its id and status,
+    // queuing it if it is still waiting
+    void submitTask(const MockTaskView& task);
+    // Removes a task that isn't running, so it can move to another node.
+    // Returns what was removed, or an empty view if the task is unknown or
+    // running.
+    MockTaskView releaseTask(const std::string& id);
+
+    // Hands up to maxTasks waiting tasks to a remote worker. The grant shrinks
+    // to what the worker's measured throughput can get through in half a lease,
+    // so slow workers don't sit on work that faster ones could run.
+    std::vector<MockTaskView> leaseTasks(const std::string& workerId, size_t maxTasks);
+    // Applies a worker's status reports and renews its leases on the reported
+    // tasks. Returns the ids the worker must abort: tasks cancelled here, or
+    // whose lease already lapsed and went back to the queue.
+    std::vector<std::string> heartbeat(const std::string& workerId, const std::vector<TaskReport>& reports);
+    std::chrono::milliseconds getLeaseDuration() const;
+    // Takes back every lease a worker known to be dead holds, without waiting
+    // for them to expire
+    void revokeLeases(const std::string& workerId);
+
+    // Records a status decided elsewhere, e.g. by a replicated log
+    void setTaskStatus(const std::string& id, MockTask::Status status);
+    // A node that isn't executing keeps the registry but runs and leases
+    // nothing. Turning execution on requeues every waiting task, along with
+    // tasks left running by the node that executed them before.
+    void setExecuting(bool executing);
+    void setStatusListener(StatusListener listener);
+
+    // Restores the tasks the store recovered, then records every change to
+    // the registry in it. Creations, cancellations and removals return once
+    // the store holds them as durably as it promises; status changes don't
+    // wait, so a task whose completion was lost in a crash runs again. If the
+    // store holds finished tasks, they are looked up there instead of being
+    // kept in memory. Call before any task is created. Returns how many tasks
+    // were restored.
+    size_t setStore(std::unique_ptr<TaskStore> store);
+    // Forgets finished tasks once they have been finished for ttl, removing
+    // them from the store too. A background thread sweeps them a slice at a
+    // time, so requests never wait long behind it. Given an archive, evicted
+    // tasks are written to it first and viewTask still finds them there,
+    // though listings no longer show them. Call once, after setStore.
+    void setRetention(std::chrono::milliseconds ttl, std::unique_ptr<TaskArchive> archive);
+    // Keeps the registered tasks within roughly bytes of memory without
+    // turning any away: past the budget, new waiting tasks go to spill
+    // instead, behind those spilled before them, and a background thread
+    // brings them back in queue order whenever the waiting queue in memory
+    // runs low. Spilled tasks are still found, listed, counted and cancelled.
+    // Finished tasks count against the budget but never spill, so a node
+    // taking bursts for long also needs retention or a task table. Call
+    // once, before setStore.
+    void setMemoryBudget(size_t bytes, std::unique_ptr<SpillQueue> spill);
+
+    TaskLoad getLoad() const;
+    // Removes up to maxTasks waiting tasks from the back of the queue, the
+    // ones furthest from running, skipping the ids in keep. Returns them as
+    // they were before removal.
+    std::vector<MockTaskView> takeWaitingTasks(size_t maxTasks, const std::unordered_set<std::string>& keep);
+private:
+    struct Lease {
+        std::string workerId;
+        TaskHandle task;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    struct LeaseHolder {
+        std::chrono::steady_clock::time_point lastHeartbeat;
+        // Tasks completed per second, smoothed over heartbeats
+        double throughput = 0;
+        std::vector<std::string> pendingCancels;
+    };
+
+    // Puts a task in m_slots, m_tasks and a row, replacing any task under its
+    // id, with m_tasksMutex held
+    TaskHandle insertTask(std::shared_ptr<MockTask> task);
+    // Takes a task out of all three, with m_tasksMutex held
+    void eraseTask(const TaskIndex::Entry& entry);
+    // Sends a task to m_spill instead of registering it if the registry is
+    // over its budget or tasks are already spilled, with m_tasksMutex held.
+    // Returns whether it did.
+    bool spill(const MockTask& task);
+    // Copies a task's status to its row, after every change
+    void updateRow(const MockTask& task);
+    // The task, kept alive beyond m_tasksMutex, or nullptr if it is gone
+    std::shared_ptr<MockTask> share(TaskHandle handle) const;
+    void enqueue(std::shared_ptr<MockTask> task);
+    void addTask(const MockTaskView& task);
+    // Records a final status reached here
+    void finish(const std::string& id, MockTask::Status status);
+    void reapExpiredLeases();
+    // Starts the retention period of a task that just finished, with
+    // m_tasksMutex held
+    void retain(const std::string& id);
+    void sweepFinishedTasks();
+    // Moves spilled tasks back to the waiting queue as it runs low
+    void pageIn();
+
+    // Owns the registered tasks, which everything else names by handle
+    TaskSlots m_slots;
+    // The handle of every task in m_slots, by id. viewTask reads it without
+    // the lock, so tasks erased from m_slots are retired to Epochs.
+    TaskIndex m_tasks;
+    // A row for every task in m_slots, which listings and counts scan
+    TaskColumns m_columns;
+    std::unique_ptr<TaskStore> m_store;
+    std::deque<TaskHandle> m_waitingTasks;
+    std::vector<std::thread> m_workers;
+    std::condition_variable m_condition;
+    bool m_executing;
+    StatusListener m_statusListener;
+    // Ids of the tasks this node's workers are computing right now
+    std::unordered_set<std::string> m_computing;
+    // Guards m_waitingTasks, m_executing, m_computing and the lease tables
+    mutable std::mutex m_mutex;
+    // Guards m_slots and m_tasks, which worker nodes update from several
+    // connections at once
+    mutable std::mutex m_tasksMutex;
+
+    std::unordered_map<std::string, Lease> m_leases;
+    std::unordered_map<std::string, LeaseHolder> m_leaseHolders;
+    std::chrono::milliseconds m_leaseDuration;
+    std::thread m_leaseReaper;
+
+    // Zero when finished tasks are kept forever
+    std::chrono::milliseconds m_retention;
+    std::unique_ptr<TaskArchive> m_archive;
+    struct FinishedTask {
+        std::chrono::steady_clock::time_point expiry;
+        // Milliseconds since the epoch, for the archive
+        int64_t finishedAt;
+        std::string id;
+    };
+    // Finished tasks in the order they expire, guarded by m_tasksMutex
+    std::deque<FinishedTask> m_finishedTasks;
+    std::thread m_sweeper;
+
+    // The back of the waiting queue while over budget, guarded by
+    // m_tasksMutex; nullptr without a budget
+    std::unique_ptr<SpillQueue> m_spill;
+    size_t m_memoryBudget;
+    // Roughly what the tasks in m_slots take, guarded by m_tasksMutex
+    size_t m_residentBytes;
+    // Wakes m_pager, waiting on m_mutex
+    std::condition_variable m_pagerCondition;
+    std::thread m_pager;
+};
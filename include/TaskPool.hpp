@@ -0,0 +1,96 @@
+/*
+    Pooled allocation of small objects of one size
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// Hands out blocks of one size carved from large slabs, and recycles freed
+// blocks through a free list instead of returning them to the system, so
+// creating and destroying millions of tasks neither fragments the heap nor
+// pays malloc's per-block header. Each thread keeps a short free list of its
+// own and trades blocks with the shared one in batches, so most allocations
+// and frees take no lock.
+class SlabPool {
+public:
+    // The pool for blocks of Size bytes. It is never destroyed, so blocks can
+    // still be freed while the process shuts down.
+    template<size_t Size>
+    static SlabPool& instance() {
+        static SlabPool* pool = new SlabPool(Size);
+        return *pool;
+    }
+
+    void* allocate();
+    void deallocate(void* block);
+    size_t getBlockSize() const;
+    // Bytes taken from the system so far
+    size_t getReservedBytes() const;
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    struct ThreadCache {
+        FreeBlock* head = nullptr;
+        size_t count = 0;
+    };
+    struct ThreadCaches;
+
+    explicit SlabPool(size_t blockSize);
+    // This thread's cache, or nullptr once the thread is tearing it down
+    ThreadCache* threadCache();
+    // Moves a batch from the shared free list, or from a new slab
+    void refill(ThreadCache& cache);
+    // Gives the shared free list all but keep of the cached blocks
+    void drain(ThreadCache& cache, size_t keep);
+
+    size_t m_blockSize;
+    // Which of each thread's caches is this pool's
+    size_t m_index;
+    // Guards everything below
+    mutable std::mutex m_mutex;
+    FreeBlock* m_free;
+    uint8_t* m_slab;
+    size_t m_slabUsed;
+    size_t m_reservedBytes;
+};
+
+// Allocator for std::allocate_shared that takes single objects from the
+// SlabPool for their size, and anything else from the heap
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if(n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(SlabPool::instance<sizeof(T)>().allocate());
+    }
+
+    void deallocate(T* object, size_t n) {
+        if(n != 1) {
+            ::operator delete(object);
+            return;
+        }
+        SlabPool::instance<sizeof(T)>().deallocate(object);
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const {
+        return true;
+    }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const {
+        return false;
+    }
+};
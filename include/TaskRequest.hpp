@@ -0,0 +1,39 @@
+/*
+    Parsing of REST request bodies
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include "MediaType.hpp"
+
+// The fields of a POST /taches body, {"description": "...", "duration": N}
+struct CreateTaskRequest {
+    // Views the body, with any escapes still in it if escaped is set
+    std::string_view description;
+    bool escaped;
+    int duration;
+
+    // The description with its escapes resolved
+    std::string descriptionString() const;
+};
+
+// Parses a POST /taches body in one pass over it, without building a document
+// or copying anything out of it. Other members of the object are checked and
+// skipped. Returns the fields, or what is wrong with the body.
+std::variant<CreateTaskRequest, const char*> parseCreateTask(std::string_view body);
+
+// The fields of a POST /taches body sent as MessagePack or CBOR
+struct DecodedCreateTask {
+    std::string description;
+    int duration;
+};
+
+// Decodes a MessagePack or CBOR body with nlohmann's readers. Binary bodies
+// come from our own clients, which send no more than the two fields, so this
+// builds a document rather than parsing in one pass. Returns the fields, or
+// what is wrong with the body.
+std::variant<DecodedCreateTask, const char*> decodeCreateTask(std::string_view body, MediaType type);
@@ -0,0 +1,68 @@
+/*
+    Tasks addressed by generational index
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "MockTask.hpp"
+
+// Names a task in a TaskSlots. Handles are plain values, so queues and lease
+// tables pass them around without touching the task's reference count. Once
+// the task is erased its slot moves on to the next generation, so a handle
+// kept past that resolves to nothing rather than to whichever task reuses
+// the slot.
+struct TaskHandle {
+    uint32_t index = 0;
+    // Generations start at 1, so a default handle never resolves
+    uint32_t generation = 0;
+
+    bool operator==(const TaskHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const TaskHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+// Owns a registry's tasks in a vector of slots, looked up by handle in
+// constant time without hashing. Freed slots are reused. Not thread-safe:
+// the registry guards it with its own lock, and shares a task when it needs
+// it beyond that lock, e.g. to compute it.
+class TaskSlots {
+public:
+    TaskSlots();
+
+    TaskHandle insert(std::shared_ptr<MockTask> task);
+    // nullptr if the handle is stale
+    MockTask* get(TaskHandle handle) const;
+    // The task kept alive for as long as the caller holds it, or nullptr if
+    // the handle is stale
+    std::shared_ptr<MockTask> share(TaskHandle handle) const;
+    // Returns the task, for the caller to release once nothing still uses
+    // it, or nullptr if the handle is stale
+    std::shared_ptr<MockTask> erase(TaskHandle handle);
+    size_t size() const;
+
+    // Calls visit(handle, task) for every task
+    template<typename Visit>
+    void forEach(Visit visit) const {
+        for(uint32_t i = 0; i < m_slots.size(); ++i) {
+            if(m_slots[i].task) {
+                visit(TaskHandle{i, m_slots[i].generation}, *m_slots[i].task);
+            }
+        }
+    }
+private:
+    struct Slot {
+        std::shared_ptr<MockTask> task;
+        uint32_t generation = 1;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+    size_t m_size;
+};
@@ -0,0 +1,39 @@
+/*
+    Where a node keeps its tasks beyond the process's memory
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MockTask.hpp"
+
+// Told of every change to a TaskManager's tasks, to keep them across restarts.
+// This one keeps nothing, for a registry that doesn't survive restarts.
+class TaskStore {
+public:
+    virtual ~TaskStore() = default;
+
+    // Hands over the tasks the store held when it was opened, for the
+    // registry to take back, in creation order. Tasks left running by the
+    // previous process are waiting again.
+    virtual std::vector<MockTaskView> takeRecoveredTasks();
+
+    // Each returns a position to pass to commit()
+    virtual uint64_t logCreate(const MockTaskView& task);
+    virtual uint64_t logStatus(const std::string& id, MockTask::Status status);
+    virtual uint64_t logCancel(const std::string& id);
+    virtual uint64_t logRemove(const std::string& id);
+    // Waits until everything up to position is as durable as promised.
+    // Throws if it can't be.
+    virtual void commit(uint64_t position);
+
+    // Whether the store serves finished tasks itself, so the registry can
+    // forget them. Such a store only hands unfinished tasks back on restart.
+    virtual bool holdsFinishedTasks() const;
+    virtual std::optional<MockTaskView> findTask(const std::string& id) const;
+    virtual std::vector<MockTaskView> viewFinishedTasks() const;
+};
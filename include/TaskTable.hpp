@@ -0,0 +1,95 @@
+/*
+    Task registry kept in memory-mapped files of fixed-size records
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "TaskStore.hpp"
+
+// A file mapped into memory, growing by remapping
+class MappedFile {
+public:
+    // Opens or creates path, at least minimumSize bytes long
+    MappedFile(const std::string& path, size_t minimumSize);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Moves the mapping, so pointers into it don't survive
+    void resize(size_t size);
+    uint8_t* data() const;
+    size_t size() const;
+private:
+    int m_fd;
+    uint8_t* m_data;
+    size_t m_size;
+};
+
+// Keeps every task as a fixed-size record in a memory-mapped file, found by id
+// through an open-addressing hash index mapped from a second file, with the
+// descriptions appended to a third. Opening the table maps the files and reads
+// nothing else, whatever the number of tasks, and the page cache decides which
+// records stay in memory, so a node can hold tens of millions of finished
+// tasks without keeping them on its heap.
+//
+// Records are written in place, in the machine's byte order. Every change is
+// in the page cache as soon as it is made, so the table survives the process
+// crashing but, unlike a log with fsync, not the machine. Removed tasks leave
+// their record and description behind.
+//
+// Task ids are at most 39 bytes, which fits the UUIDs nodes generate.
+class TaskTable : public TaskStore {
+public:
+    // Opens or creates the table at path, path.index and path.descriptions
+    TaskTable(const std::string& path);
+
+    // The unfinished tasks, found without reading the records of tasks that
+    // finished before the oldest unfinished one
+    std::vector<MockTaskView> takeRecoveredTasks() override;
+    uint64_t logCreate(const MockTaskView& task) override;
+    uint64_t logStatus(const std::string& id, MockTask::Status status) override;
+    uint64_t logCancel(const std::string& id) override;
+    uint64_t logRemove(const std::string& id) override;
+
+    bool holdsFinishedTasks() const override;
+    std::optional<MockTaskView> findTask(const std::string& id) const override;
+    std::vector<MockTaskView> viewFinishedTasks() const override;
+private:
+    struct Header;
+    struct Record;
+    struct IndexHeader;
+
+    Header& header() const;
+    Record& record(uint64_t index) const;
+    IndexHeader& indexHeader() const;
+    uint64_t* slots() const;
+
+    // Everything below runs with m_mutex held
+    // The index slot holding id's record, and the record itself
+    std::optional<uint64_t> findSlot(const std::string& id) const;
+    std::optional<uint64_t> find(const std::string& id) const;
+    // Adds a record to the index, growing it when needed
+    void index(uint64_t recordIndex);
+    // Puts a record in a free slot, with room already made
+    void insert(uint64_t recordIndex);
+    // Rebuilds the index from the records, with room for growth
+    void reindex();
+    uint64_t appendDescription(const std::string& description);
+    MockTaskView view(const Record& record) const;
+    // Moves the start of the unfinished tasks past those that finished
+    void skipFinished();
+
+    std::string m_path;
+    mutable std::shared_mutex m_mutex;
+    MappedFile m_records;
+    MappedFile m_descriptions;
+    std::unique_ptr<MappedFile> m_index;
+};
@@ -4,9 +4,15 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace utils {
 
 std::string generateUUID();
+std::vector<std::string> split(const std::string& text, char separator);
+// FNV-1a, which unlike std::hash is the same in every build, for hashes kept
+// on disk
+uint64_t stableHash(const std::string& text);
 }
\ No newline at end of file
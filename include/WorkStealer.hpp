@@ -0,0 +1,65 @@
+/*
+    Work stealing between worker nodes that tasks are pushed to
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "RemoteNode.hpp"
+#include "TaskManager.hpp"
+
+// Lets an idle worker node take waiting tasks from a backlogged peer, so a
+// node that was handed the long tasks doesn't hold up work others could run.
+//
+// Nodes poll their peers' load with heartbeats. A node whose queue is empty
+// and has idle threads asks the peer with the longest queue for a batch. The
+// victim only gives from a queue of several tasks and keeps at least half of
+// it, and a stolen task is never given away again, so tasks don't bounce
+// between nodes.
+//
+// The coordinator still looks tasks up on the node its ring assigns them to.
+// That node remembers where each stolen task went and forwards lookups and
+// cancellations there. Listings come from the node running a task, so a
+// coordinator lists stolen tasks only if it also pushes to the thief.
+class WorkStealer {
+public:
+    // port is where this node serves the binary protocol; peers are the other
+    // worker nodes as "host:port"
+    WorkStealer(TaskManager& taskManager, unsigned short port, const std::vector<std::string>& peers);
+    // Exchanges heartbeats and steals forever
+    void run();
+
+    // Victim side, for the node server
+    TaskLoad getLoad() const;
+    std::vector<MockTaskView> giveTasks(const std::string& thiefAddress, size_t maxTasks);
+    // Node a task was given to, or null if it wasn't given away
+    std::shared_ptr<RemoteNode> findThief(const std::string& id) const;
+    // The task was placed back on this node, e.g. by a rebalance
+    void taskReturned(const std::string& id);
+private:
+    struct Peer {
+        std::shared_ptr<RemoteNode> node;
+        TaskLoad load{0, 0};
+        bool reachable = false;
+    };
+
+    void exchangeHeartbeats();
+    void stealIfIdle();
+
+    TaskManager& m_taskManager;
+    unsigned short m_port;
+    std::vector<Peer> m_peers;
+
+    mutable std::mutex m_mutex;
+    // Tasks stolen by this node, which it never gives away
+    std::unordered_set<std::string> m_stolen;
+    // Tasks this node gave away, and the node that took each
+    std::unordered_map<std::string, std::shared_ptr<RemoteNode>> m_givenTo;
+    std::unordered_map<std::string, std::shared_ptr<RemoteNode>> m_thieves;
+};